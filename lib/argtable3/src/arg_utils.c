@@ -37,6 +37,7 @@
 #endif
 
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -79,8 +80,24 @@ void arg_set_panic(arg_panicfn* proc) {
     s_panic = proc;
 }
 
+/*
+ * Every allocation of the library goes through these hooks, malloc/realloc/free
+ * unless the application installs its own allocator (an arena, a pool).
+ * Install it before the first arg_xxx constructor, the hooks must free what they
+ * allocated.
+ */
+static arg_mallocfn* s_malloc = malloc;
+static arg_reallocfn* s_realloc = realloc;
+static arg_freefn* s_free = free;
+
+void arg_set_allocator(arg_mallocfn* malloc_fn, arg_reallocfn* realloc_fn, arg_freefn* free_fn) {
+    s_malloc = malloc_fn ? malloc_fn : malloc;
+    s_realloc = realloc_fn ? realloc_fn : realloc;
+    s_free = free_fn ? free_fn : free;
+}
+
 void* xmalloc(size_t size) {
-    void* ret = malloc(size);
+    void* ret = s_malloc(size);
     if (!ret) {
         s_panic("Out of memory!\n");
     }
@@ -90,16 +107,20 @@ void* xmalloc(size_t size) {
 void* xcalloc(size_t count, size_t size) {
     size_t allocated_count = count && size ? count : 1;
     size_t allocated_size = count && size ? size : 1;
-    void* ret = calloc(allocated_count, allocated_size);
+    if (allocated_size && allocated_count > SIZE_MAX / allocated_size) {
+        s_panic("Out of memory!\n");
+    }
+    void* ret = s_malloc(allocated_count * allocated_size);
     if (!ret) {
         s_panic("Out of memory!\n");
     }
+    memset(ret, 0, allocated_count * allocated_size);
     return ret;
 }
 
 void* xrealloc(void* ptr, size_t size) {
     size_t allocated_size = size ? size : 1;
-    void* ret = realloc(ptr, allocated_size);
+    void* ret = s_realloc(ptr, allocated_size);
     if (!ret) {
         s_panic("Out of memory!\n");
     }
@@ -107,7 +128,7 @@ void* xrealloc(void* ptr, size_t size) {
 }
 
 void xfree(void* ptr) {
-    free(ptr);
+    s_free(ptr);
 }
 
 static void merge(void* data, int esize, int i, int j, int k, arg_comparefn* comparefn) {
@@ -77,6 +77,9 @@ typedef void(arg_errorfn)(void* parent, arg_dstr_t ds, int error, const char* ar
 typedef void(arg_dstr_freefn)(char* buf);
 typedef int(arg_cmdfn)(int argc, char* argv[], arg_dstr_t res);
 typedef int(arg_comparefn)(const void* k1, const void* k2);
+typedef void*(arg_mallocfn)(size_t size);
+typedef void*(arg_reallocfn)(void* ptr, size_t size);
+typedef void(arg_freefn)(void* ptr);
 
 /*
  * The arg_hdr struct defines properties that are common to all arg_xxx structs.
@@ -267,6 +270,7 @@ ARG_EXTERN void arg_make_syntax_err_msg(arg_dstr_t ds, void** argtable, struct a
 ARG_EXTERN int arg_make_syntax_err_help_msg(arg_dstr_t ds, char* name, int help, int nerrors, void** argtable, struct arg_end* end, int* exitcode);
 ARG_EXTERN void arg_set_module_name(const char* name);
 ARG_EXTERN void arg_set_module_version(int major, int minor, int patch, const char* tag);
+ARG_EXTERN void arg_set_allocator(arg_mallocfn* malloc_fn, arg_reallocfn* realloc_fn, arg_freefn* free_fn);
 
 /**** deprecated functions, for back-compatibility only ********/
 ARG_EXTERN void arg_free(void** argtable);
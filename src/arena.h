@@ -0,0 +1,132 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <Arduino.h>
+#include <argtable3.h>
+
+#define ARENA_OBJECT_BYTES 16384    // argtable3 objects built by setupCommands() and kept for the whole run, 14.6 KB on a 64-bit host, less with 4-byte pointers.
+#define ARENA_SCRATCH_BYTES 2048    // One command line: parseArgx(), arg_parse() option tables, TRex programs, help text. 1.4 KB on a host.
+#define ARENA_ALIGN 8               // Block alignment, also the size of a block header.
+
+#define ARENA_EMPTY 0xFFFFFFFF     // No block below.
+#define ARENA_FREED 0x80000000     // Set in arenaHeader.size once freed.
+
+// Every argtable3 allocation goes to one of two static regions instead of the heap, which is left to the frame buffers.
+// Objects are bump allocated once in setup, the scratch region is bumped during a command and reset after it in O(1).
+// A freed block is marked and the top drops below every freed block on it: arg_parse() frees its tables in reverse
+// order and TRex its compiled program in any order, so the scratch peak stays near one parse. A region that is full
+// falls back to malloc() and counts it.
+typedef struct{
+    uint32_t size;          // Bytes after the header, ARENA_FREED once freed.
+    uint32_t below;         // Offset of the header of the block below, ARENA_EMPTY for the first one.
+} arenaHeader;
+static_assert(sizeof(arenaHeader) == ARENA_ALIGN, "arenaHeader must keep blocks aligned");
+
+typedef struct{
+    byte* base;
+    size_t size;
+    size_t top;
+    uint32_t last;          // Offset of the header of the top block, ARENA_EMPTY when empty.
+    size_t peak;
+    uint32_t allocations;
+    uint32_t fallbacks;
+} arenaRegion;
+
+alignas(ARENA_ALIGN) byte arenaObjectMemory[ARENA_OBJECT_BYTES];
+alignas(ARENA_ALIGN) byte arenaScratchMemory[ARENA_SCRATCH_BYTES];
+arenaRegion arenaObjects = {arenaObjectMemory, ARENA_OBJECT_BYTES, 0, ARENA_EMPTY, 0, 0, 0};
+arenaRegion arenaScratch = {arenaScratchMemory, ARENA_SCRATCH_BYTES, 0, ARENA_EMPTY, 0, 0, 0};
+arenaRegion* arenaCurrent = &arenaObjects;
+
+inline bool arenaOwns(arenaRegion* region, void* pointer){
+    return (byte*) pointer >= region->base && (byte*) pointer < region->base + region->size;
+}
+
+inline arenaHeader* arenaHeaderOf(void* pointer){
+    return (arenaHeader*) ((byte*) pointer - ARENA_ALIGN);
+}
+
+inline size_t arenaRound(size_t size){
+    return (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+}
+
+// A zero size still gets a block of its own, base + size is past the region and arenaFree() would hand it to free().
+// A size larger than the region falls back before arenaRound() can wrap it.
+void* arenaAllocate(size_t size){
+    arenaRegion* region = arenaCurrent;
+    size_t blockSize = (size == 0) ? ARENA_ALIGN : arenaRound(size);
+    if(size > region->size || region->top + ARENA_ALIGN + blockSize > region->size){
+        region->fallbacks++;
+        return malloc(size);
+    }
+    arenaHeader* header = (arenaHeader*) (region->base + region->top);
+    header->size = blockSize;
+    header->below = region->last;
+    region->last = region->top;
+    region->top += ARENA_ALIGN + blockSize;
+    region->allocations++;
+    if(region->top > region->peak){
+        region->peak = region->top;
+    }
+    return (byte*) header + ARENA_ALIGN;
+}
+
+void arenaFree(void* pointer){
+    arenaRegion* region = arenaOwns(&arenaScratch, pointer) ? &arenaScratch : arenaOwns(&arenaObjects, pointer) ? &arenaObjects : NULL;
+    if(region == NULL){
+        free(pointer);
+        return;
+    }
+    arenaHeaderOf(pointer)->size |= ARENA_FREED;
+    while(region->last != ARENA_EMPTY && (((arenaHeader*) (region->base + region->last))->size & ARENA_FREED)){
+        region->top = region->last;
+        region->last = ((arenaHeader*) (region->base + region->last))->below;
+    }
+}
+
+// The top block grows in place, any other one is copied to a new block.
+void* arenaReallocate(void* pointer, size_t size){
+    if(pointer == NULL){
+        return arenaAllocate(size);
+    }
+    if(!arenaOwns(&arenaScratch, pointer) && !arenaOwns(&arenaObjects, pointer)){
+        return realloc(pointer, size);
+    }
+    arenaRegion* region = arenaCurrent;
+    arenaHeader* header = arenaHeaderOf(pointer);
+    size_t oldSize = header->size;
+    size_t blockSize = arenaRound(size);
+    if((byte*) header == region->base + region->last && region->last + ARENA_ALIGN + blockSize <= region->size){
+        header->size = blockSize;
+        region->top = region->last + ARENA_ALIGN + blockSize;
+        if(region->top > region->peak){
+            region->peak = region->top;
+        }
+        return pointer;
+    }
+    void* block = arenaOwns(region, pointer) ? arenaAllocate(size) : malloc(size); // An object outlives the scratch region.
+    if(block != NULL){
+        memcpy(block, pointer, (oldSize < size) ? oldSize : size);
+        arenaFree(pointer);
+    }
+    return block;
+}
+
+// Before the first argtable3 constructor.
+void arenaBegin(){
+    arenaCurrent = &arenaObjects;
+    arg_set_allocator(&arenaAllocate, &arenaReallocate, &arenaFree);
+}
+
+// Once the commands are built, later allocations only live for one command.
+void arenaSeal(){
+    arenaCurrent = &arenaScratch;
+}
+
+// After each command line, nothing allocated while serving it is used any more.
+void arenaReset(){
+    arenaScratch.top = 0;
+    arenaScratch.last = ARENA_EMPTY;
+}
+
+#endif
\ No newline at end of file
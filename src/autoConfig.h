@@ -0,0 +1,353 @@
+#ifndef AUTOCONFIG_H
+#define AUTOCONFIG_H
+
+#include <Arduino.h>
+#include <camera.h>
+#include <stream.h>
+#include <threads.h>
+#include <linkBench.h>
+#include <transport.h>
+
+#define AUTO_CONFIG_HEADROOM_PERCENT 90     // Share of the measured link throughput a configuration may plan for.
+#define AUTO_CONFIG_FRAME_OVERHEAD (TRANSMIT_HEADER_BYTES + 2)  // "FRAME" header and "\r\n" around every frame.
+#define AUTO_CONFIG_CHECK_MS 1000           // Shortest window the stream is measured over.
+#define AUTO_CONFIG_CHECK_FRAMES 8          // Frame periods per window at low frame rates.
+#define AUTO_CONFIG_DRIFT_PERCENT 15        // Frame rate this far below the target steps the configuration down.
+#define AUTO_CONFIG_RECOVER_CHECKS 5        // Windows on target before a budget lowered by drift is raised again.
+#define AUTO_CONFIG_MAX_RATE_FACTOR 2      // Sensor rate at most this times the target to make up for frames the capture drops.
+#define AUTO_CONFIG_SCALES 3
+
+const uint8_t autoConfigScales[AUTO_CONFIG_SCALES] = {1, 2, 4};
+const uint8_t autoConfigFormats[2] = {RGB565, GRAYSCALE};   // Best first, GRAYSCALE halves the bytes of a frame.
+
+// A resolution, format and readout scale, with the sensor rate that reaches the target and the throughput it needs.
+typedef struct{
+    uint8_t resolution;
+    uint8_t format;
+    uint8_t scale;
+    uint8_t fps;                // Sensor rate, the clock divider makes it at least the target.
+    uint16_t width;
+    uint16_t height;
+    size_t frameBytes;
+    uint32_t bytesPerSecond;
+} autoConfigChoice;
+
+// "autoConfig": picks the largest frame that the link carries at the target rate, then follows the stream and steps down
+// when the rate drifts below the target, up again once it held the target for a while.
+typedef struct{
+    bool active;
+    uint8_t fps;
+    uint8_t planFPS;                // Rate the settings are chosen for, raised above fps while the capture drops frames.
+    uint8_t minResolution;
+    transport* link;
+    uint32_t linkBytesPerSecond;    // Kept "benchLink" result the governor started from.
+    uint32_t budgetBytesPerSecond;  // Lowered by drift, raised back towards the link result.
+    autoConfigChoice choice;
+    bool warm;                      // A window of the current stream was measured already.
+    uint32_t checkedMillis;
+    uint32_t framesChecked;         // Whole frames sent, torn ones left out.
+    uint32_t bytesChecked;
+    uint32_t tornChecked;           // Torn frames and overruns.
+    uint32_t droppedChecked;
+    uint8_t stableChecks;
+    uint32_t lastFrameRate100;      // Frame rate of the last window, in hundredths.
+    uint32_t lastBytesPerSecond;
+    uint32_t stepsDown;
+    uint32_t stepsUp;
+    uint32_t rateSteps;
+} autoConfigState;
+
+autoConfigState autoConfig;
+
+// Lowest sensor rate whose frame period is no longer than the target's, 0 when even 30 fps falls short.
+uint8_t autoConfigSensorFPS(uint8_t fps){
+    for(uint16_t rate = fps; rate <= CAMERA_MAX_FPS; rate++){
+        if(CAMERA_BASE_FPS >= (uint16_t) fps * cameraClockDivider(rate)){
+            return rate;
+        }
+    }
+    return 0;
+}
+
+// Highest sensor rate the readout keeps up with at resolution. Once a frame was captured its measured readout sets it,
+// scaled to the pixels of the resolution and to the undivided pixel clock, since the lines come at the pace of the
+// divider it was read at. The cameraMaxFPS() model only stands in before the first frame.
+uint8_t autoConfigMaxFPS(uint8_t resolution, uint8_t format){
+    if(captureStats.lastFrameMicros == 0){
+        return cameraMaxFPS(resolution, format);
+    }
+    uint64_t measuredPixels = (uint64_t) cameraWidths[captureStats.lastFrameResolution] * cameraHeights[captureStats.lastFrameResolution];
+    uint64_t readoutMicros = (uint64_t) captureStats.lastFrameMicros * cameraWidths[resolution] * cameraHeights[resolution]
+                             / (measuredPixels * cameraClockDivider(captureStats.lastFrameFPS));
+    uint64_t maxFPS = (readoutMicros == 0) ? CAMERA_MAX_FPS : 1000000 / readoutMicros;
+    return (maxFPS == 0) ? 1 : (maxFPS > CAMERA_MAX_FPS) ? CAMERA_MAX_FPS : maxFPS;
+}
+
+// Most pixels first, then colour, then the smaller sensor mode, which leaves the readout more room.
+bool autoConfigBetter(const autoConfigChoice* candidate, const autoConfigChoice* best){
+    uint32_t candidatePixels = (uint32_t) candidate->width * candidate->height;
+    uint32_t bestPixels = (uint32_t) best->width * best->height;
+    if(candidatePixels != bestPixels){
+        return candidatePixels > bestPixels;
+    }
+    if(formatBytesPerPixel(candidate->format) != formatBytesPerPixel(best->format)){
+        return formatBytesPerPixel(candidate->format) > formatBytesPerPixel(best->format);
+    }
+    return candidate->resolution > best->resolution;
+}
+
+// Every resolution down to minResolution, both formats and the readout scales: the best one the readout and the budget allow.
+int autoConfigChoose(uint8_t fps, uint8_t minResolution, uint32_t budgetBytesPerSecond, autoConfigChoice* choice){
+    uint8_t sensorFPS = autoConfigSensorFPS(fps);
+    if(sensorFPS == 0){
+        return 1;
+    }
+    uint32_t minPixels = (uint32_t) cameraWidths[minResolution] * cameraHeights[minResolution];
+    uint64_t budget = (uint64_t) budgetBytesPerSecond * AUTO_CONFIG_HEADROOM_PERCENT / 100;
+    bool found = false;
+    for(uint8_t resolution = 0; resolution <= QQVGA; resolution++){
+        for(uint8_t format = 0; format < 2; format++){
+            if(sensorFPS > autoConfigMaxFPS(resolution, autoConfigFormats[format])){
+                continue;
+            }
+            for(uint8_t scale = 0; scale < AUTO_CONFIG_SCALES; scale++){
+                autoConfigChoice candidate;
+                candidate.resolution = resolution;
+                candidate.format = autoConfigFormats[format];
+                candidate.scale = autoConfigScales[scale];
+                candidate.fps = sensorFPS;
+                candidate.width = (cameraWidths[resolution] + candidate.scale - 1) / candidate.scale;
+                candidate.height = (cameraHeights[resolution] + candidate.scale - 1) / candidate.scale;
+                candidate.frameBytes = (size_t) candidate.width * candidate.height * formatBytesPerPixel(candidate.format);
+                candidate.bytesPerSecond = (uint32_t) ((uint64_t) (candidate.frameBytes + AUTO_CONFIG_FRAME_OVERHEAD) * 1000000 / cameraFramePeriodMicros(sensorFPS));
+                // Two bands hold the frame only while the link takes its lines as fast as they are read, not over the whole period.
+                bool bands = streamBands(candidate.frameBytes);
+                uint64_t needed = bands ? (uint64_t) candidate.bytesPerSecond * CAMERA_BLANKING_NUMERATOR / CAMERA_BLANKING_DENOMINATOR : candidate.bytesPerSecond;
+                if((uint32_t) candidate.width * candidate.height < minPixels || needed > budget){
+                    continue;
+                }
+                if(!found || autoConfigBetter(&candidate, choice)){
+                    *choice = candidate;
+                    found = true;
+                }
+            }
+        }
+    }
+    return found ? 0 : 1;
+}
+
+bool autoConfigSame(const autoConfigChoice* first, const autoConfigChoice* second){
+    return first->resolution == second->resolution && first->format == second->format && first->scale == second->scale && first->fps == second->fps;
+}
+
+// verbose false keeps text off the link, for a change in the middle of a stream.
+int applyAutoConfig(const autoConfigChoice* choice, uint8_t maxTries, bool verbose){
+    cameraResolution = choice->resolution;
+    cameraFormat = choice->format;
+    cameraFPS = choice->fps;
+    resetCameraWindow(&cameraRoi);
+    if(choice->scale != 1){
+        cameraRoi = {0, 0, cameraWidths[choice->resolution], cameraHeights[choice->resolution], choice->scale};
+    }
+    if(verbose){
+        return reconfigureCamera(maxTries);
+    }
+#if CAMERA_DELTA_RECONFIGURATION
+    if(applyCameraDelta() == 0){
+        return 0;
+    }
+#endif
+    return cameraReady ? setupCamera(maxTries, false) : startCamera(maxTries);
+}
+
+void printAutoConfigChoice(const autoConfigChoice* choice){
+    commandLink->print(choice->width);
+    commandLink->print("x");
+    commandLink->print(choice->height);
+    commandLink->print(" ");
+    commandLink->print(cameraFormatName(choice->format));
+    commandLink->print(" (resolution ");
+    commandLink->print(choice->resolution);
+    commandLink->print(", scale ");
+    commandLink->print(choice->scale);
+    commandLink->print(") at ");
+    commandLink->print(choice->fps);
+    commandLink->print(" fps, ");
+    commandLink->print(choice->bytesPerSecond);
+    commandLink->print(" bytes/s");
+}
+
+int startAutoConfig(uint8_t fps, uint8_t minResolution, transport* link, uint32_t linkBytesPerSecond, const autoConfigChoice* choice){
+    autoConfig.active = true;
+    autoConfig.fps = fps;
+    autoConfig.planFPS = fps;
+    autoConfig.minResolution = minResolution;
+    autoConfig.link = link;
+    autoConfig.linkBytesPerSecond = linkBytesPerSecond;
+    autoConfig.budgetBytesPerSecond = linkBytesPerSecond;
+    autoConfig.choice = *choice;
+    autoConfig.warm = false;
+    autoConfig.stableChecks = 0;
+    autoConfig.lastFrameRate100 = 0;
+    autoConfig.lastBytesPerSecond = 0;
+    autoConfig.stepsDown = 0;
+    autoConfig.stepsUp = 0;
+    autoConfig.rateSteps = 0;
+    return 0;
+}
+
+// Manual settings take over from the governor.
+void stopAutoConfig(){
+    if(!autoConfig.active){
+        return;
+    }
+    autoConfig.active = false;
+    commandLink->println("autoConfig turned off, the settings are manual again.");
+}
+
+// The stream is restarted on the new settings, its frames keep counting. A "MODE <width> <height> <format> <fps>\r\n"
+// record on the frame link tells the host the size of the frames after it.
+void restartAutoConfigStream(const autoConfigChoice* choice, uint8_t maxTries){
+    bool threaded = (captureOwner == CAPTURE_FOR_THREADS);
+    uint32_t remaining = stream.remaining;
+    uint32_t sequence = stream.sequence;
+    uint32_t framesSent = stream.framesSent;
+    uint32_t framesTorn = stream.framesTorn;
+    stopCapture();
+    if(applyAutoConfig(choice, maxTries, false)){
+        autoConfig.active = false;
+        commandLink->println("autoConfig failed to apply the camera settings, stream stopped.");
+        return;
+    }
+    autoConfig.choice = *choice;
+    autoConfig.warm = false;
+
+    frameLink = autoConfig.link;
+    frameLink->print("MODE ");
+    frameLink->print(choice->width);
+    frameLink->print(" ");
+    frameLink->print(choice->height);
+    frameLink->print(" ");
+    frameLink->print(cameraFormatName(choice->format));
+    frameLink->print(" ");
+    frameLink->print(choice->fps);
+    frameLink->print("\r\n");
+    if(threaded ? startStreamThreads(remaining) : startStream(remaining)){
+        autoConfig.active = false;
+        commandLink->println("autoConfig failed to restart the stream.");
+        return;
+    }
+    stream.sequence = sequence;
+    stream.framesSent = framesSent;
+    stream.framesTorn = framesTorn;
+}
+
+// A torn frame reached the host but is not a frame of the target rate.
+uint32_t autoConfigWholeFrames(){
+    return stream.framesSent - stream.framesTorn;
+}
+
+// Called on every loop(): once per window of a stream, the frame rate it reached is compared with the target. Torn frames
+// and overruns mean the link fell behind, the frame gets smaller. Frames the capture dropped on its own mean the readout
+// misses frames the link had room for, the sensor runs faster instead.
+void serviceAutoConfig(uint8_t maxTries){
+    if(!autoConfig.active || !streamRunning() || !stream.capturing){
+        return;
+    }
+    uint32_t now = millis();
+    uint32_t window = AUTO_CONFIG_CHECK_FRAMES * cameraFramePeriodMicros(autoConfig.choice.fps) / 1000;
+    window = (window > AUTO_CONFIG_CHECK_MS) ? window : AUTO_CONFIG_CHECK_MS;
+    if(!autoConfig.warm){
+        autoConfig.warm = true;     // The first window of a stream includes its start, it is not measured.
+        autoConfig.checkedMillis = now;
+        autoConfig.framesChecked = autoConfigWholeFrames();
+        autoConfig.bytesChecked = stream.bytesSent;
+        autoConfig.tornChecked = stream.framesTorn + stream.overruns;
+        autoConfig.droppedChecked = captureStats.framesDropped;
+        return;
+    }
+    uint32_t elapsed = now - autoConfig.checkedMillis;
+    if(elapsed < window){
+        return;
+    }
+    int32_t frames = (int32_t) (autoConfigWholeFrames() - autoConfig.framesChecked);
+    frames = (frames > 0) ? frames : 0;
+    uint32_t bytes = stream.bytesSent - autoConfig.bytesChecked;
+    bool linkBehind = (stream.framesTorn + stream.overruns != autoConfig.tornChecked);
+    bool captureDropped = (captureStats.framesDropped != autoConfig.droppedChecked);
+    autoConfig.checkedMillis = now;
+    autoConfig.framesChecked = autoConfigWholeFrames();
+    autoConfig.bytesChecked = stream.bytesSent;
+    autoConfig.tornChecked = stream.framesTorn + stream.overruns;
+    autoConfig.droppedChecked = captureStats.framesDropped;
+    autoConfig.lastFrameRate100 = (uint32_t) ((uint64_t) frames * 100000 / elapsed);
+    autoConfig.lastBytesPerSecond = (uint32_t) ((uint64_t) bytes * 1000 / elapsed);
+
+    autoConfigChoice choice;
+    if(autoConfig.lastFrameRate100 * 100 < (uint32_t) autoConfig.fps * 100 * (100 - AUTO_CONFIG_DRIFT_PERCENT)){
+        autoConfig.stableChecks = 0;
+        if(captureDropped && !linkBehind && frames != 0){
+            if(autoConfig.choice.fps >= CAMERA_MAX_FPS || autoConfig.choice.fps >= AUTO_CONFIG_MAX_RATE_FACTOR * autoConfig.fps || autoConfigChoose(autoConfig.choice.fps + 1, autoConfig.minResolution, autoConfig.budgetBytesPerSecond, &choice)){
+                return;
+            }
+            autoConfig.planFPS = autoConfig.choice.fps + 1;
+            autoConfig.rateSteps++;
+            restartAutoConfigStream(&choice, maxTries);
+            return;
+        }
+
+        // Frames went out back to back and still fell short: what they moved is what the link carries now.
+        uint32_t budget = (uint32_t) ((uint64_t) autoConfig.lastBytesPerSecond * 100 / AUTO_CONFIG_HEADROOM_PERCENT);
+        uint32_t current = (uint32_t) ((uint64_t) autoConfig.choice.bytesPerSecond * 100 / AUTO_CONFIG_HEADROOM_PERCENT);
+        autoConfig.budgetBytesPerSecond = (budget < current) ? budget : current - 1;
+        if(autoConfigChoose(autoConfig.planFPS, autoConfig.minResolution, autoConfig.budgetBytesPerSecond, &choice)){
+            autoConfig.budgetBytesPerSecond = current - 1;  // Torn frames carry little, the next smaller settings are tried instead.
+            if(autoConfigChoose(autoConfig.planFPS, autoConfig.minResolution, autoConfig.budgetBytesPerSecond, &choice)){
+                return;
+            }
+        }
+        if(!autoConfigSame(&choice, &autoConfig.choice)){
+            autoConfig.stepsDown++;
+            restartAutoConfigStream(&choice, maxTries);
+        }
+        return;
+    }
+
+    if(autoConfig.budgetBytesPerSecond >= autoConfig.linkBytesPerSecond || ++autoConfig.stableChecks < AUTO_CONFIG_RECOVER_CHECKS){
+        return;
+    }
+    autoConfig.stableChecks = 0;
+    uint32_t raised = autoConfig.budgetBytesPerSecond + autoConfig.budgetBytesPerSecond / 4 + 1;
+    autoConfig.budgetBytesPerSecond = (raised < autoConfig.linkBytesPerSecond) ? raised : autoConfig.linkBytesPerSecond;
+    if(autoConfigChoose(autoConfig.planFPS, autoConfig.minResolution, autoConfig.budgetBytesPerSecond, &choice) == 0 && !autoConfigSame(&choice, &autoConfig.choice)){
+        autoConfig.stepsUp++;
+        restartAutoConfigStream(&choice, maxTries);
+    }
+}
+
+void printAutoConfigStats(){
+    if(!autoConfig.active){
+        return;
+    }
+    commandLink->print("\tautoConfig: ");
+    commandLink->print(autoConfig.fps);
+    commandLink->print(" fps target, ");
+    printAutoConfigChoice(&autoConfig.choice);
+    commandLink->print(", budget ");
+    commandLink->print(autoConfig.budgetBytesPerSecond);
+    commandLink->print(" of ");
+    commandLink->print(autoConfig.linkBytesPerSecond);
+    commandLink->print(" bytes/s, last window ");
+    commandLink->print(autoConfig.lastFrameRate100 / 100);
+    commandLink->print(".");
+    commandLink->print(autoConfig.lastFrameRate100 / 10 % 10);
+    commandLink->print(" fps, ");
+    commandLink->print(autoConfig.stepsDown);
+    commandLink->print(" steps down, ");
+    commandLink->print(autoConfig.stepsUp);
+    commandLink->print(" up, ");
+    commandLink->print(autoConfig.rateSteps);
+    commandLink->print(" faster.\n");
+}
+
+#endif
\ No newline at end of file
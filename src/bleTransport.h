@@ -0,0 +1,339 @@
+#ifndef BLETRANSPORT_H
+#define BLETRANSPORT_H
+
+#include <Arduino.h>
+#include <ArduinoBLE.h>
+#include <utility/ATT.h>
+#include <mbed.h>
+#include <transport.h>
+
+#define BLE_TRANSPORT_NAME "Nano33BLE-Camera"
+#define BLE_DEFAULT_MTU 23
+#define BLE_MAX_PAYLOAD 244             // Longest notification: ATT MTU 247, one 251 byte LE data packet.
+#define BLE_QUEUE_BYTES 2048            // Output of one characteristic waiting for credits.
+#define BLE_INPUT_BYTES 256
+#define BLE_CREDITS 6                   // Notifications handed to the controller ahead of the connection events.
+#define BLE_NOTIFICATIONS_PER_EVENT 3   // What the controller is first assumed to send in one event.
+#define BLE_INTERVAL_MIN 6              // Connection interval asked for, in 1.25 ms units: 7.5 to 15 ms.
+#define BLE_INTERVAL_MAX 12
+#define BLE_INTERVAL_MICROS 15000       // Longest interval asked for, the first estimate of the one the central chose.
+#define BLE_CREDIT_MIN_MICROS 1000      // Bounds of the estimated time the controller takes per notification.
+#define BLE_CREDIT_MAX_MICROS 100000
+#define BLE_CREDIT_PROBE 64             // Notifications taken at once, under credit waits, before the estimate is shortened.
+#define BLE_BLOCKED_MICROS 2000         // A writeValue() this long waited inside ArduinoBLE for a controller buffer.
+#define BLE_LINGER_MICROS 7500          // A partial payload waits this long for more output before it goes out alone.
+#define BLE_WRITE_TIMEOUT_MS 1000       // Longest write() waits for queue room to grow, the rest is dropped after it.
+#define BLE_MTU_HANDLES 4               // Connection handles searched for the negotiated MTU.
+
+// Image service: the central writes command lines to the control characteristic and gets the responses notified on
+// it, photos and streams asked for there are notified on the data characteristic, in the same records as on serial.
+BLEService bleImageService("4E330001-6D1A-4B6E-9C4A-0F3B2D1E5A70");
+BLECharacteristic bleControl("4E330002-6D1A-4B6E-9C4A-0F3B2D1E5A70", BLEWrite | BLEWriteWithoutResponse | BLENotify, BLE_MAX_PAYLOAD);
+BLECharacteristic bleData("4E330003-6D1A-4B6E-9C4A-0F3B2D1E5A70", BLENotify, BLE_MAX_PAYLOAD);
+
+// Credits bound the notifications the controller holds: one is spent per notification and one comes back each time the
+// controller should have sent one, so several notifications go in each event without the controller running out of
+// buffers (ArduinoBLE would then wait inside writeValue()). That time is an estimate: ArduinoBLE reports neither the
+// interval the central chose nor the controller's completed packets, so it starts from the interval asked for and is
+// learnt from what happens to the notifications, see bleAdaptCredits().
+typedef struct{
+    bool started;
+    bool connected;
+    uint16_t mtu;
+    uint8_t credits;
+    uint32_t refilledAt;
+    uint32_t creditMicros;  // Estimated time the controller takes per notification, a credit comes back after it.
+    uint32_t taken;         // Notifications taken at once since the controller was last found full.
+    uint32_t probed;        // Of those, taken since the estimate was last shortened.
+    uint32_t notifications;
+    uint32_t partial;       // Notifications shorter than the payload, sent after BLE_LINGER_MICROS without output.
+    uint64_t bytes;
+    uint32_t creditWaits;   // Sends that stopped with full payloads left for want of credits.
+    uint32_t refused;       // writeValue() calls the stack refused.
+    uint32_t blocked;       // writeValue() calls that waited for a controller buffer.
+    uint32_t dropped;       // Bytes written while no central listened or the queue stayed full.
+} bleLinkState;
+
+bleLinkState ble;
+rtos::Mutex bleMutex;   // ArduinoBLE is not thread safe, the transmit thread and loop() take turns.
+
+// ArduinoBLE keeps the MTU each central negotiated in ATT and has no accessor for the connection's handle.
+uint16_t bleNegotiatedMtu(){
+    uint16_t mtu = BLE_DEFAULT_MTU;
+    for(uint16_t handle = 0; handle < BLE_MTU_HANDLES; handle++){
+        uint16_t handleMtu = ATT.mtu(handle);
+        mtu = (handleMtu > mtu) ? handleMtu : mtu;
+    }
+    return mtu;
+}
+
+// From an empty or a full controller: its next connection event may be up to an interval away, the first credit comes
+// back after BLE_NOTIFICATIONS_PER_EVENT credit times, the ones after it at the estimated pace. Spread over the
+// interval from the start, they would let more than BLE_CREDITS notifications wait for the event.
+void bleHoldCredits(){
+    ble.refilledAt = micros() + ble.creditMicros * (BLE_NOTIFICATIONS_PER_EVENT - 1);
+}
+
+// Called before every send: a new connection starts with all credits and the MTU it negotiated.
+void bleRefresh(){
+    bool connected = ble.started && BLE.connected();
+    if(connected && !ble.connected){
+        ble.credits = BLE_CREDITS;
+        ble.refilledAt = micros();
+        ble.creditMicros = BLE_INTERVAL_MICROS / BLE_NOTIFICATIONS_PER_EVENT;
+        ble.taken = BLE_CREDIT_PROBE;   // A first refusal may be the initial burst, not the pace.
+        ble.probed = 0;
+    }
+    ble.connected = connected;
+    if(!connected){
+        return;
+    }
+    ble.mtu = bleNegotiatedMtu();
+    int32_t elapsed = (int32_t) (micros() - ble.refilledAt);    // Below 0 while bleHoldCredits() holds them.
+    uint32_t returned = (elapsed > 0) ? elapsed / ble.creditMicros : 0;
+    if(returned != 0){
+        ble.refilledAt += returned * ble.creditMicros;
+        uint32_t credits = ble.credits + returned;
+        ble.credits = (credits < BLE_CREDITS) ? credits : BLE_CREDITS;
+    }
+}
+
+// A notification refused, or held inside writeValue() until a connection event freed a buffer, means the controller
+// is full now: the credits count again from here, and a quarter slower when it was found full less than
+// BLE_CREDIT_PROBE notifications ago. A run of BLE_CREDIT_PROBE notifications taken at once while the credits were the
+// limit shortens the estimate by an eighth, so a faster link than the first estimate is found.
+void bleAdaptCredits(bool controllerFull){
+    if(controllerFull){
+        if(ble.taken < BLE_CREDIT_PROBE){
+            uint32_t longer = ble.creditMicros + ble.creditMicros / 4;
+            ble.creditMicros = (longer < BLE_CREDIT_MAX_MICROS) ? longer : BLE_CREDIT_MAX_MICROS;
+        }
+        ble.credits = 0;
+        bleHoldCredits();
+        ble.taken = 0;
+        ble.probed = 0;
+    }
+    else if(ble.probed >= BLE_CREDIT_PROBE){
+        uint32_t shorter = ble.creditMicros - ble.creditMicros / 8;
+        ble.creditMicros = (shorter > BLE_CREDIT_MIN_MICROS) ? shorter : BLE_CREDIT_MIN_MICROS;
+        ble.probed = 0;
+    }
+}
+
+size_t blePayloadBytes(){
+    size_t payload = ble.mtu - 3;
+    return (payload < BLE_MAX_PAYLOAD) ? payload : BLE_MAX_PAYLOAD;
+}
+
+// One notify characteristic: output is queued and leaves in payloads that fill the MTU, as credits allow.
+class bleNotifyTransport : public transport{
+    public:
+        explicit bleNotifyTransport(BLECharacteristic& characteristic) : characteristic(characteristic){}
+
+        using transport::write;
+        size_t write(const uint8_t* buffer, size_t size) override{
+            bleMutex.lock();
+            uint32_t start = millis();
+            size_t offset = 0;
+            while(offset < size){
+                if(!connected()){
+                    ble.dropped += size - offset;
+                    break;
+                }
+                compact();
+                size_t count = BLE_QUEUE_BYTES - queued;
+                count = (count < size - offset) ? count : size - offset;
+                memcpy(queue + queued, buffer + offset, count);
+                queued += count;
+                offset += count;
+                lastWrite = micros();
+                start = (count != 0) ? millis() : start;
+                send(false);
+                if(offset < size){
+                    if(millis() - start > BLE_WRITE_TIMEOUT_MS){
+                        ble.dropped += size - offset;
+                        break;
+                    }
+                    BLE.poll();
+                    yield();
+                }
+            }
+            bleMutex.unlock();
+            return size;
+        }
+
+        size_t writev(const transportSegment* segments, size_t count) override{
+            bleMutex.lock();    // Recursive, write() takes it again.
+            size_t written = transport::writev(segments, count);
+            bleMutex.unlock();
+            return written;
+        }
+
+        int availableForWrite() override{
+            return connected() ? BLE_QUEUE_BYTES - (queued - sent) : 0;
+        }
+
+        // Full payloads at once, a partial one once no output came for BLE_LINGER_MICROS.
+        void flush() override{
+            bleMutex.lock();
+            send(micros() - lastWrite >= BLE_LINGER_MICROS);
+            bleMutex.unlock();
+        }
+
+        size_t read(byte* buffer, size_t size) override{
+            (void) buffer;
+            (void) size;
+            return 0;
+        }
+
+        bool connected() override{
+            return ble.started && BLE.connected() && characteristic.subscribed();
+        }
+        const char* name() override{ return "bleData"; }
+
+        size_t pending(){ return queued - sent; }
+
+    protected:
+        void send(bool partial){
+            bleRefresh();
+            size_t payload = blePayloadBytes();
+            while(sent < queued && (queued - sent >= payload || partial)){
+                if(ble.credits == 0){
+                    ble.creditWaits++;
+                    bleAdaptCredits(false);
+                    return;
+                }
+                if(ble.credits == BLE_CREDITS){
+                    bleHoldCredits();
+                }
+                size_t chunk = (queued - sent < payload) ? queued - sent : payload;
+                uint32_t start = micros();
+                if(!characteristic.writeValue(queue + sent, chunk)){
+                    ble.refused++;
+                    bleAdaptCredits(true);
+                    return;
+                }
+                ble.credits--;
+                if(micros() - start > BLE_BLOCKED_MICROS){
+                    ble.blocked++;
+                    bleAdaptCredits(true);
+                }
+                else{
+                    ble.taken++;
+                    ble.probed++;
+                }
+                ble.notifications++;
+                ble.partial += (chunk < payload) ? 1 : 0;
+                ble.bytes += chunk;
+                sent += chunk;
+            }
+        }
+
+        // Sent bytes are dropped from the front before new ones are queued.
+        void compact(){
+            if(sent == 0){
+                return;
+            }
+            memmove(queue, queue + sent, queued - sent);
+            queued -= sent;
+            sent = 0;
+        }
+
+        BLECharacteristic& characteristic;
+        uint8_t queue[BLE_QUEUE_BYTES];
+        size_t queued = 0;
+        size_t sent = 0;
+        uint32_t lastWrite = 0;
+};
+
+bleNotifyTransport bleDataLink(bleData);
+
+// The control characteristic: command lines in, responses out. Frames asked for here go to the data characteristic.
+class bleControlTransport : public bleNotifyTransport{
+    public:
+        bleControlTransport() : bleNotifyTransport(bleControl){}
+
+        int begin(){
+            if(!BLE.begin()){
+                return 1;
+            }
+            BLE.setLocalName(BLE_TRANSPORT_NAME);
+            BLE.setConnectionInterval(BLE_INTERVAL_MIN, BLE_INTERVAL_MAX);
+            BLE.setAdvertisedService(bleImageService);
+            bleImageService.addCharacteristic(bleControl);
+            bleImageService.addCharacteristic(bleData);
+            BLE.addService(bleImageService);
+            BLE.advertise();
+            ble.started = true;
+            ble.mtu = BLE_DEFAULT_MTU;
+            return 0;
+        }
+
+        size_t read(byte* buffer, size_t size) override{
+            if(!ble.started){
+                return 0;
+            }
+            if(inputLength == 0){
+                bleMutex.lock();
+                BLE.poll();
+                if(bleControl.written()){
+                    size_t length = bleControl.valueLength();
+                    length = (length < BLE_INPUT_BYTES) ? length : BLE_INPUT_BYTES;
+                    memcpy(input, bleControl.value(), length);
+                    inputLength = length;
+                    inputRead = 0;
+                }
+                bleMutex.unlock();
+            }
+            size_t count = (inputLength - inputRead < size) ? inputLength - inputRead : size;
+            memcpy(buffer, input + inputRead, count);
+            inputRead += count;
+            if(inputRead == inputLength){
+                inputLength = 0;
+            }
+            return count;
+        }
+
+        void flush() override{
+            bleNotifyTransport::flush();
+            bleDataLink.flush();
+        }
+
+        transport* frames() override{ return &bleDataLink; }
+        const char* name() override{ return "ble"; }
+
+    private:
+        byte input[BLE_INPUT_BYTES];
+        size_t inputLength = 0;
+        size_t inputRead = 0;
+};
+
+bleControlTransport bleLink;
+
+void printBleStats(){
+    if(!ble.started){
+        return;
+    }
+    commandLink->print("\tBLE: ");
+    commandLink->print(ble.connected ? "connected, MTU " : "advertising, MTU ");
+    commandLink->print(ble.mtu);
+    commandLink->print(", ");
+    commandLink->print(ble.notifications);
+    commandLink->print(" notifications (");
+    commandLink->print(ble.partial);
+    commandLink->print(" partial), ");
+    commandLink->print((uint32_t) ble.bytes);
+    commandLink->print(" bytes, ");
+    commandLink->print(ble.creditWaits);
+    commandLink->print(" credit waits, ");
+    commandLink->print(ble.refused);
+    commandLink->print(" refused, ");
+    commandLink->print(ble.blocked);
+    commandLink->print(" blocked, a credit every ");
+    commandLink->print(ble.creditMicros);
+    commandLink->print(" us, ");
+    commandLink->print(ble.dropped);
+    commandLink->print(" bytes dropped.\n");
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,109 @@
+#ifndef BOOTTRACE_H
+#define BOOTTRACE_H
+
+#include <Arduino.h>
+#include <transport.h>
+
+#if !defined(ARDUINO_ARCH_MBED)
+#include <chrono>
+#endif
+
+#define BOOT_TRACE_ENTRIES 48
+#define BOOT_TRACE_PHASES 16        // Slots only phase marks take, steps inside a phase never crowd them out.
+
+// Power-on to first frame timeline, recorded in a static buffer and printed by the "bootTrace" command.
+typedef struct{
+    const char* label;
+    uint32_t micros;    // micros() since power-on, for gaps longer than the cycle counter wraps.
+    uint32_t cycles;    // Cycle counter, wraps after 67 s at 64 MHz.
+} bootTraceEntry;
+
+bootTraceEntry bootTraceEntries[BOOT_TRACE_ENTRIES];
+uint8_t bootTraceCount = 0;
+uint8_t bootTraceSteps = 0;
+uint16_t bootTraceDropped = 0;     // Marks that found the buffer full.
+bool bootTraceClosed = false;
+
+#if defined(ARDUINO_ARCH_MBED)
+#define BOOT_TRACE_HZ SystemCoreClock
+
+void bootTraceStart(){
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+inline uint32_t bootTraceCycles(){
+    return DWT->CYCCNT;
+}
+#else
+#define BOOT_TRACE_HZ 1000000000UL // Host cycles are steady_clock nanoseconds.
+
+void bootTraceStart(){}
+
+inline uint32_t bootTraceCycles(){
+    return (uint32_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+void bootTraceRecord(const char* label){
+    bootTraceEntries[bootTraceCount].cycles = bootTraceCycles();
+    bootTraceEntries[bootTraceCount].micros = micros();
+    bootTraceEntries[bootTraceCount].label = label;
+    bootTraceCount++;
+}
+
+// Ends a boot phase: setup, Serial.begin, setupCommands, BLE.begin, Camera.begin... label must be a string literal,
+// only the pointer is kept.
+void bootTraceMark(const char* label){
+    if(bootTraceClosed){
+        return;
+    }
+    if(bootTraceCount == BOOT_TRACE_ENTRIES){
+        bootTraceDropped++;
+        return;
+    }
+    bootTraceRecord(label);
+}
+
+// Ends a step inside a phase, such as one command of setupCommands(). Steps leave BOOT_TRACE_PHASES slots free.
+void bootTraceStep(const char* label){
+    if(bootTraceClosed){
+        return;
+    }
+    if(bootTraceSteps == BOOT_TRACE_ENTRIES - BOOT_TRACE_PHASES || bootTraceCount == BOOT_TRACE_ENTRIES){
+        bootTraceDropped++;
+        return;
+    }
+    bootTraceSteps++;
+    bootTraceRecord(label);
+}
+
+// Last mark of the boot, later marks are ignored.
+void bootTraceClose(const char* label){
+    bootTraceMark(label);
+    bootTraceClosed = true;
+}
+
+// "bootTrace,<hz>,<entries>,<closed>,<dropped>" then one "<label>,<micros>,<cycles>" line per mark, each one ending a phase.
+void printBootTrace(){
+    commandLink->print("bootTrace,");
+    commandLink->print((unsigned long) BOOT_TRACE_HZ);
+    commandLink->print(",");
+    commandLink->print(bootTraceCount);
+    commandLink->print(",");
+    commandLink->print(bootTraceClosed ? 1 : 0);
+    commandLink->print(",");
+    commandLink->print(bootTraceDropped);
+    commandLink->print("\r\n");
+    for(uint8_t index = 0; index < bootTraceCount; index++){
+        commandLink->print(bootTraceEntries[index].label);
+        commandLink->print(",");
+        commandLink->print(bootTraceEntries[index].micros);
+        commandLink->print(",");
+        commandLink->print(bootTraceEntries[index].cycles);
+        commandLink->print("\r\n");
+    }
+}
+
+#endif
\ No newline at end of file
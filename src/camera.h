@@ -3,6 +3,13 @@
 
 #include <Arduino.h>
 #include <Arduino_OV767X.h>
+#include <Wire.h>
+#include <bootTrace.h>
+#include <transport.h>
+
+#ifndef CAMERA_DELTA_RECONFIGURATION
+#define CAMERA_DELTA_RECONFIGURATION 1 // Set to 0 to always reconfigure with a full Camera.begin().
+#endif
 
 #define CAMERA_VSYNC 8
 #define CAMERA_HREF  A1
@@ -22,192 +29,593 @@ const int CAMERA_DPINS[8] = {CAMERA_D0, CAMERA_D1, CAMERA_D2, CAMERA_D3, CAMERA_
 uint8_t cameraResolution = QVGA;
 uint8_t cameraFormat = RGB565;
 uint8_t cameraModel = OV7675;
-const uint8_t cameraFPS = 1;
+uint8_t cameraFPS = 1;
 
 byte* frameBuffer;
 size_t frameBufferSize;
 
-int setupCamera(uint8_t maxTries){
+const uint16_t cameraWidths[5] = {640, 352, 320, 176, 160};
+const uint16_t cameraHeights[5] = {480, 240, 240, 144, 120};
+
+uint16_t cameraWidth(){
+    return cameraWidths[cameraResolution];
+}
+
+uint16_t cameraHeight(){
+    return cameraHeights[cameraResolution];
+}
+
+uint8_t formatBytesPerPixel(uint8_t format){
+    return (format == GRAYSCALE) ? 1 : 2;
+}
+
+uint8_t cameraBytesPerPixel(){
+    return formatBytesPerPixel(cameraFormat);
+}
+
+// Name of a format in records for the host, as tools/rawContainer.py spells them.
+const char* cameraFormatName(uint8_t format){
+    switch(format){
+        case YUV422:
+            return "YUV422";
+        case RGB444:
+            return "RGB444";
+        case RGB565:
+            return "RGB565";
+        case GRAYSCALE:
+            return "GRAYSCALE";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+// Region of interest cropped and decimated while the frame is read out, the sensor always sends the full frame.
+typedef struct{
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;     // 0 selects the full frame.
+    uint16_t height;
+    uint8_t scale;      // Keeps one pixel out of scale in each direction.
+} cameraWindow;
+
+cameraWindow cameraRoi = {0, 0, 0, 0, 1};
+
+void resetCameraWindow(cameraWindow* window){
+    *window = {0, 0, 0, 0, 1};
+}
+
+// Fills a full frame window in and checks it against the sensor geometry of resolution and format.
+int validateCameraWindow(cameraWindow* window, uint8_t resolution, uint8_t format){
+    if(window->width == 0 || window->height == 0){
+        window->x = 0;
+        window->y = 0;
+        window->width = cameraWidths[resolution];
+        window->height = cameraHeights[resolution];
+    }
+    if(window->scale == 0 || window->scale > 8){
+        return 1;
+    }
+    if((uint32_t) window->x + window->width > cameraWidths[resolution] || (uint32_t) window->y + window->height > cameraHeights[resolution]){
+        return 1;
+    }
+    if(format == YUV422 && (window->scale != 1 || (window->x & 1) || (window->width & 1))){
+        return 1; // U and V are shared by pixel pairs.
+    }
+    return 0;
+}
+
+uint16_t cameraOutputWidth(){
+    return (cameraRoi.width == 0) ? cameraWidth() : (cameraRoi.width + cameraRoi.scale - 1) / cameraRoi.scale;
+}
+
+uint16_t cameraOutputHeight(){
+    return (cameraRoi.height == 0) ? cameraHeight() : (cameraRoi.height + cameraRoi.scale - 1) / cameraRoi.scale;
+}
+
+// OV767X registers touched by a resolution or format change, values from the ov7670 driver tables used by Arduino_OV767X.
+#define CAMERA_SCCB_ADDRESS 0x21
+#define CAMERA_REG_VREF     0x03
+#define CAMERA_REG_COM1     0x04
+#define CAMERA_REG_COM3     0x0C
+#define CAMERA_REG_CLKRC    0x11
+#define CAMERA_REG_COM7     0x12
+#define CAMERA_REG_COM9     0x14
+#define CAMERA_REG_HSTART   0x17
+#define CAMERA_REG_HSTOP    0x18
+#define CAMERA_REG_VSTART   0x19
+#define CAMERA_REG_VSTOP    0x1A
+#define CAMERA_REG_HREF     0x32
+#define CAMERA_REG_COM13    0x3D
+#define CAMERA_REG_COM14    0x3E
+#define CAMERA_REG_COM15    0x40
+#define CAMERA_REG_MTX1     0x4F
+#define CAMERA_REG_MTX2     0x50
+#define CAMERA_REG_MTX3     0x51
+#define CAMERA_REG_MTX4     0x52
+#define CAMERA_REG_MTX5     0x53
+#define CAMERA_REG_MTX6     0x54
+#define CAMERA_REG_XSC      0x70
+#define CAMERA_REG_YSC      0x71
+#define CAMERA_REG_DCWCTR   0x72
+#define CAMERA_REG_PCLK_DIV 0x73
+#define CAMERA_REG_RGB444   0x8C
+#define CAMERA_REG_PCLK_DELAY 0xA2
+
+#define CAMERA_FORMAT_REGISTERS 12
+#define CAMERA_RESOLUTION_REGISTERS 13
+#define CAMERA_MODE_REGISTERS (CAMERA_FORMAT_REGISTERS + CAMERA_RESOLUTION_REGISTERS + 1) // + CLKRC
+
+// Frame rate is the sensor's 30 fps divided by the CLKRC prescaler.
+#define CAMERA_BASE_FPS 30
+#define CAMERA_MAX_FPS 30
+// Bus bytes per second the bit-banged readout keeps up with, interrupts off and one port read per data pin.
+#define CAMERA_MAX_BUS_BYTES_PER_SECOND 2000000
+// Sensor frame including blanking over the active frame, 784x510 for 640x480.
+#define CAMERA_BLANKING_NUMERATOR 13
+#define CAMERA_BLANKING_DENOMINATOR 10
+
+uint8_t cameraClockDivider(uint8_t fps){
+    uint8_t divider = (CAMERA_BASE_FPS + fps / 2) / fps;
+    return (divider == 0) ? 1 : (divider > 64) ? 64 : divider;
+}
+
+uint32_t cameraFramePeriodMicros(uint8_t fps){
+    return (uint32_t) cameraClockDivider(fps) * 1000000 / CAMERA_BASE_FPS;
+}
+
+// Highest frame rate whose pixel clock the readout can sample, every format is 2 bytes per pixel on the bus.
+uint8_t cameraMaxFPS(uint8_t resolution, uint8_t format){
+    (void) format;
+    uint32_t busBytes = (uint32_t) cameraWidths[resolution] * cameraHeights[resolution] * 2 * CAMERA_BLANKING_NUMERATOR / CAMERA_BLANKING_DENOMINATOR;
+    uint32_t maxFPS = CAMERA_MAX_BUS_BYTES_PER_SECOND / busBytes;
+    return (maxFPS == 0) ? 1 : (maxFPS > CAMERA_MAX_FPS) ? CAMERA_MAX_FPS : maxFPS;
+}
+
+// Camera.begin() only takes 1, 5, 10, 15 and 30 fps, other rates are set through CLKRC afterwards.
+uint8_t cameraBeginFPS(uint8_t fps){
+    const uint8_t rates[5] = {30, 15, 10, 5, 1};
+    for(uint8_t index = 0; index < 5; index++){
+        if(rates[index] <= fps){
+            return rates[index];
+        }
+    }
+    return 1;
+}
+
+// COM7 first, it carries both the output format and the resolution preset bits.
+const uint8_t cameraFormatRegisters[CAMERA_FORMAT_REGISTERS] = {CAMERA_REG_COM7, CAMERA_REG_RGB444, CAMERA_REG_COM1, CAMERA_REG_COM15, CAMERA_REG_COM9, CAMERA_REG_MTX1, CAMERA_REG_MTX2, CAMERA_REG_MTX3, CAMERA_REG_MTX4, CAMERA_REG_MTX5, CAMERA_REG_MTX6, CAMERA_REG_COM13};
+const uint8_t cameraFormatValues[3][CAMERA_FORMAT_REGISTERS] = {
+    {0x00, 0x00, 0x00, 0xC0, 0x48, 0x80, 0x80, 0x00, 0x22, 0x5E, 0x80, 0xC0}, // YUV422, GRAYSCALE keeps the Y bytes.
+    {0x04, 0x02, 0x00, 0x90, 0x38, 0xB3, 0xB3, 0x00, 0x3D, 0xA7, 0xE4, 0xC2}, // RGB444
+    {0x04, 0x00, 0x00, 0x10, 0x38, 0xB3, 0xB3, 0x00, 0x3D, 0xA7, 0xE4, 0xC0}  // RGB565
+};
+
+const uint8_t cameraResolutionCom7[5] = {0x00, 0x20, 0x10, 0x00, 0x10};
+const uint8_t cameraResolutionRegisters[CAMERA_RESOLUTION_REGISTERS] = {CAMERA_REG_COM3, CAMERA_REG_COM14, CAMERA_REG_XSC, CAMERA_REG_YSC, CAMERA_REG_DCWCTR, CAMERA_REG_PCLK_DIV, CAMERA_REG_PCLK_DELAY, CAMERA_REG_HSTART, CAMERA_REG_HSTOP, CAMERA_REG_HREF, CAMERA_REG_VSTART, CAMERA_REG_VSTOP, CAMERA_REG_VREF};
+const uint8_t cameraResolutionValues[5][CAMERA_RESOLUTION_REGISTERS] = {
+    {0x00, 0x00, 0x3A, 0x35, 0x11, 0xF0, 0x02, 0x13, 0x01, 0xB6, 0x02, 0x7A, 0x0A}, // VGA
+    {0x00, 0x00, 0x3A, 0x35, 0x11, 0xF0, 0x02, 0x15, 0x0B, 0x92, 0x03, 0x7B, 0x0A}, // CIF
+    {0x00, 0x00, 0x3A, 0x35, 0x11, 0xF0, 0x02, 0x15, 0x03, 0x80, 0x03, 0x7B, 0x00}, // QVGA
+    {0x04, 0x11, 0x3A, 0x35, 0x11, 0xF1, 0x52, 0x39, 0x03, 0x80, 0x03, 0x7B, 0x0A}, // QCIF, VGA preset downscaled
+    {0x04, 0x1A, 0x3A, 0x35, 0x22, 0xF2, 0x02, 0x16, 0x04, 0xA4, 0x02, 0x7A, 0x0A}  // QQVGA, QVGA preset downscaled
+};
+
+typedef struct{
+    uint8_t address;
+    uint8_t value;
+} cameraRegister;
+
+bool cameraReady = false;           // Camera.begin() succeeded, the sensor answers on SCCB.
+bool cameraShadowValid = false;     // cameraShadow holds what the sensor registers contain.
+cameraRegister cameraShadow[CAMERA_MODE_REGISTERS];
+uint8_t cameraDeltaWrites = 0;      // Registers written by the last reconfiguration.
+
+void cameraModeRegisters(uint8_t resolution, uint8_t format, uint8_t fps, cameraRegister* registers){
+    const uint8_t* formatValues = cameraFormatValues[(format == GRAYSCALE) ? (uint8_t) YUV422 : format];
+    for(uint8_t index = 0; index < CAMERA_FORMAT_REGISTERS; index++){
+        registers[index].address = cameraFormatRegisters[index];
+        registers[index].value = formatValues[index];
+    }
+    registers[0].value |= cameraResolutionCom7[resolution];
+    for(uint8_t index = 0; index < CAMERA_RESOLUTION_REGISTERS; index++){
+        registers[CAMERA_FORMAT_REGISTERS + index].address = cameraResolutionRegisters[index];
+        registers[CAMERA_FORMAT_REGISTERS + index].value = cameraResolutionValues[resolution][index];
+    }
+    registers[CAMERA_MODE_REGISTERS - 1].address = CAMERA_REG_CLKRC;
+    registers[CAMERA_MODE_REGISTERS - 1].value = cameraClockDivider(fps) - 1;
+}
+
+int sccbWrite(uint8_t address, uint8_t value){
+    Wire.beginTransmission(CAMERA_SCCB_ADDRESS);
+    Wire.write(address);
+    Wire.write(value);
+    return (Wire.endTransmission() == 0) ? 0 : 1;
+}
+
+// SCCB has no repeated start, the register address goes in its own transaction.
+int sccbRead(uint8_t address, uint8_t* value){
+    Wire.beginTransmission(CAMERA_SCCB_ADDRESS);
+    Wire.write(address);
+    if(Wire.endTransmission() != 0){
+        return 1;
+    }
+    if(Wire.requestFrom(CAMERA_SCCB_ADDRESS, 1) != 1){
+        return 1;
+    }
+    *value = Wire.read();
+    return 0;
+}
+
+// Reads back the mode registers once after Camera.begin(), deltas are computed against the sensor and not against the tables.
+int readCameraShadow(){
+    cameraModeRegisters(cameraResolution, cameraFormat, cameraFPS, cameraShadow);
+    for(uint8_t index = 0; index < CAMERA_MODE_REGISTERS; index++){
+        if(sccbRead(cameraShadow[index].address, &cameraShadow[index].value)){
+            cameraShadowValid = false;
+            return 1;
+        }
+    }
+    cameraShadowValid = true;
+    return 0;
+}
+
+// Writes only the registers of target whose value differs from the sensor, then verifies them.
+int applyCameraRegisters(const cameraRegister* target){
+    if(!cameraReady || !cameraShadowValid){
+        return 1;
+    }
+
+    cameraDeltaWrites = 0;
+    for(uint8_t index = 0; index < CAMERA_MODE_REGISTERS; index++){
+        if(cameraShadow[index].value == target[index].value){
+            continue;
+        }
+        cameraShadowValid = false; // Until the write is verified the sensor state is unknown.
+        uint8_t readBack;
+        if(sccbWrite(target[index].address, target[index].value) || sccbRead(target[index].address, &readBack) || readBack != target[index].value){
+            return 1;
+        }
+        cameraShadow[index].value = target[index].value;
+        cameraShadowValid = true;
+        cameraDeltaWrites++;
+    }
+    return 0;
+}
+
+int applyCameraDelta(){
+    cameraRegister target[CAMERA_MODE_REGISTERS];
+    cameraModeRegisters(cameraResolution, cameraFormat, cameraFPS, target);
+    return applyCameraRegisters(target);
+}
+
+#if defined(ARDUINO_ARCH_MBED)
+volatile uint32_t* cameraVsyncPort;
+volatile uint32_t* cameraHrefPort;
+volatile uint32_t* cameraPclkPort;
+volatile uint32_t* cameraDataPorts[8];
+uint32_t cameraVsyncMask;
+uint32_t cameraHrefMask;
+uint32_t cameraPclkMask;
+uint32_t cameraDataMasks[8];
+
+void setupCameraBus(){
+    cameraVsyncPort = portInputRegister(digitalPinToPort(CAMERA_VSYNC));
+    cameraHrefPort = portInputRegister(digitalPinToPort(CAMERA_HREF));
+    cameraPclkPort = portInputRegister(digitalPinToPort(CAMERA_PCLK));
+    cameraVsyncMask = digitalPinToBitMask(CAMERA_VSYNC);
+    cameraHrefMask = digitalPinToBitMask(CAMERA_HREF);
+    cameraPclkMask = digitalPinToBitMask(CAMERA_PCLK);
+    for(uint8_t bit = 0; bit < 8; bit++){
+        cameraDataPorts[bit] = portInputRegister(digitalPinToPort(CAMERA_DPINS[bit]));
+        cameraDataMasks[bit] = digitalPinToBitMask(CAMERA_DPINS[bit]);
+    }
+}
+
+inline bool cameraBusVsync(){
+    return (*cameraVsyncPort & cameraVsyncMask) != 0;
+}
+
+inline bool cameraBusHref(){
+    return (*cameraHrefPort & cameraHrefMask) != 0;
+}
+
+// Data is valid on the rising edge of PCLK.
+inline uint8_t cameraBusReadByte(){
+    while((*cameraPclkPort & cameraPclkMask) == 0);
+    uint8_t value = 0;
+    for(uint8_t bit = 0; bit < 8; bit++){
+        if(*cameraDataPorts[bit] & cameraDataMasks[bit]){
+            value |= 1 << bit;
+        }
+    }
+    while((*cameraPclkPort & cameraPclkMask) != 0);
+    return value;
+}
+#else
+// Simulated sensor bus, implemented by tools/native/camera.cpp.
+inline void setupCameraBus(){}
+bool cameraBusVsync();
+bool cameraBusHref();
+uint8_t cameraBusReadByte();
+#endif
+
+// verbose false only reports the final failure, for bring-ups that must not mix text into a command response.
+int setupCamera(uint8_t maxTries, bool verbose = true){
     uint8_t tries = 1;
+    if(cameraReady){
+        Camera.end();
+        cameraReady = false;
+    }
     while(true){
-        Serial.println("Setting up camera.");
+        if(verbose){
+            commandLink->println("Setting up camera.");
+        }
         Camera.setPins(CAMERA_VSYNC, CAMERA_HREF, CAMERA_PCLK, CAMERA_XCLK, CAMERA_DPINS);
-        if(Camera.begin(cameraResolution, cameraFormat, cameraFPS, cameraModel)){ // Camera setup correctly
-            Serial.println("Cammera settings apllied correctly.");
+        bootTraceMark("Camera.setPins");
+        if(Camera.begin(cameraResolution, cameraFormat, cameraBeginFPS(cameraFPS), cameraModel)){ // Camera setup correctly
+            bootTraceMark("Camera.begin");
+            setupCameraBus();
+            cameraReady = true;
+            if(readCameraShadow() == 0){
+                applyCameraDelta(); // Sensor to the register tables, frame rates between the library ones included.
+            }
+            bootTraceMark("cameraRegisters");
+            if(verbose){
+                commandLink->println("Cammera settings apllied correctly.");
+            }
             return 0;
         }
         else if(maxTries != 0 && maxTries > tries){ // maxTries is setup and there is tries left
-            Serial.println("Failed to setup camera, trying again.");
+            if(verbose){
+                commandLink->println("Failed to setup camera, trying again.");
+            }
             tries++;
         }
         else if(maxTries != 0){ // maxTries is setup and there isn't tries left
-            Serial.println("Failed to setup camera.");
+            commandLink->println("Failed to setup camera.");
             return 1;
         }
         delay(500);
     }
 }
 
+uint32_t cameraStartedMillis = 0;   // millis() when the camera last came up.
+uint32_t cameraStartupMillis = 0;   // Time the last bring-up took, Camera.begin() alone waits 1 s for the sensor.
+bool cameraStartFailed = false;
+
+// Brings the camera up on first use instead of at boot, so commands are served right after power-on.
+int startCamera(uint8_t maxTries){
+    if(cameraReady){
+        return 0;
+    }
+    uint32_t start = millis();
+    cameraStartFailed = (setupCamera(maxTries, false) != 0);
+    cameraStartupMillis = millis() - start;
+    if(!cameraStartFailed){
+        cameraStartedMillis = millis();
+    }
+    return cameraStartFailed ? 1 : 0;
+}
+
+// Applies cameraResolution and cameraFormat, register deltas first and a full Camera.begin() when they fail.
+int reconfigureCamera(uint8_t maxTries){
+#if CAMERA_DELTA_RECONFIGURATION
+    if(applyCameraDelta() == 0){
+        commandLink->print("Camera registers updated (");
+        commandLink->print(cameraDeltaWrites);
+        commandLink->println(" writes).");
+        return 0;
+    }
+    if(cameraReady){
+        commandLink->println("Failed to update camera registers, reinitializing camera.");
+    }
+#endif
+    return cameraReady ? setupCamera(maxTries) : startCamera(maxTries);
+}
+
 int configureResolution(uint8_t resolution, uint8_t maxTries){
     if(resolution > 4){
         return 1;
     }
     cameraResolution = resolution;
-    Serial.print("Configuring camera resolution to: ");
+    resetCameraWindow(&cameraRoi);
+    commandLink->print("Configuring camera resolution to: ");
     switch (cameraResolution){
         case VGA:
-            Serial.println("VGA (640x480).");
+            commandLink->println("VGA (640x480).");
         break;
 
         case CIF:
-            Serial.println("CIF (352x240).");
+            commandLink->println("CIF (352x240).");
         break;
 
         case QVGA:
-            Serial.println("QVGA (320x240).");
+            commandLink->println("QVGA (320x240).");
         break;
 
         case QCIF:
-            Serial.println("QCIF (176x144).");
+            commandLink->println("QCIF (176x144).");
         break;
 
         case QQVGA:
-            Serial.println("QQVGA (160x120).");
+            commandLink->println("QQVGA (160x120).");
         break;
     
         default:
-            Serial.println("Invalid value.");
+            commandLink->println("Invalid value.");
         break;
     }
-    return setupCamera(maxTries);
+    if(cameraFPS > cameraMaxFPS(cameraResolution, cameraFormat)){
+        cameraFPS = cameraMaxFPS(cameraResolution, cameraFormat);
+        commandLink->print("Frame rate lowered to ");
+        commandLink->print(cameraFPS);
+        commandLink->println(" fps for this resolution.");
+    }
+    return reconfigureCamera(maxTries);
 }
 
 int configureFormat(uint8_t format, uint8_t maxTries){
-    if(format != 4 || format > 2){
+    if(format != 4 && format > 2){
         return 1;
     }
     cameraFormat = format;
-    Serial.print("Configuring camera format to: ");
+    resetCameraWindow(&cameraRoi);
+    commandLink->print("Configuring camera format to: ");
     switch (cameraFormat){
         case YUV422:
-            Serial.println("YUV422 (1 byte per pixel).");
+            commandLink->println("YUV422 (1 byte per pixel).");
         break;
 
         case RGB444:
-            Serial.println("RGB444 (1 byte per pixel).");
+            commandLink->println("RGB444 (1 byte per pixel).");
         break;
 
         case RGB565:
-            Serial.println("RGB565 (2 bytes per pixel).");
+            commandLink->println("RGB565 (2 bytes per pixel).");
         break;
 
         case GRAYSCALE:
-            Serial.println("GRAYSCALE (1 byte per pixel).");
+            commandLink->println("GRAYSCALE (1 byte per pixel).");
         break;
     
         default:
-            Serial.println("Invalid value.");
+            commandLink->println("Invalid value.");
         break;
     }
-    return setupCamera(maxTries);
+    return reconfigureCamera(maxTries);
+}
+
+int configureFPS(uint8_t fps, uint8_t maxTries){
+    if(fps == 0 || fps > cameraMaxFPS(cameraResolution, cameraFormat)){
+        return 1;
+    }
+    cameraFPS = fps;
+    commandLink->print("Configuring camera frame rate to: ");
+    commandLink->print(cameraFPS);
+    commandLink->println(" fps.");
+    return reconfigureCamera(maxTries);
 }
 
 void printCameraSettings(){
-    Serial.print("Current camera settings:\n");
+    commandLink->print("Current camera settings:\n");
 
-    Serial.print("\tModel: ");
+    commandLink->print("\tModel: ");
     switch (cameraModel){
         case OV7670:
-            Serial.print("OV7670.\n");
+            commandLink->print("OV7670.\n");
         break;
 
         case OV7675:
-            Serial.print("OV7675.\n");
+            commandLink->print("OV7675.\n");
         break;
 
         default:
-            Serial.print("Invalid value.\n");
-        break;
-    }
-
-    Serial.print("\tVSYNC_PIN: ");
-    Serial.print(CAMERA_VSYNC);
-    Serial.print("\n\tHREF_PIN: ");
-    Serial.print(CAMERA_HREF);
-    Serial.print("\n\tPCLK_PIN: ");
-    Serial.print(CAMERA_PCLK);
-    Serial.print("\n\tXCLK_PIN: ");
-    Serial.print(CAMERA_XCLK);
-    Serial.print("\n\tD0_PIN: ");
-    Serial.print(CAMERA_D0);
-    Serial.print("\n\tD1_PIN: ");
-    Serial.print(CAMERA_D1);
-    Serial.print("\n\tD2_PIN: ");
-    Serial.print(CAMERA_D2);
-    Serial.print("\n\tD3_PIN: ");
-    Serial.print(CAMERA_D3);
-    Serial.print("\n\tD4_PIN: ");
-    Serial.print(CAMERA_D4);
-    Serial.print("\n\tD5_PIN: ");
-    Serial.print(CAMERA_D5);
-    Serial.print("\n\tD6_PIN: ");
-    Serial.print(CAMERA_D6);
-    Serial.print("\n\tD7_PIN: ");
-    Serial.print(CAMERA_D7);
+            commandLink->print("Invalid value.\n");
+        break;
+    }
+
+    commandLink->print("\tVSYNC_PIN: ");
+    commandLink->print(CAMERA_VSYNC);
+    commandLink->print("\n\tHREF_PIN: ");
+    commandLink->print(CAMERA_HREF);
+    commandLink->print("\n\tPCLK_PIN: ");
+    commandLink->print(CAMERA_PCLK);
+    commandLink->print("\n\tXCLK_PIN: ");
+    commandLink->print(CAMERA_XCLK);
+    commandLink->print("\n\tD0_PIN: ");
+    commandLink->print(CAMERA_D0);
+    commandLink->print("\n\tD1_PIN: ");
+    commandLink->print(CAMERA_D1);
+    commandLink->print("\n\tD2_PIN: ");
+    commandLink->print(CAMERA_D2);
+    commandLink->print("\n\tD3_PIN: ");
+    commandLink->print(CAMERA_D3);
+    commandLink->print("\n\tD4_PIN: ");
+    commandLink->print(CAMERA_D4);
+    commandLink->print("\n\tD5_PIN: ");
+    commandLink->print(CAMERA_D5);
+    commandLink->print("\n\tD6_PIN: ");
+    commandLink->print(CAMERA_D6);
+    commandLink->print("\n\tD7_PIN: ");
+    commandLink->print(CAMERA_D7);
     
-    Serial.print("\n\tResolution: ");
+    commandLink->print("\n\tResolution: ");
     switch (cameraResolution){
         case VGA:
-            Serial.print("VGA (640x480).\n");
+            commandLink->print("VGA (640x480).\n");
         break;
 
         case CIF:
-            Serial.print("CIF (352x240).\n");
+            commandLink->print("CIF (352x240).\n");
         break;
 
         case QVGA:
-            Serial.print("QVGA (320x240).\n");
+            commandLink->print("QVGA (320x240).\n");
         break;
 
         case QCIF:
-            Serial.print("QCIF (176x144).\n");
+            commandLink->print("QCIF (176x144).\n");
         break;
 
         case QQVGA:
-            Serial.print("QQVGA (160x120).\n");
+            commandLink->print("QQVGA (160x120).\n");
         break;
     
         default:
-            Serial.print("Invalid value.\n");
+            commandLink->print("Invalid value.\n");
         break;
     }
 
-    Serial.print("\tFormat: ");
+    commandLink->print("\tFormat: ");
     switch (cameraFormat){
         case YUV422:
-            Serial.print("YUV422 (1 byte per pixel).\n");
+            commandLink->print("YUV422 (1 byte per pixel).\n");
         break;
 
         case RGB444:
-            Serial.print("RGB444 (1 byte per pixel).\n");
+            commandLink->print("RGB444 (1 byte per pixel).\n");
         break;
 
         case RGB565:
-            Serial.print("RGB565 (2 bytes per pixel).\n");
+            commandLink->print("RGB565 (2 bytes per pixel).\n");
         break;
 
         case GRAYSCALE:
-            Serial.print("GRAYSCALE (1 byte per pixel).\n");
+            commandLink->print("GRAYSCALE (1 byte per pixel).\n");
         break;
     
         default:
-            Serial.print("Invalid value.\n");
+            commandLink->print("Invalid value.\n");
         break;
     }
 
-    Serial.print("\tFPS: ");
-    Serial.print(cameraFPS);
-    Serial.println(".");
+    if(cameraRoi.width != 0){
+        commandLink->print("\tWindow: ");
+        commandLink->print(cameraRoi.x);
+        commandLink->print(",");
+        commandLink->print(cameraRoi.y);
+        commandLink->print(" ");
+        commandLink->print(cameraRoi.width);
+        commandLink->print("x");
+        commandLink->print(cameraRoi.height);
+        commandLink->print(", scale ");
+        commandLink->print(cameraRoi.scale);
+        commandLink->print(".\n");
+    }
+
+    commandLink->print("\tFrame: ");
+    commandLink->print(cameraOutputWidth());
+    commandLink->print("x");
+    commandLink->print(cameraOutputHeight());
+    commandLink->print(" (");
+    commandLink->print(cameraOutputWidth() * cameraOutputHeight() * cameraBytesPerPixel());
+    commandLink->print(" bytes).\n");
+
+    commandLink->print("\tFPS: ");
+    commandLink->print(cameraFPS);
+    commandLink->print(".\n\tFrame period: ");
+    commandLink->print(cameraFramePeriodMicros(cameraFPS));
+    commandLink->println(" us.");
 }
 
 void freeFrameBuffer(byte** frameBuffer){
@@ -220,14 +628,14 @@ void freeFrameBuffer(byte** frameBuffer){
 int setupFrameBuffer(byte** frameBuffer, size_t* frameBufferSize){
     freeFrameBuffer(frameBuffer);
     
-    *frameBufferSize = Camera.width() * Camera.height() * Camera.bytesPerPixel();
+    *frameBufferSize = cameraOutputWidth() * cameraOutputHeight() * cameraBytesPerPixel();
 
     *frameBuffer = (byte *) malloc(*frameBufferSize * sizeof(byte));
 
     if(*frameBuffer == NULL){
-        Serial.print("No enough memory for frame buffer, requested: ");
-        Serial.print(*frameBufferSize * sizeof(byte));
-        Serial.println(" bytes. Try to downgrade the camera resolution and format.");
+        commandLink->print("No enough memory for frame buffer, requested: ");
+        commandLink->print(*frameBufferSize * sizeof(byte));
+        commandLink->println(" bytes. Try to downgrade the camera resolution and format, \"mem\" lists the ones that fit.");
         *frameBufferSize = 0;
         return 1;
     }
@@ -235,20 +643,4 @@ int setupFrameBuffer(byte** frameBuffer, size_t* frameBufferSize){
     return 0;
 }
 
-int takePhoto(byte** frameBuffer, size_t* frameBufferSize){
-    if(setupFrameBuffer(frameBuffer, frameBufferSize)){
-        Serial.println("Failed to setup frame buffer.");
-        return 1;
-    }
-
-    Camera.readFrame(*frameBuffer);
-
-    if(*frameBuffer == NULL){
-        *frameBufferSize = 0;
-        Serial.println("Failed to read frame.");
-        return 1;
-    }
-    return 0;
-}
-
 #endif
\ No newline at end of file
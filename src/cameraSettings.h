@@ -0,0 +1,183 @@
+#ifndef CAMERASETTINGS_H
+#define CAMERASETTINGS_H
+
+#include <Arduino.h>
+#include <camera.h>
+#include <transport.h>
+
+#define CAMERA_SETTINGS_DOCUMENT_BYTES 512
+#define CAMERA_SETTINGS_PINS 12     // VSYNC, HREF, PCLK, XCLK, D0 to D7.
+
+// "getCameraSettings --json" and "--cbor": the settings of a cameraSettings snapshot encoded in one buffer and written
+// at once. The JSON is a single line ending in "\r\n", the CBOR map goes as "CBOR <bytes>\r\n", the map and "\r\n".
+// Both have the same keys, in the same order.
+typedef struct{
+    const char* model;
+    const char* resolution;
+    uint16_t sensorWidth;
+    uint16_t sensorHeight;
+    const char* format;
+    uint16_t width;                 // Frame sent, after the window.
+    uint16_t height;
+    uint8_t bytesPerPixel;
+    uint32_t frameBytes;
+    uint8_t fps;
+    uint32_t framePeriodMicros;
+    cameraWindow window;
+    uint8_t pins[CAMERA_SETTINGS_PINS];
+} cameraSettings;
+
+void readCameraSettings(cameraSettings* settings){
+    static const char* resolutionNames[5] = {"VGA", "CIF", "QVGA", "QCIF", "QQVGA"};
+    settings->model = (cameraModel == OV7670) ? "OV7670" : (cameraModel == OV7675) ? "OV7675" : "UNKNOWN";
+    settings->resolution = (cameraResolution < 5) ? resolutionNames[cameraResolution] : "UNKNOWN";
+    settings->sensorWidth = cameraWidth();
+    settings->sensorHeight = cameraHeight();
+    settings->format = cameraFormatName(cameraFormat);
+    settings->width = cameraOutputWidth();
+    settings->height = cameraOutputHeight();
+    settings->bytesPerPixel = cameraBytesPerPixel();
+    settings->frameBytes = (uint32_t) settings->width * settings->height * settings->bytesPerPixel;
+    settings->fps = cameraFPS;
+    settings->framePeriodMicros = cameraFramePeriodMicros(cameraFPS);
+    settings->window = cameraRoi;
+    const uint8_t pins[CAMERA_SETTINGS_PINS] = {CAMERA_VSYNC, CAMERA_HREF, CAMERA_PCLK, CAMERA_XCLK, CAMERA_D0, CAMERA_D1,
+                                                CAMERA_D2, CAMERA_D3, CAMERA_D4, CAMERA_D5, CAMERA_D6, CAMERA_D7};
+    memcpy(settings->pins, pins, sizeof(pins));
+}
+
+size_t cameraSettingsJson(const cameraSettings* settings, char* document, size_t size){
+    const uint8_t* pins = settings->pins;
+    int length = snprintf(document, size,
+        "{\"model\":\"%s\",\"resolution\":\"%s\",\"sensorWidth\":%u,\"sensorHeight\":%u,\"format\":\"%s\","
+        "\"width\":%u,\"height\":%u,\"bytesPerPixel\":%u,\"frameBytes\":%lu,\"fps\":%u,\"framePeriodUs\":%lu,"
+        "\"window\":{\"x\":%u,\"y\":%u,\"width\":%u,\"height\":%u,\"scale\":%u},"
+        "\"pins\":{\"vsync\":%u,\"href\":%u,\"pclk\":%u,\"xclk\":%u,\"data\":[%u,%u,%u,%u,%u,%u,%u,%u]}}\r\n",
+        settings->model, settings->resolution, settings->sensorWidth, settings->sensorHeight, settings->format,
+        settings->width, settings->height, settings->bytesPerPixel, (unsigned long) settings->frameBytes, settings->fps,
+        (unsigned long) settings->framePeriodMicros, settings->window.x, settings->window.y, settings->window.width,
+        settings->window.height, settings->window.scale, pins[0], pins[1], pins[2], pins[3], pins[4], pins[5], pins[6],
+        pins[7], pins[8], pins[9], pins[10], pins[11]);
+    return (length > 0 && (size_t) length < size) ? length : 0;
+}
+
+// The few CBOR (RFC 8949) items the settings need: unsigned integers, text, arrays and maps of known length.
+typedef struct{
+    byte* data;
+    size_t size;
+    size_t length;      // Past size when the document did not fit.
+} cborWriter;
+
+void cborAppend(cborWriter* writer, const void* data, size_t size){
+    if(writer->length + size <= writer->size){
+        memcpy(writer->data + writer->length, data, size);
+    }
+    writer->length += size;
+}
+
+void cborHead(cborWriter* writer, uint8_t major, uint32_t value){
+    byte head[5];
+    size_t size;
+    if(value < 24){
+        head[0] = (major << 5) | value;
+        size = 1;
+    }
+    else if(value <= 0xFF){
+        head[0] = (major << 5) | 24;
+        head[1] = value;
+        size = 2;
+    }
+    else if(value <= 0xFFFF){
+        head[0] = (major << 5) | 25;
+        head[1] = value >> 8;
+        head[2] = value;
+        size = 3;
+    }
+    else{
+        head[0] = (major << 5) | 26;
+        head[1] = value >> 24;
+        head[2] = value >> 16;
+        head[3] = value >> 8;
+        head[4] = value;
+        size = 5;
+    }
+    cborAppend(writer, head, size);
+}
+
+void cborText(cborWriter* writer, const char* text){
+    size_t size = strlen(text);
+    cborHead(writer, 3, size);
+    cborAppend(writer, text, size);
+}
+
+void cborPairUint(cborWriter* writer, const char* key, uint32_t value){
+    cborText(writer, key);
+    cborHead(writer, 0, value);
+}
+
+void cborPairText(cborWriter* writer, const char* key, const char* value){
+    cborText(writer, key);
+    cborText(writer, value);
+}
+
+size_t cameraSettingsCbor(const cameraSettings* settings, byte* document, size_t size){
+    cborWriter writer = {document, size, 0};
+    cborHead(&writer, 5, 13);
+    cborPairText(&writer, "model", settings->model);
+    cborPairText(&writer, "resolution", settings->resolution);
+    cborPairUint(&writer, "sensorWidth", settings->sensorWidth);
+    cborPairUint(&writer, "sensorHeight", settings->sensorHeight);
+    cborPairText(&writer, "format", settings->format);
+    cborPairUint(&writer, "width", settings->width);
+    cborPairUint(&writer, "height", settings->height);
+    cborPairUint(&writer, "bytesPerPixel", settings->bytesPerPixel);
+    cborPairUint(&writer, "frameBytes", settings->frameBytes);
+    cborPairUint(&writer, "fps", settings->fps);
+    cborPairUint(&writer, "framePeriodUs", settings->framePeriodMicros);
+    cborText(&writer, "window");
+    cborHead(&writer, 5, 5);
+    cborPairUint(&writer, "x", settings->window.x);
+    cborPairUint(&writer, "y", settings->window.y);
+    cborPairUint(&writer, "width", settings->window.width);
+    cborPairUint(&writer, "height", settings->window.height);
+    cborPairUint(&writer, "scale", settings->window.scale);
+    cborText(&writer, "pins");
+    cborHead(&writer, 5, 5);
+    cborPairUint(&writer, "vsync", settings->pins[0]);
+    cborPairUint(&writer, "href", settings->pins[1]);
+    cborPairUint(&writer, "pclk", settings->pins[2]);
+    cborPairUint(&writer, "xclk", settings->pins[3]);
+    cborText(&writer, "data");
+    cborHead(&writer, 4, 8);
+    for(uint8_t pin = 4; pin < CAMERA_SETTINGS_PINS; pin++){
+        cborHead(&writer, 0, settings->pins[pin]);
+    }
+    return (writer.length <= size) ? writer.length : 0;
+}
+
+// Returns 1 when the document did not fit its buffer, nothing is written then.
+int sendCameraSettings(transport* link, bool cbor){
+    cameraSettings settings;
+    readCameraSettings(&settings);
+    byte document[CAMERA_SETTINGS_DOCUMENT_BYTES];
+    if(!cbor){
+        size_t length = cameraSettingsJson(&settings, (char*) document, sizeof(document));
+        if(length == 0){
+            return 1;
+        }
+        link->write(document, length);
+        return 0;
+    }
+
+    size_t length = cameraSettingsCbor(&settings, document, sizeof(document));
+    if(length == 0){
+        return 1;
+    }
+    char header[24];
+    snprintf(header, sizeof(header), "CBOR %u\r\n", (unsigned) length);
+    transportSegment segments[3] = {{header, strlen(header)}, {document, length}, {"\r\n", 2}};
+    link->writev(segments, 3);
+    return 0;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,316 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <Arduino.h>
+#include <camera.h>
+#include <bootTrace.h>
+
+#define CAMERA_FRAME_TIMEOUT_MS 3000
+#define CAPTURE_SLICE_MICROS 2000   // Time a captureStep() from loop() may take, lines are never split so a step can run one line longer.
+#define CAPTURE_UNSLICED 0          // captureStep() budget reading the whole frame in one call.
+#define CAPTURE_LINE_SLICE 1        // captureStep() budget returning after every line.
+#define CAPTURE_HBLANK_PERCENT 10   // Part of a line period safe to spend away from the bus after a line, HREF is about 80% of it.
+
+// The sensor has no FIFO, a line not read while HREF is high is lost. The engine reads whole lines with interrupts off and
+// returns to loop() in the horizontal blanking between them, a frame with a missed line is dropped and the next one read.
+typedef enum{
+    CAPTURE_IDLE,
+    CAPTURE_WAIT_VSYNC,
+    CAPTURE_WAIT_FRAME,     // VSYNC seen, its falling edge starts the frame.
+    CAPTURE_LINES,
+    CAPTURE_DONE,
+    CAPTURE_FAILED
+} captureState;
+
+typedef struct{
+    captureState state;
+    byte* buffer;
+    byte* write;
+    cameraWindow window;
+    uint16_t width;
+    uint16_t height;
+    bool grayscale;         // GRAYSCALE is YUV422 on the bus, the Y byte comes first.
+    uint16_t row;
+    uint8_t rowPhase;
+    uint32_t startMillis;
+    uint32_t frameMicros;   // micros() at the VSYNC falling edge of the frame being read.
+    uint32_t lineEndMicros; // micros() when HREF of the last line read fell.
+    uint32_t linePeriodMicros;
+    uint32_t backPorchMicros;   // VSYNC falling edge to first line, as last measured at this line period, 0 until then.
+    uint16_t outputRows;    // Rows kept in the buffer per frame.
+    uint16_t keptRows;
+    size_t bandBytes;       // 0 when buffer holds the whole frame.
+    byte* bandEnd;
+    byte* (*nextBand)();    // Buffer for the rest of the frame once a band is full, NULL drops the frame.
+    byte* (*restart)();     // Buffer for the frame read after a drop, NULL leaves the engine idle.
+    bool overrun;
+} captureEngine;
+
+typedef struct{
+    uint32_t framesCaptured;
+    uint32_t framesDropped;     // Restarted because loop() came back after a line had started or no band was free.
+    uint32_t framesFailed;      // No VSYNC within CAMERA_FRAME_TIMEOUT_MS.
+    uint32_t lines;
+    uint32_t steps;
+    uint32_t longestStepMicros;
+    uint32_t lastFrameMicros;   // VSYNC to last line of the last frame captured.
+    uint8_t lastFrameResolution;    // Sensor mode lastFrameMicros was measured in.
+    uint8_t lastFrameFPS;
+} captureStatistics;
+
+captureEngine capture;
+captureStatistics captureStats;
+
+bool captureBusy(){
+    return capture.state == CAPTURE_WAIT_VSYNC || capture.state == CAPTURE_WAIT_FRAME || capture.state == CAPTURE_LINES;
+}
+
+void restartCapture(){
+    capture.write = capture.buffer;
+    capture.bandEnd = (capture.bandBytes != 0) ? capture.buffer + capture.bandBytes : NULL;
+    capture.keptRows = 0;
+    capture.overrun = false;
+    capture.row = 0;
+    capture.rowPhase = 0;
+    capture.state = CAPTURE_WAIT_VSYNC;
+}
+
+// Starts reading the next frame into buffer, sized by setupFrameBuffer() for the current mode and cameraRoi.
+void captureBegin(byte* buffer){
+    capture.buffer = buffer;
+    capture.width = cameraWidth();
+    capture.height = cameraHeight();
+    capture.grayscale = (cameraFormat == GRAYSCALE);
+    capture.window = cameraRoi;
+    validateCameraWindow(&capture.window, cameraResolution, cameraFormat);
+    uint32_t linePeriodMicros = cameraFramePeriodMicros(cameraFPS) * CAMERA_BLANKING_DENOMINATOR / ((uint32_t) CAMERA_BLANKING_NUMERATOR * capture.height);
+    if(linePeriodMicros != capture.linePeriodMicros){
+        capture.linePeriodMicros = linePeriodMicros;
+        capture.backPorchMicros = 0;
+    }
+    capture.outputRows = (capture.window.height + capture.window.scale - 1) / capture.window.scale;
+    capture.bandBytes = 0;
+    capture.nextBand = NULL;
+    capture.restart = NULL;
+    capture.startMillis = millis();
+    restartCapture();
+}
+
+// Same as captureBegin() but the kept rows go to bands of bandBytes (whole rows), handed over by nextBand() as they fill.
+void captureBeginBands(byte* buffer, size_t bandBytes, byte* (*nextBand)(), byte* (*restart)()){
+    captureBegin(buffer);
+    capture.bandBytes = bandBytes;
+    capture.nextBand = nextBand;
+    capture.restart = restart;
+    restartCapture();
+}
+
+// The frame being read is lost, the next one is read into the buffer the restart hook gives.
+void dropCapture(){
+    captureStats.framesDropped++;
+    if(capture.restart != NULL){
+        capture.buffer = capture.restart();
+        if(capture.buffer == NULL){
+            capture.state = CAPTURE_IDLE;
+            return;
+        }
+    }
+    restartCapture();
+}
+
+void captureAbort(){
+    if(captureBusy()){
+        capture.state = CAPTURE_IDLE;
+    }
+}
+
+// Every byte of the line is clocked out of the sensor, only the ones inside the window are stored.
+inline void captureLine(){
+    uint16_t windowRight = capture.window.x + capture.window.width;
+    bool keepRow = capture.row >= capture.window.y && capture.row < capture.window.y + capture.window.height && capture.rowPhase == 0;
+    if(capture.row >= capture.window.y){
+        capture.rowPhase = (capture.rowPhase + 1 == capture.window.scale) ? 0 : capture.rowPhase + 1;
+    }
+
+    byte* write = capture.write;
+    uint8_t columnPhase = 0;
+    for(uint16_t column = 0; column < capture.width; column++){
+        uint8_t first = cameraBusReadByte();
+        uint8_t second = cameraBusReadByte();
+        if(keepRow && column >= capture.window.x && column < windowRight){
+            if(columnPhase == 0){
+                *write++ = first;
+                if(!capture.grayscale){
+                    *write++ = second;
+                }
+            }
+            columnPhase = (columnPhase + 1 == capture.window.scale) ? 0 : columnPhase + 1;
+        }
+    }
+    capture.write = write;
+    if(keepRow && ++capture.keptRows < capture.outputRows && write == capture.bandEnd){
+        byte* next = capture.nextBand();
+        capture.overrun = (next == NULL);
+        if(!capture.overrun){
+            capture.write = next;
+            capture.bandEnd = next + capture.bandBytes;
+        }
+    }
+    while(cameraBusHref());
+    capture.lineEndMicros = micros();
+    capture.row++;
+    captureStats.lines++;
+}
+
+// How long loop() may stay away from the bus without the engine missing data.
+// The first line comes a measured back porch after VSYNC, a quarter line early to be safe.
+uint32_t captureSpareMicros(){
+    uint32_t blanking = capture.linePeriodMicros * CAPTURE_HBLANK_PERCENT / 100;
+    if(capture.state == CAPTURE_LINES && capture.row > 0){
+        uint32_t elapsed = micros() - capture.lineEndMicros;
+        return (elapsed < blanking) ? blanking - elapsed : 0;
+    }
+    if(capture.state == CAPTURE_LINES){
+        uint32_t elapsed = micros() - capture.frameMicros + capture.linePeriodMicros / 4;
+        if(capture.backPorchMicros == 0){
+            return blanking;
+        }
+        return (elapsed < capture.backPorchMicros) ? capture.backPorchMicros - elapsed : 0;
+    }
+    if(capture.state == CAPTURE_WAIT_FRAME){
+        return blanking; // The falling edge times the frame.
+    }
+    if(capture.state == CAPTURE_WAIT_VSYNC){
+        return capture.linePeriodMicros; // VSYNC stays high for several lines.
+    }
+    return CAPTURE_SLICE_MICROS;
+}
+
+// Advances the capture for about budgetMicros and returns its state, CAPTURE_UNSLICED reads the frame to the end.
+captureState captureStep(uint32_t budgetMicros){
+    if(!captureBusy()){
+        return capture.state;
+    }
+    bool sliced = (budgetMicros != CAPTURE_UNSLICED);
+    uint32_t stepStart = micros();
+    bool reentered = true;
+
+    while(captureBusy()){
+        if(capture.state == CAPTURE_WAIT_VSYNC){
+            if(!cameraBusVsync()){
+                if(millis() - capture.startMillis > CAMERA_FRAME_TIMEOUT_MS){
+                    capture.state = CAPTURE_FAILED;
+                    captureStats.framesFailed++;
+                }
+                else if(sliced){
+                    break;
+                }
+                continue;
+            }
+            capture.state = CAPTURE_WAIT_FRAME;
+            continue;
+        }
+
+        // The vertical back porch is many lines long, a first line already started when loop() comes back drops the frame below.
+        if(capture.state == CAPTURE_WAIT_FRAME){
+            if(cameraBusVsync()){
+                reentered = false;
+                if(sliced && micros() - stepStart >= budgetMicros){
+                    break;
+                }
+                continue;
+            }
+            capture.frameMicros = micros();
+            capture.state = CAPTURE_LINES;
+            continue;
+        }
+
+        noInterrupts();
+        if(sliced && reentered && cameraBusHref()){
+            interrupts();
+            dropCapture();
+            continue;
+        }
+        reentered = false;
+
+        // Between lines the wait is one horizontal blanking, only the vertical back porch before the first line is long enough to yield in,
+        // and only once it was measured, up to a quarter line before it ends.
+        bool yielded = false;
+        while(!cameraBusHref()){
+            if(sliced && capture.row == 0 && micros() - stepStart >= budgetMicros && captureSpareMicros() > 0){
+                yielded = true;
+                break;
+            }
+        }
+        if(yielded){
+            break;
+        }
+        if(capture.row == 0){
+            capture.backPorchMicros = micros() - capture.frameMicros;
+        }
+
+        // A whole line period without HREF means loop() came back in the blanking after a missed line.
+        if(sliced && capture.row > 0 && micros() - capture.lineEndMicros > capture.linePeriodMicros){
+            interrupts();
+            dropCapture();
+            continue;
+        }
+        captureLine();
+        if(capture.overrun){
+            interrupts();
+            dropCapture();
+            continue;
+        }
+        if(capture.row == capture.height){
+            capture.state = CAPTURE_DONE;
+            captureStats.framesCaptured++;
+            captureStats.lastFrameMicros = micros() - capture.frameMicros;
+            captureStats.lastFrameResolution = cameraResolution;
+            captureStats.lastFrameFPS = cameraFPS;
+        }
+        else if(sliced){
+            interrupts();
+            if(micros() - stepStart >= budgetMicros){
+                break;
+            }
+            noInterrupts();
+        }
+    }
+    interrupts();
+
+    uint32_t stepMicros = micros() - stepStart;
+    captureStats.steps++;
+    if(stepMicros > captureStats.longestStepMicros){
+        captureStats.longestStepMicros = stepMicros;
+    }
+    return capture.state;
+}
+
+// Blocking readout, same result as Camera.readFrame() but with the geometry and window kept in camera.h.
+int readCameraFrame(byte* buffer){
+    captureBegin(buffer);
+    captureState state = captureStep(CAPTURE_UNSLICED);
+    capture.state = CAPTURE_IDLE;
+    return (state == CAPTURE_DONE) ? 0 : 1;
+}
+
+int takePhoto(byte** frameBuffer, size_t* frameBufferSize){
+    if(setupFrameBuffer(frameBuffer, frameBufferSize)){
+        commandLink->println("Failed to setup frame buffer.");
+        return 1;
+    }
+
+    if(!cameraReady || readCameraFrame(*frameBuffer)){
+        freeFrameBuffer(frameBuffer);
+    }
+
+    if(*frameBuffer == NULL){
+        *frameBufferSize = 0;
+        commandLink->println("Failed to read frame.");
+        return 1;
+    }
+    bootTraceClose("firstFrame");
+    return 0;
+}
+
+#endif
\ No newline at end of file
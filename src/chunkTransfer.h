@@ -0,0 +1,267 @@
+#ifndef CHUNKTRANSFER_H
+#define CHUNKTRANSFER_H
+
+#include <Arduino.h>
+#include <stream.h>
+#include <transport.h>
+
+#define CHUNK_DEFAULT_BYTES 1024
+#define CHUNK_MIN_BYTES 64
+#define CHUNK_MAX_BYTES 8192
+#define CHUNK_MAX_CHUNKS 512        // Chunks a frame is split into at most, larger frames get larger chunks.
+#define CHUNK_DEFAULT_WINDOW 16     // Chunks sent ahead of the host's acknowledgement.
+#define CHUNK_MAX_WINDOW 64
+#define CHUNK_RETRY_MS 250          // Nothing left to send in the window and no acknowledgement: the first chunk missing goes again.
+#define CHUNK_RETRY_MAX_MS 4000     // The wait doubles after each timeout, up to this.
+#define CHUNK_RETRIES 5             // Timeouts in a row before the device stops sending again and only waits for the host.
+#define CHUNK_ABANDON_MS 30000      // Nothing from the host for that long: it is gone, the transfer ends.
+
+// "takePhoto --chunked": the frame stays in its buffer once read and is sent as "CHUNK <transfer> <index> <offset>
+// <bytes> <crc32>\r\n", the bytes and "\r\n", after a "TRANSFER <transfer> <bytes> <chunk bytes> <chunks> <window>\r\n"
+// record. At most a window of chunks goes ahead of the host's "transfer ack <n>" (every chunk before n arrived),
+// "transfer nack <index>" sends one chunk again. A chunk lost or corrupted on the way costs that chunk, not a capture.
+typedef struct{
+    bool requested;                         // The photo being read is sent in chunks.
+    size_t requestedBytes;
+    uint16_t requestedWindow;
+    bool active;
+    uint16_t transfer;
+    const byte* frame;
+    size_t frameBytes;
+    size_t chunkBytes;
+    uint16_t chunks;
+    uint16_t window;
+    uint16_t acked;                         // Chunks before it reached the host.
+    uint16_t next;                          // First chunk never sent.
+    uint8_t resend[CHUNK_MAX_CHUNKS / 8];   // Chunks to send again, asked for by the host or timed out.
+    uint32_t hostMillis;                    // Last "transfer" command.
+    uint32_t retryMillis;                   // Last acknowledgement or timeout.
+    uint32_t retryWaitMillis;               // Before the next timeout, doubled by each one.
+    uint8_t retries;                        // Timeouts since the last acknowledgement.
+    uint32_t startMillis;
+    uint32_t elapsedMillis;                 // First chunk to the last acknowledgement, of the last transfer.
+    uint32_t chunksSent;
+    uint32_t chunksResent;
+    uint32_t nacks;
+    uint32_t timeouts;
+} chunkTransferState;
+
+chunkTransferState chunkTransfer;
+
+// CRC-32 of zlib (reflected 0xEDB88320), four bits at a time to keep the table out of the way.
+uint32_t crc32Update(uint32_t crc, const byte* data, size_t size){
+    static const uint32_t nibbles[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    crc = ~crc;
+    for(size_t index = 0; index < size; index++){
+        crc ^= data[index];
+        crc = (crc >> 4) ^ nibbles[crc & 0x0F];
+        crc = (crc >> 4) ^ nibbles[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+bool chunkTransferActive(){
+    return captureOwner == CAPTURE_FOR_TRANSFER;
+}
+
+// Called by "takePhoto" before the capture starts.
+void chunkTransferRequest(bool chunked, size_t chunkBytes, uint16_t window){
+    chunkTransfer.requested = chunked;
+    chunkTransfer.requestedBytes = chunkBytes;
+    chunkTransfer.requestedWindow = window;
+}
+
+bool chunkTransferWanted(){
+    return chunkTransfer.requested;
+}
+
+void chunkTransferAnnounce(){
+    chunkTransferState& transfer = chunkTransfer;
+    frameLink->print("TRANSFER ");
+    frameLink->print(transfer.transfer);
+    frameLink->print(" ");
+    frameLink->print((uint32_t) transfer.frameBytes);
+    frameLink->print(" ");
+    frameLink->print((uint32_t) transfer.chunkBytes);
+    frameLink->print(" ");
+    frameLink->print(transfer.chunks);
+    frameLink->print(" ");
+    frameLink->print(transfer.window);
+    frameLink->print("\r\n");
+}
+
+void chunkTransferBegin(const byte* frame, size_t frameBytes){
+    chunkTransferState& transfer = chunkTransfer;
+    transfer.requested = false;
+    transfer.frame = frame;
+    transfer.frameBytes = frameBytes;
+    transfer.chunkBytes = transfer.requestedBytes;
+    while((frameBytes + transfer.chunkBytes - 1) / transfer.chunkBytes > CHUNK_MAX_CHUNKS){
+        transfer.chunkBytes *= 2;
+    }
+    transfer.chunks = (frameBytes + transfer.chunkBytes - 1) / transfer.chunkBytes;
+    transfer.window = transfer.requestedWindow;
+    transfer.acked = 0;
+    transfer.next = 0;
+    memset(transfer.resend, 0, sizeof(transfer.resend));
+    transfer.transfer++;
+    transfer.hostMillis = millis();
+    transfer.retryMillis = transfer.hostMillis;
+    transfer.retryWaitMillis = CHUNK_RETRY_MS;
+    transfer.retries = 0;
+    transfer.startMillis = transfer.hostMillis;
+    transfer.elapsedMillis = 0;
+    transfer.chunksSent = 0;
+    transfer.chunksResent = 0;
+    transfer.nacks = 0;
+    transfer.timeouts = 0;
+    transfer.active = true;
+    captureOwner = CAPTURE_FOR_TRANSFER;
+
+    chunkTransferAnnounce();
+}
+
+// The frame buffer is kept, as after any photo, until the next capture needs it.
+void chunkTransferEnd(){
+    chunkTransfer.active = false;
+    captureOwner = CAPTURE_FOR_NONE;
+}
+
+bool chunkResendPending(uint16_t index){
+    return chunkTransfer.resend[index / 8] & (1 << (index % 8));
+}
+
+void chunkMarkResend(uint16_t index, bool pending){
+    if(pending){
+        chunkTransfer.resend[index / 8] |= (1 << (index % 8));
+    }
+    else{
+        chunkTransfer.resend[index / 8] &= ~(1 << (index % 8));
+    }
+}
+
+void sendChunk(uint16_t index){
+    chunkTransferState& transfer = chunkTransfer;
+    size_t offset = (size_t) index * transfer.chunkBytes;
+    size_t size = (transfer.frameBytes - offset < transfer.chunkBytes) ? transfer.frameBytes - offset : transfer.chunkBytes;
+    char header[64];
+    snprintf(header, sizeof(header), "CHUNK %u %u %lu %lu %08lx\r\n", transfer.transfer, index, (unsigned long) offset,
+             (unsigned long) size, (unsigned long) crc32Update(0, transfer.frame + offset, size));
+    transportSegment segments[3] = {{header, strlen(header)}, {transfer.frame + offset, size}, {"\r\n", 2}};
+    frameLink->writev(segments, 3);
+    transfer.chunksSent++;
+}
+
+// Called on every loop(): one chunk per call, the ones asked for again first.
+void serviceChunkTransfer(){
+    chunkTransferState& transfer = chunkTransfer;
+    uint32_t now = millis();
+    if(now - transfer.hostMillis > CHUNK_ABANDON_MS){
+        chunkTransferEnd();
+        postEvent(EVENT_ERROR, micros(), "error abandoned");
+        commandLink->print("Transfer ");
+        commandLink->print(transfer.transfer);
+        commandLink->println(" abandoned, no acknowledgement from the host.");
+        return;
+    }
+
+    uint16_t end = (transfer.acked + transfer.window < transfer.chunks) ? transfer.acked + transfer.window : transfer.chunks;
+    for(uint16_t index = transfer.acked; index < transfer.next && index < end; index++){
+        if(chunkResendPending(index)){
+            chunkMarkResend(index, false);
+            sendChunk(index);
+            transfer.chunksResent++;
+            return;
+        }
+    }
+    if(transfer.next < end){
+        sendChunk(transfer.next++);
+        return;
+    }
+
+    // Everything the window allows is out: either the acknowledgements are on their way or something was lost. A host
+    // that stays silent gets fewer and fewer retries, then none until it acknowledges or the transfer is abandoned.
+    if(transfer.retries < CHUNK_RETRIES && now - transfer.retryMillis > transfer.retryWaitMillis){
+        if(transfer.acked == 0){
+            chunkTransferAnnounce();    // The host may have lost the record that started the transfer.
+        }
+        chunkMarkResend(transfer.acked, true);
+        transfer.timeouts++;
+        transfer.retries++;
+        transfer.retryMillis = now;
+        transfer.retryWaitMillis = (2 * transfer.retryWaitMillis < CHUNK_RETRY_MAX_MS) ? 2 * transfer.retryWaitMillis : CHUNK_RETRY_MAX_MS;
+    }
+}
+
+// "transfer ack <n>": every chunk before n reached the host. The last one ends the transfer.
+int chunkTransferAck(uint16_t received){
+    chunkTransferState& transfer = chunkTransfer;
+    if(!chunkTransferActive() || received > transfer.next){
+        return 1;
+    }
+    transfer.hostMillis = millis();
+    if(received > transfer.acked){
+        transfer.acked = received;
+        transfer.retryMillis = transfer.hostMillis;
+        transfer.retryWaitMillis = CHUNK_RETRY_MS;
+        transfer.retries = 0;
+    }
+    if(transfer.acked == transfer.chunks){
+        transfer.elapsedMillis = transfer.hostMillis - transfer.startMillis;
+        chunkTransferEnd();
+        commandLink->print("Transfer ");
+        commandLink->print(transfer.transfer);
+        commandLink->print(" complete, ");
+        commandLink->print(transfer.chunksResent);
+        commandLink->println(" chunks sent again.");
+    }
+    return 0;
+}
+
+// "transfer nack <index>": the chunk failed its CRC or never came.
+int chunkTransferNack(uint16_t index){
+    chunkTransferState& transfer = chunkTransfer;
+    if(!chunkTransferActive() || index >= transfer.next){
+        return 1;
+    }
+    transfer.hostMillis = millis();
+    transfer.nacks++;
+    if(index >= transfer.acked){
+        chunkMarkResend(index, true);
+    }
+    return 0;
+}
+
+void printChunkTransferStats(){
+    chunkTransferState& transfer = chunkTransfer;
+    if(transfer.transfer == 0){
+        return;
+    }
+    uint32_t elapsed = transfer.active ? millis() - transfer.startMillis : transfer.elapsedMillis;
+    size_t delivered = transfer.active ? (size_t) transfer.acked * transfer.chunkBytes : transfer.frameBytes;
+    delivered = (delivered < transfer.frameBytes) ? delivered : transfer.frameBytes;
+    commandLink->print("\tTransfer ");
+    commandLink->print(transfer.transfer);
+    commandLink->print(transfer.active ? ": sending, " : ": done, ");
+    commandLink->print(transfer.acked);
+    commandLink->print("/");
+    commandLink->print(transfer.chunks);
+    commandLink->print(" chunks of ");
+    commandLink->print((uint32_t) transfer.chunkBytes);
+    commandLink->print(" bytes acknowledged, ");
+    commandLink->print(transfer.chunksSent);
+    commandLink->print(" sent, ");
+    commandLink->print(transfer.chunksResent);
+    commandLink->print(" again (");
+    commandLink->print(transfer.nacks);
+    commandLink->print(" nacks, ");
+    commandLink->print(transfer.timeouts);
+    commandLink->print(" timeouts), goodput ");
+    commandLink->print((elapsed != 0) ? (uint32_t) ((uint64_t) delivered * 1000 / elapsed) : 0);
+    commandLink->print(" bytes/s.\n");
+}
+
+#endif
\ No newline at end of file
@@ -3,14 +3,29 @@
 
 #include <Arduino.h>
 #include <camera.h>
+#include <profiles.h>
+#include <capture.h>
+#include <stream.h>
+#include <threads.h>
+#include <bootTrace.h>
+#include <arena.h>
+#include <transport.h>
+#include <bleTransport.h>
+#include <memoryStats.h>
+#include <chunkTransfer.h>
+#include <linkBench.h>
+#include <autoConfig.h>
+#include <machineMode.h>
+#include <cameraSettings.h>
 #include <argtable3.h>
 
-#define COMMANDS 5
+#define COMMANDS 23
+static_assert(COMMANDS <= BOOT_TRACE_ENTRIES - BOOT_TRACE_PHASES, "every command gets its boot trace step");
 #define CAMERA_CONFIGURATION_MAXTRIES 3
 
 #define REG_EXTENDED 1
 #define REG_ICASE (REG_EXTENDED << 1)
-void arg_print_syntax_custom(HardwareSerial* printable, void** argtable, const char* suffix) {
+void arg_print_syntax_custom(transport* printable, void** argtable, const char* suffix) {
     arg_dstr_t ds = arg_dstr_create();
     arg_print_syntax_ds(ds, argtable, suffix);
     printable->print(arg_dstr_cstr(ds));
@@ -18,7 +33,7 @@ void arg_print_syntax_custom(HardwareSerial* printable, void** argtable, const c
     arg_dstr_destroy(ds);
 }
 
-void arg_print_glossary_custom(HardwareSerial* printable, void** argtable, const char* format) {
+void arg_print_glossary_custom(transport* printable, void** argtable, const char* format) {
     arg_dstr_t ds = arg_dstr_create();
     arg_print_glossary_ds(ds, argtable, format);
     printable->print(arg_dstr_cstr(ds));
@@ -29,26 +44,42 @@ typedef struct{
     void** argtable;
     int parseErrors;
     const char* helpMsg;
-    void (*function)();
+    int (*function)();      // COMMAND_OK, COMMAND_FAILED or COMMAND_BUSY.
+    bool payload;           // Its output is the answer, machine mode sends it after the record.
 } command_struct;
 
 command_struct** commandList;
 
+// Mode changes resize the frame being read, they wait for the capture to end.
+bool captureInProgress(){
+    if(captureOwner == CAPTURE_FOR_NONE){
+        return false;
+    }
+    if(captureOwner == CAPTURE_FOR_TRANSFER){
+        commandLink->println("Photo transfer in progress, acknowledge it or use \"transfer abort\" and try again.");
+        return true;
+    }
+    commandLink->println("Capture in progress, use \"stream stop\" or wait for the photo and try again.");
+    return true;
+}
+uint32_t firstCommandMillis = 0; // millis() when the first valid command ran, power-on is millis() 0.
+
 struct {
     struct arg_rex* arg_cmd;
     struct arg_end* arg_end;
 } help_argtable;
 command_struct help_command_struct; // help_command symbol is already used by .platformio\packages\framework-arduino-mbed\variants\ARDUINO_NANO33BLE\libs\libmbed.a
 
-void help_function(){
-    Serial.print("List of commands:\n");
+int help_function(){
+    commandLink->print("List of commands:\n");
     for(size_t commandIndex = 0; commandIndex < COMMANDS; commandIndex++){
-        Serial.print("\t");
-        arg_print_syntax_custom(&Serial, commandList[commandIndex]->argtable, "\t\t");
-        Serial.print(commandList[commandIndex]->helpMsg);
-        Serial.print("\n");
+        commandLink->print("\t");
+        arg_print_syntax_custom(commandLink, commandList[commandIndex]->argtable, "\t\t");
+        commandLink->print(commandList[commandIndex]->helpMsg);
+        commandLink->print("\n");
     }
-    Serial.println();
+    commandLink->println();
+    return COMMAND_OK;
 }
 
 struct {
@@ -59,39 +90,45 @@ struct {
 } setResolution_argtable;
 command_struct setResolution_command;
 
-void setResolution_function(){
+int setResolution_function(){
     if(setResolution_argtable.arg_help->count == 1){
-        Serial.println("Usage: ");
-        arg_print_syntax_custom(&Serial, setResolution_command.argtable, "\n");
-        arg_print_glossary_custom(&Serial, setResolution_command.argtable,"      %-20s %s\n");
-        Serial.println("\nDetails: ");
-        Serial.println(setResolution_command.helpMsg);
-        Serial.println("<resolution> is a unsigned integer with possible values:");
-        Serial.println("\t0 -> VGA (640x480).");
-        Serial.println("\t1 -> CIF (352x240).");
-        Serial.println("\t2 -> QVGA (320x240).");
-        Serial.println("\t3 -> QCIF (176x144).");
-        Serial.println("\t4 -> QQVGA (160x120).");
-        return;
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, setResolution_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, setResolution_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(setResolution_command.helpMsg);
+        commandLink->println("<resolution> is a unsigned integer with possible values:");
+        commandLink->println("\t0 -> VGA (640x480).");
+        commandLink->println("\t1 -> CIF (352x240).");
+        commandLink->println("\t2 -> QVGA (320x240).");
+        commandLink->println("\t3 -> QCIF (176x144).");
+        commandLink->println("\t4 -> QQVGA (160x120).");
+        return COMMAND_OK;
+    }
+
+    if(captureInProgress()){
+        return COMMAND_BUSY;
     }
 
     if(setResolution_argtable.arg_int->count == 0){
-        Serial.println("Missing <resolution> value, use \"setResolution --help\" for more details.");
-        return;
+        commandLink->println("Missing <resolution> value, use \"setResolution --help\" for more details.");
+        return COMMAND_FAILED;
     }
 
     uint8_t selectedResolution = setResolution_argtable.arg_int->ival[0];
     if(selectedResolution > 4){
-        Serial.println("Invalid <resolution> value, use \"setResolution --help\" for more details.");
-        return;
+        commandLink->println("Invalid <resolution> value, use \"setResolution --help\" for more details.");
+        return COMMAND_FAILED;
     }
 
+    stopAutoConfig();
     if(configureResolution(selectedResolution, CAMERA_CONFIGURATION_MAXTRIES) != 0){
-        Serial.println("Unexpected error, check syntax with the flag \"--help\" and try again.");
-        return;
+        commandLink->println("Unexpected error, check syntax with the flag \"--help\" and try again.");
+        return COMMAND_FAILED;
     }
 
-    Serial.println("Camera resolution applied correctly.");
+    commandLink->println("Camera resolution applied correctly.");
+    return COMMAND_OK;
 }
 
 struct {
@@ -102,98 +139,986 @@ struct {
 } setFormat_argtable;
 command_struct setFormat_command;
 
-void setFormat_function(){
+int setFormat_function(){
     if(setFormat_argtable.arg_help->count == 1){
-        Serial.println("Usage: ");
-        arg_print_syntax_custom(&Serial, setFormat_command.argtable, "\n");
-        arg_print_glossary_custom(&Serial, setFormat_command.argtable,"      %-20s %s\n");
-        Serial.println("\nDetails: ");
-        Serial.println(setFormat_command.helpMsg);
-        Serial.println("<format> is a unsigned integer with possible values:");
-        Serial.println("\t0 -> YUV422 (1 byte per pixel).");
-        Serial.println("\t1 -> RGB444 (1 byte per pixel).");
-        Serial.println("\t2 -> RGB565 (2 bytes per pixel).");
-        Serial.println("\t3 -> GRAYSCALE (2 bytes per pixel).");
-        return;
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, setFormat_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, setFormat_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(setFormat_command.helpMsg);
+        commandLink->println("<format> is a unsigned integer with possible values:");
+        commandLink->println("\t0 -> YUV422 (1 byte per pixel).");
+        commandLink->println("\t1 -> RGB444 (1 byte per pixel).");
+        commandLink->println("\t2 -> RGB565 (2 bytes per pixel).");
+        commandLink->println("\t3 -> GRAYSCALE (2 bytes per pixel).");
+        return COMMAND_OK;
+    }
+
+    if(captureInProgress()){
+        return COMMAND_BUSY;
     }
 
     if(setFormat_argtable.arg_int->count == 0){
-        Serial.println("Missing <format> value, use \"setFormat --help\" for more details.");
-        return;
+        commandLink->println("Missing <format> value, use \"setFormat --help\" for more details.");
+        return COMMAND_FAILED;
     }
 
     uint8_t selectedFormat = setFormat_argtable.arg_int->ival[0];
     if(selectedFormat > 3){
-        Serial.println("Invalid <format> value, use \"setFormat --help\" for more details.");
-        return;
+        commandLink->println("Invalid <format> value, use \"setFormat --help\" for more details.");
+        return COMMAND_FAILED;
     }
 
     selectedFormat = (selectedFormat == 3) ? 4 : selectedFormat; // GRAYSCALE enum is value 4.
 
+    stopAutoConfig();
     if(configureFormat(selectedFormat, CAMERA_CONFIGURATION_MAXTRIES) != 0){
-        Serial.println("Unexpected error, check syntax with the flag \"--help\" and try again.");
-        return;
+        commandLink->println("Unexpected error, check syntax with the flag \"--help\" and try again.");
+        return COMMAND_FAILED;
     }
     
-    Serial.println("Camera format applied correctly.");
+    commandLink->println("Camera format applied correctly.");
+    return COMMAND_OK;
 }
 
 struct {
     struct arg_rex* arg_cmd;
+    struct arg_lit* arg_json;
+    struct arg_lit* arg_cbor;
     struct arg_lit* arg_help;
     struct arg_end* arg_end;
 } getCameraSettings_argtable;
 command_struct getCameraSettings_command;
 
-void getCameraSettings_function(){
+int getCameraSettings_function(){
     if(getCameraSettings_argtable.arg_help->count == 1){
-        Serial.println("Usage: ");
-        arg_print_syntax_custom(&Serial, getCameraSettings_command.argtable, "\n");
-        arg_print_glossary_custom(&Serial, getCameraSettings_command.argtable,"      %-20s %s\n");
-        Serial.println("\nDetails: ");
-        Serial.println(getCameraSettings_command.helpMsg);
-        return;
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, getCameraSettings_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, getCameraSettings_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(getCameraSettings_command.helpMsg);
+        commandLink->println("--json sends one line with the keys model, resolution, sensorWidth, sensorHeight, format, width, height,");
+        commandLink->println("bytesPerPixel, frameBytes, fps, framePeriodUs, window {x, y, width, height, scale} and pins {vsync, href,");
+        commandLink->println("pclk, xclk, data}. --cbor sends the same map as \"CBOR <bytes>\\r\\n\", the bytes and \"\\r\\n\".");
+        return COMMAND_OK;
     }
 
-    printCameraSettings();
+    bool json = (getCameraSettings_argtable.arg_json->count == 1);
+    bool cbor = (getCameraSettings_argtable.arg_cbor->count == 1);
+    if(json && cbor){
+        commandLink->println("Use either --json or --cbor, use \"getCameraSettings --help\" for more details.");
+        return COMMAND_FAILED;
+    }
+    if(!json && !cbor){
+        printCameraSettings();
+        return COMMAND_OK;
+    }
+    if(sendCameraSettings(commandLink, cbor)){
+        commandLink->println("Camera settings do not fit the document buffer.");
+        return COMMAND_FAILED;
+    }
+    return COMMAND_OK;
 }
 
 struct {
     struct arg_rex* arg_cmd;
+    struct arg_lit* arg_chunked;
+    struct arg_int* arg_chunkBytes;
+    struct arg_int* arg_window;
     struct arg_lit* arg_help;
     struct arg_end* arg_end;
 } takePhoto_argtable;
 command_struct takePhoto_command;
 
-void takePhoto_function(){
+int takePhoto_function(){
     if(takePhoto_argtable.arg_help->count == 1){
-        Serial.println("Usage: ");
-        arg_print_syntax_custom(&Serial, takePhoto_command.argtable, "\n");
-        arg_print_glossary_custom(&Serial, takePhoto_command.argtable,"      %-20s %s\n");
-        Serial.println("\nDetails: ");
-        Serial.println(takePhoto_command.helpMsg);
-        return;
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, takePhoto_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, takePhoto_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(takePhoto_command.helpMsg);
+        commandLink->println("--chunked keeps the frame and sends it as \"CHUNK <transfer> <index> <offset> <bytes> <crc32>\\r\\n\", the bytes and \"\\r\\n\",");
+        commandLink->println("after \"TRANSFER <transfer> <bytes> <chunk bytes> <chunks> <window>\\r\\n\". At most --window chunks go ahead of");
+        commandLink->println("\"transfer ack <n>\", \"transfer nack <index>\" sends a chunk again, the last ack or \"transfer abort\" ends the transfer.");
+        return COMMAND_OK;
+    }
+
+    if(captureInProgress()){
+        return COMMAND_BUSY;
+    }
+
+    bool chunked = (takePhoto_argtable.arg_chunked->count == 1);
+    int chunkBytes = (takePhoto_argtable.arg_chunkBytes->count == 1) ? takePhoto_argtable.arg_chunkBytes->ival[0] : CHUNK_DEFAULT_BYTES;
+    int window = (takePhoto_argtable.arg_window->count == 1) ? takePhoto_argtable.arg_window->ival[0] : CHUNK_DEFAULT_WINDOW;
+    if(chunkBytes < CHUNK_MIN_BYTES || chunkBytes > CHUNK_MAX_BYTES || window < 1 || window > CHUNK_MAX_WINDOW){
+        commandLink->println("Invalid --chunk-bytes or --window value, use \"takePhoto --help\" for more details.");
+        return COMMAND_FAILED;
+    }
+    chunkTransferRequest(chunked, chunkBytes, window);
+
+    // The frame is sent by serviceCapture() once read, loop() keeps serving commands meanwhile.
+    if(startCamera(CAMERA_CONFIGURATION_MAXTRIES) || startPhotoCapture()){
+        commandLink->println("Failed to take photo.");
+        return COMMAND_FAILED;
+    }
+    return COMMAND_OK;
+}
+
+struct {
+    struct arg_rex* arg_cmd;
+    struct arg_int* arg_int;
+    struct arg_lit* arg_help;
+    struct arg_end* arg_end;
+} setFPS_argtable;
+command_struct setFPS_command;
+
+int setFPS_function(){
+    if(setFPS_argtable.arg_help->count == 1){
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, setFPS_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, setFPS_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(setFPS_command.helpMsg);
+        commandLink->print("<fps> is a unsigned integer from 1 to the highest rate the readout keeps up with at the current resolution, now ");
+        commandLink->print(cameraMaxFPS(cameraResolution, cameraFormat));
+        commandLink->println(".");
+        commandLink->println("The sensor runs at 30 fps divided by an integer, the closest achievable frame period is used.");
+        return COMMAND_OK;
+    }
+
+    if(captureInProgress()){
+        return COMMAND_BUSY;
+    }
+
+    if(setFPS_argtable.arg_int->count == 0){
+        commandLink->println("Missing <fps> value, use \"setFPS --help\" for more details.");
+        return COMMAND_FAILED;
+    }
+
+    int selectedFPS = setFPS_argtable.arg_int->ival[0];
+    if(selectedFPS < 1 || selectedFPS > cameraMaxFPS(cameraResolution, cameraFormat)){
+        commandLink->print("Invalid <fps> value, the current resolution allows up to ");
+        commandLink->print(cameraMaxFPS(cameraResolution, cameraFormat));
+        commandLink->println(" fps, use \"setFPS --help\" for more details.");
+        return COMMAND_FAILED;
+    }
+
+    stopAutoConfig();
+    if(configureFPS(selectedFPS, CAMERA_CONFIGURATION_MAXTRIES) != 0){
+        commandLink->println("Unexpected error, check syntax with the flag \"--help\" and try again.");
+        return COMMAND_FAILED;
+    }
+
+    commandLink->print("Frame period: ");
+    commandLink->print(cameraFramePeriodMicros(cameraFPS));
+    commandLink->println(" us.");
+    commandLink->println("Camera frame rate applied correctly.");
+    return COMMAND_OK;
+}
+
+struct {
+    struct arg_rex* arg_cmd;
+    struct arg_rex* arg_action;
+    struct arg_str* arg_name;
+    struct arg_int* arg_res;
+    struct arg_int* arg_fmt;
+    struct arg_int* arg_fps;
+    struct arg_str* arg_roi;
+    struct arg_int* arg_scale;
+    struct arg_lit* arg_help;
+    struct arg_end* arg_end;
+} profileDefine_argtable;
+command_struct profileDefine_command;
+
+int profileDefine_function(){
+    if(profileDefine_argtable.arg_help->count == 1){
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, profileDefine_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, profileDefine_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(profileDefine_command.helpMsg);
+        commandLink->println("<resolution> and <format> take the values of setResolution and setFormat, <fps> defaults to the current frame rate.");
+        commandLink->println("<x,y,w,h> crops the frame in sensor pixels, <n> keeps one pixel out of n in each direction.");
+        commandLink->println("YUV422 windows need an even x and w and no scaling.");
+        return COMMAND_OK;
+    }
+
+    if(profileDefine_argtable.arg_name->count == 0 || profileDefine_argtable.arg_res->count == 0 || profileDefine_argtable.arg_fmt->count == 0){
+        commandLink->println("Missing <name>, --res or --fmt value, use \"profile define --help\" for more details.");
+        return COMMAND_FAILED;
+    }
+
+    int selectedResolution = profileDefine_argtable.arg_res->ival[0];
+    int selectedFormat = profileDefine_argtable.arg_fmt->ival[0];
+    if(selectedResolution < 0 || selectedResolution > 4 || selectedFormat < 0 || selectedFormat > 3){
+        commandLink->println("Invalid --res or --fmt value, use \"profile define --help\" for more details.");
+        return COMMAND_FAILED;
+    }
+    selectedFormat = (selectedFormat == 3) ? GRAYSCALE : selectedFormat;
+
+    cameraWindow window;
+    resetCameraWindow(&window);
+    if(profileDefine_argtable.arg_roi->count == 1){
+        unsigned int x, y, width, height;
+        if(sscanf(profileDefine_argtable.arg_roi->sval[0], "%u,%u,%u,%u", &x, &y, &width, &height) != 4 || width == 0 || height == 0 || x > 0xFFFF || y > 0xFFFF || width > 0xFFFF || height > 0xFFFF){
+            commandLink->println("Invalid --roi value, use \"profile define --help\" for more details.");
+            return COMMAND_FAILED;
+        }
+        window = {(uint16_t) x, (uint16_t) y, (uint16_t) width, (uint16_t) height, 1};
+    }
+    if(profileDefine_argtable.arg_scale->count == 1){
+        int scale = profileDefine_argtable.arg_scale->ival[0];
+        window.scale = (scale < 1 || scale > 8) ? 0 : scale;
+    }
+
+    int selectedFPS = (profileDefine_argtable.arg_fps->count == 1) ? profileDefine_argtable.arg_fps->ival[0] : cameraFPS;
+    selectedFPS = (selectedFPS < 0 || selectedFPS > CAMERA_MAX_FPS) ? 0 : selectedFPS;
+
+    cameraProfile* profile = defineCameraProfile(profileDefine_argtable.arg_name->sval[0], selectedResolution, selectedFormat, selectedFPS, window);
+    if(profile == NULL){
+        commandLink->println("Failed to define profile, check the window and frame rate fit the resolution and there is room for it.");
+        return COMMAND_FAILED;
+    }
+
+    commandLink->print("Profile ");
+    commandLink->print(profile->name);
+    commandLink->print(" defined: ");
+    commandLink->print(profile->frameWidth);
+    commandLink->print("x");
+    commandLink->print(profile->frameHeight);
+    commandLink->print(", ");
+    commandLink->print(profile->frameSize);
+    commandLink->println(" bytes per frame.");
+    return COMMAND_OK;
+}
+
+struct {
+    struct arg_rex* arg_cmd;
+    struct arg_rex* arg_action;
+    struct arg_str* arg_name;
+    struct arg_lit* arg_help;
+    struct arg_end* arg_end;
+} profileUse_argtable;
+command_struct profileUse_command;
+
+int profileUse_function(){
+    if(profileUse_argtable.arg_help->count == 1){
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, profileUse_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, profileUse_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(profileUse_command.helpMsg);
+        return COMMAND_OK;
+    }
+
+    if(captureInProgress()){
+        return COMMAND_BUSY;
+    }
+
+    if(profileUse_argtable.arg_name->count == 0){
+        commandLink->println("Missing <name> value, use \"profile use --help\" for more details.");
+        return COMMAND_FAILED;
+    }
+
+    cameraProfile* profile = findCameraProfile(profileUse_argtable.arg_name->sval[0]);
+    if(profile == NULL){
+        commandLink->println("Unknown profile, use the command \"profile list\" to get a list of profiles.");
+        return COMMAND_FAILED;
+    }
+
+    stopAutoConfig();
+    if(useCameraProfile(profile, CAMERA_CONFIGURATION_MAXTRIES) != 0){
+        commandLink->println("Unexpected error, check syntax with the flag \"--help\" and try again.");
+        return COMMAND_FAILED;
+    }
+
+    commandLink->print("Camera profile ");
+    commandLink->print(profile->name);
+    commandLink->println(" applied correctly.");
+    return COMMAND_OK;
+}
+
+struct {
+    struct arg_rex* arg_cmd;
+    struct arg_rex* arg_action;
+    struct arg_lit* arg_help;
+    struct arg_end* arg_end;
+} profileList_argtable;
+command_struct profileList_command;
+
+int profileList_function(){
+    if(profileList_argtable.arg_help->count == 1){
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, profileList_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, profileList_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(profileList_command.helpMsg);
+        return COMMAND_OK;
+    }
+
+    commandLink->print("Camera profiles (");
+    commandLink->print(cameraProfileCount);
+    commandLink->print("/");
+    commandLink->print(CAMERA_PROFILES);
+    commandLink->print("):\n");
+    for(uint8_t index = 0; index < cameraProfileCount; index++){
+        cameraProfile* profile = &cameraProfiles[index];
+        commandLink->print("\t");
+        commandLink->print(profile->name);
+        commandLink->print(": resolution ");
+        commandLink->print(profile->resolution);
+        commandLink->print(", format ");
+        commandLink->print((profile->format == GRAYSCALE) ? 3 : profile->format);
+        commandLink->print(", ");
+        commandLink->print(profile->fps);
+        commandLink->print(" fps");
+        commandLink->print(", window ");
+        commandLink->print(profile->window.x);
+        commandLink->print(",");
+        commandLink->print(profile->window.y);
+        commandLink->print(" ");
+        commandLink->print(profile->window.width);
+        commandLink->print("x");
+        commandLink->print(profile->window.height);
+        commandLink->print(", scale ");
+        commandLink->print(profile->window.scale);
+        commandLink->print(", ");
+        commandLink->print(profile->frameSize);
+        commandLink->print(" bytes.\n");
+    }
+    return COMMAND_OK;
+}
+
+struct {
+    struct arg_rex* arg_cmd;
+    struct arg_lit* arg_help;
+    struct arg_end* arg_end;
+} status_argtable;
+command_struct status_command;
+
+int status_function(){
+    if(status_argtable.arg_help->count == 1){
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, status_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, status_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(status_command.helpMsg);
+        return COMMAND_OK;
+    }
+
+    commandLink->print("Status:\n\tUptime: ");
+    commandLink->print(millis());
+    commandLink->print(" ms.\n\tCamera: ");
+    if(cameraReady){
+        commandLink->print("ready since ");
+        commandLink->print(cameraStartedMillis);
+        commandLink->print(" ms, bring-up took ");
+        commandLink->print(cameraStartupMillis);
+        commandLink->print(" ms.\n");
+    }
+    else if(cameraStartFailed){
+        commandLink->print("failed to start, retried on next use.\n");
+    }
+    else{
+        commandLink->print("not started, starts on first use.\n");
+    }
+    commandLink->print("\tFirst command: ");
+    commandLink->print(firstCommandMillis);
+    commandLink->println(" ms after power-on.");
+    return COMMAND_OK;
+}
+
+struct {
+    struct arg_rex* arg_cmd;
+    struct arg_lit* arg_help;
+    struct arg_end* arg_end;
+} bootTrace_argtable;
+command_struct bootTrace_command;
+
+int bootTrace_function(){
+    if(bootTrace_argtable.arg_help->count == 1){
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, bootTrace_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, bootTrace_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(bootTrace_command.helpMsg);
+        commandLink->println("First line: bootTrace,<cycle counter Hz>,<entries>,<1 once the first frame was captured>,<marks dropped>.");
+        commandLink->println("Then one <label>,<micros since power-on>,<cycles> line per mark, each mark ends the phase it names.");
+        return COMMAND_OK;
+    }
+
+    printBootTrace();
+    return COMMAND_OK;
+}
+
+struct {
+    struct arg_rex* arg_cmd;
+    struct arg_rex* arg_action;
+    struct arg_int* arg_frames;
+    struct arg_lit* arg_threads;
+    struct arg_lit* arg_help;
+    struct arg_end* arg_end;
+} streamStart_argtable;
+command_struct streamStart_command;
+
+int streamStart_function(){
+    if(streamStart_argtable.arg_help->count == 1){
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, streamStart_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, streamStart_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(streamStart_command.helpMsg);
+        commandLink->println("Each frame is sent as \"FRAME <sequence> <bytes> <micros>\\r\\n\", the frame bytes and \"\\r\\n\".");
+        commandLink->println("<micros> is the VSYNC of the frame, commands are served between frames and between lines.");
+        commandLink->println("Without --frames the stream runs until \"stream stop\".");
+        commandLink->println("--threads reads and sends frames from RTOS threads, loop() only serves commands, \"stats\" shows their CPU time.");
+        return COMMAND_OK;
+    }
+
+    if(captureInProgress()){
+        return COMMAND_BUSY;
+    }
+
+    int frames = (streamStart_argtable.arg_frames->count == 1) ? streamStart_argtable.arg_frames->ival[0] : 0;
+    if(frames < 0){
+        commandLink->println("Invalid --frames value, use \"stream start --help\" for more details.");
+        return COMMAND_FAILED;
+    }
+
+    if(startCamera(CAMERA_CONFIGURATION_MAXTRIES)){
+        commandLink->println("Failed to start stream.");
+        return COMMAND_FAILED;
+    }
+    bool threaded = (streamStart_argtable.arg_threads->count == 1);
+    if(threaded ? startStreamThreads(frames) : startStream(frames)){
+        commandLink->println("Failed to start stream.");
+        return COMMAND_FAILED;
+    }
+
+    postEvent(EVENT_CAPTURE, micros(), "start stream");
+    commandLink->println("Stream started.");
+    return COMMAND_OK;
+}
+
+struct {
+    struct arg_rex* arg_cmd;
+    struct arg_rex* arg_action;
+    struct arg_lit* arg_help;
+    struct arg_end* arg_end;
+} streamStop_argtable;
+command_struct streamStop_command;
+
+int streamStop_function(){
+    if(streamStop_argtable.arg_help->count == 1){
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, streamStop_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, streamStop_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(streamStop_command.helpMsg);
+        return COMMAND_OK;
+    }
+
+    if(!streamRunning()){
+        commandLink->println("No stream running.");
+        return COMMAND_FAILED;
+    }
+
+    stopCapture();
+    postEvent(EVENT_CAPTURE, micros(), "end %lu", (unsigned long) stream.framesSent);
+    commandLink->print("Stream stopped after ");
+    commandLink->print(stream.framesSent.load());
+    commandLink->println(" frames.");
+    return COMMAND_OK;
+}
+
+struct {
+    struct arg_rex* arg_cmd;
+    struct arg_lit* arg_help;
+    struct arg_end* arg_end;
+} stats_argtable;
+command_struct stats_command;
+
+// CPU time of each thread since the stream started, its share of that time, and the capture to transmit queue.
+void printThreadStats(){
+    uint32_t elapsed = micros() - threads.startMicros + 1;
+    for(uint8_t index = 0; index < THREADS; index++){
+        threadStatistics* thread = &threads.stats[index];
+        commandLink->print("\tThread ");
+        commandLink->print(threadNames[index]);
+        commandLink->print(": ");
+        commandLink->print((uint32_t) (thread->busyMicros / 1000));
+        commandLink->print(" ms CPU (");
+        commandLink->print((uint32_t) (thread->busyMicros * 100 / elapsed));
+        commandLink->print("%)");
+        if(thread->linkMicros != 0){
+            commandLink->print(", ");
+            commandLink->print((uint32_t) (thread->linkMicros / 1000));
+            commandLink->print(" ms writing to the link");
+        }
+        commandLink->print(", ");
+        commandLink->print(thread->sleeps);
+        commandLink->print(" sleeps.\n");
+    }
+    commandLink->print("\tQueue: ");
+    commandLink->print(threads.filled.size());
+    commandLink->print("/");
+    commandLink->print(STREAM_SLOTS);
+    commandLink->print(" slots, mean ");
+    commandLink->print((threads.queue.pushes != 0) ? (double) threads.queue.occupancySum / threads.queue.pushes : 0.0);
+    commandLink->print(", peak ");
+    commandLink->print(threads.queue.peak);
+    commandLink->print(", ");
+    commandLink->print(threads.queue.pushes);
+    commandLink->print(" queued, ");
+    commandLink->print(threads.queue.freeWaits);
+    commandLink->print(" waits for a free slot.\n");
+}
+
+int stats_function(){
+    if(stats_argtable.arg_help->count == 1){
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, stats_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, stats_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(stats_command.helpMsg);
+        commandLink->println("A frame is dropped when loop() comes back after one of its lines started, the next frame is read instead.");
+        commandLink->println("Serial output leaves in whole 64 byte USB packets, a short one only ends a command, a frame record or a loop() pass.");
+        return COMMAND_OK;
+    }
+
+    commandLink->print("Capture statistics:\n\tState: ");
+    switch(capture.state){
+        case CAPTURE_WAIT_VSYNC:
+        case CAPTURE_WAIT_FRAME:
+            commandLink->print("waiting for VSYNC.\n");
+        break;
+
+        case CAPTURE_LINES:
+            commandLink->print("reading line ");
+            commandLink->print(capture.row);
+            commandLink->print("/");
+            commandLink->print(capture.height);
+            commandLink->print(".\n");
+        break;
+
+        default:
+            commandLink->print("idle.\n");
+        break;
+    }
+    commandLink->print("\tFrames: ");
+    commandLink->print(captureStats.framesCaptured);
+    commandLink->print(" captured, ");
+    commandLink->print(captureStats.framesDropped);
+    commandLink->print(" dropped, ");
+    commandLink->print(captureStats.framesFailed);
+    commandLink->print(" failed.\n\tLines: ");
+    commandLink->print(captureStats.lines);
+    commandLink->print(".\n\tSteps: ");
+    commandLink->print(captureStats.steps);
+    commandLink->print(", longest ");
+    commandLink->print(captureStats.longestStepMicros);
+    commandLink->print(" us.\n\tLast frame readout: ");
+    commandLink->print(captureStats.lastFrameMicros);
+    commandLink->print(" us.\n\tStream: ");
+    if(streamRunning()){
+        uint32_t now = millis();
+        uint32_t bytes = stream.bytesSent - stream.reportedBytes;
+        uint32_t remaining = stream.remaining;
+        commandLink->print(stream.framesSent.load());
+        commandLink->print(" frames sent");
+        if(remaining != 0){
+            commandLink->print(", ");
+            commandLink->print(remaining);
+            commandLink->print(" left to read");
+        }
+        commandLink->print(", ");
+        commandLink->print(stream.framesTorn.load());
+        commandLink->print(" torn, ");
+        commandLink->print(stream.overruns.load());
+        commandLink->print(" overruns, ");
+        commandLink->print((uint32_t) ((uint64_t) bytes * 1000 / (now - stream.reportedMillis + 1)));
+        commandLink->print(" bytes/s.\n\tBuffers: ");
+        stream.reportedMillis = now;
+        stream.reportedBytes += bytes;
+        commandLink->print(STREAM_SLOTS);
+        commandLink->print(" x ");
+        commandLink->print(stream.slotBytes);
+        commandLink->print(stream.bands ? " bytes (bands of " : " bytes (whole frames).\n");
+        if(stream.bands){
+            commandLink->print(STREAM_BAND_ROWS);
+            commandLink->print(" rows).\n");
+        }
+        if(captureOwner == CAPTURE_FOR_THREADS){
+            printThreadStats();
+        }
+    }
+    else{
+        commandLink->print("stopped.\n");
+    }
+    printAutoConfigStats();
+    printChunkTransferStats();
+    printSerialStats();
+    printBleStats();
+    return COMMAND_OK;
+}
+
+struct {
+    struct arg_rex* arg_cmd;
+    struct arg_lit* arg_help;
+    struct arg_end* arg_end;
+} mem_argtable;
+command_struct mem_command;
+
+int mem_function(){
+    if(mem_argtable.arg_help->count == 1){
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, mem_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, mem_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(mem_command.helpMsg);
+        commandLink->println("The largest free block is found by trying allocations, fragmentation is the part of the free heap it leaves out.");
+        commandLink->println("A resolution and format fits when its frame fits in the largest free block or in the buffers freed to make room for it.");
+        return COMMAND_OK;
     }
+    printMemory();
+    return COMMAND_OK;
+}
+
+struct {
+    struct arg_rex* arg_cmd;
+    struct arg_rex* arg_action;
+    struct arg_int* arg_chunk;
+    struct arg_lit* arg_help;
+    struct arg_end* arg_end;
+} transferAck_argtable;
+command_struct transferAck_command;
+
+// Sent for every chunk the host takes, it answers only when the transfer ends or the value is wrong.
+int transferAck_function(){
+    if(transferAck_argtable.arg_help->count == 1){
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, transferAck_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, transferAck_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(transferAck_command.helpMsg);
+        commandLink->println("The window of \"takePhoto --chunked\" moves past <chunk>, acknowledging the last chunk ends the transfer.");
+        return COMMAND_OK;
+    }
+
+    int chunk = transferAck_argtable.arg_chunk->ival[0];
+    if(transferAck_argtable.arg_chunk->count == 0 || chunk < 0 || chunk > UINT16_MAX || chunkTransferAck(chunk)){
+        commandLink->println("Invalid transfer ack, no transfer running or chunk not sent yet.");
+        return COMMAND_FAILED;
+    }
+    return COMMAND_OK;
+}
 
+struct {
+    struct arg_rex* arg_cmd;
+    struct arg_rex* arg_action;
+    struct arg_int* arg_chunk;
+    struct arg_lit* arg_help;
+    struct arg_end* arg_end;
+} transferNack_argtable;
+command_struct transferNack_command;
 
-    if(takePhoto(&frameBuffer, &frameBufferSize)){
-        Serial.println("Failed to take photo.");
-        return;
+int transferNack_function(){
+    if(transferNack_argtable.arg_help->count == 1){
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, transferNack_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, transferNack_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(transferNack_command.helpMsg);
+        commandLink->println("For a chunk that failed its CRC or never came, it goes out before the chunks not sent yet.");
+        return COMMAND_OK;
     }
 
-    Serial.write(frameBuffer, frameBufferSize);
-    Serial.print("\r\n");
+    int chunk = transferNack_argtable.arg_chunk->ival[0];
+    if(transferNack_argtable.arg_chunk->count == 0 || chunk < 0 || chunk > UINT16_MAX || chunkTransferNack(chunk)){
+        commandLink->println("Invalid transfer nack, no transfer running or chunk not sent yet.");
+        return COMMAND_FAILED;
+    }
+    return COMMAND_OK;
+}
+
+struct {
+    struct arg_rex* arg_cmd;
+    struct arg_rex* arg_action;
+    struct arg_lit* arg_help;
+    struct arg_end* arg_end;
+} transferAbort_argtable;
+command_struct transferAbort_command;
+
+int transferAbort_function(){
+    if(transferAbort_argtable.arg_help->count == 1){
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, transferAbort_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, transferAbort_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(transferAbort_command.helpMsg);
+        return COMMAND_OK;
+    }
+
+    if(!chunkTransferActive()){
+        commandLink->println("No transfer running.");
+        return COMMAND_FAILED;
+    }
+    chunkTransferEnd();
+    commandLink->println("Transfer aborted.");
+    return COMMAND_OK;
+}
+
+struct {
+    struct arg_rex* arg_cmd;
+    struct arg_int* arg_bytes;
+    struct arg_int* arg_chunk;
+    struct arg_lit* arg_help;
+    struct arg_end* arg_end;
+} benchLink_argtable;
+command_struct benchLink_command;
+
+int benchLink_function(){
+    if(benchLink_argtable.arg_help->count == 1){
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, benchLink_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, benchLink_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(benchLink_command.helpMsg);
+        commandLink->println("Each run is \"BENCH <run> <bytes> <chunk> <crc32>\\r\\n\", the pattern and \"\\r\\n\" on the link photos go to, then its result.");
+        commandLink->println("Byte i of the pattern is i ^ (i >> 8) ^ (i >> 16), tools/linkBench.py checks it and measures the arrival side.");
+        commandLink->println("Without --chunk the writes go from 64 bytes to 4096, doubling. The fastest run of each link is kept for later use.");
+        return COMMAND_OK;
+    }
+
+    if(captureInProgress()){
+        return COMMAND_BUSY;
+    }
+
+    int bytes = (benchLink_argtable.arg_bytes->count == 1) ? benchLink_argtable.arg_bytes->ival[0] : LINK_BENCH_DEFAULT_BYTES;
+    int chunk = (benchLink_argtable.arg_chunk->count == 1) ? benchLink_argtable.arg_chunk->ival[0] : 0;
+    if(bytes < 1 || bytes > LINK_BENCH_MAX_BYTES || (chunk != 0 && (chunk < LINK_BENCH_MIN_CHUNK || chunk > LINK_BENCH_MAX_CHUNK))){
+        commandLink->println("Invalid --bytes or --chunk value, use \"benchLink --help\" for more details.");
+        return COMMAND_FAILED;
+    }
+
+    int failed = 0;
+    if(chunk != 0){
+        failed = runLinkBench(bytes, chunk);
+    }
+    else{
+        for(chunk = LINK_BENCH_SWEEP_FIRST; chunk <= LINK_BENCH_MAX_CHUNK && !failed; chunk *= 2){
+            failed = runLinkBench(bytes, chunk);
+        }
+    }
+    printLinkBenchResult(commandLink->frames());
+    return failed ? COMMAND_FAILED : COMMAND_OK;
+}
+
+struct {
+    struct arg_rex* arg_cmd;
+    struct arg_int* arg_fps;
+    struct arg_int* arg_minRes;
+    struct arg_lit* arg_off;
+    struct arg_lit* arg_help;
+    struct arg_end* arg_end;
+} autoConfig_argtable;
+command_struct autoConfig_command;
+
+int autoConfig_function(){
+    if(autoConfig_argtable.arg_help->count == 1){
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, autoConfig_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, autoConfig_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(autoConfig_command.helpMsg);
+        commandLink->println("The resolution, format and readout scale with the most pixels whose frames the link carries at <fps> are applied.");
+        commandLink->println("The link throughput is the one \"benchLink\" kept, 90% of it is planned for. Colour goes before GRAYSCALE at the same size.");
+        commandLink->println("<resolution> takes the values of setResolution, smaller frames are not chosen, QQVGA by default.");
+        commandLink->println("While a stream runs, a frame rate 15% below <fps> with torn frames steps down to what the link carried, frames the");
+        commandLink->println("capture dropped run the sensor faster, up to twice <fps>. After 5 windows on target the budget is raised back towards the link.");
+        commandLink->println("A \"MODE <width> <height> <format> <fps>\" record comes before the first frame of new settings.");
+        commandLink->println("setResolution, setFormat, setFPS and \"profile use\" turn it off.");
+        return COMMAND_OK;
+    }
+
+    if(autoConfig_argtable.arg_off->count == 1){
+        if(!autoConfig.active){
+            commandLink->println("autoConfig is not on.");
+            return COMMAND_FAILED;
+        }
+        autoConfig.active = false;
+        commandLink->println("autoConfig turned off, the camera keeps its current settings.");
+        return COMMAND_OK;
+    }
+
+    if(autoConfig_argtable.arg_fps->count == 0){
+        commandLink->println("Missing --fps value, use \"autoConfig --help\" for more details.");
+        return COMMAND_FAILED;
+    }
+
+    if(captureInProgress()){
+        return COMMAND_BUSY;
+    }
+
+    int fps = autoConfig_argtable.arg_fps->ival[0];
+    int minResolution = (autoConfig_argtable.arg_minRes->count == 1) ? autoConfig_argtable.arg_minRes->ival[0] : QQVGA;
+    if(fps < 1 || fps > CAMERA_MAX_FPS || minResolution < 0 || minResolution > QQVGA){
+        commandLink->println("Invalid --fps or --min-res value, use \"autoConfig --help\" for more details.");
+        return COMMAND_FAILED;
+    }
+
+    transport* link = commandLink->frames();
+    linkBenchResult* measured = linkBenchFor(link);
+    if(measured == NULL){
+        commandLink->print("No throughput measured for the ");
+        commandLink->print(link->name());
+        commandLink->println(" link, run \"benchLink\" first.");
+        return COMMAND_FAILED;
+    }
+
+    autoConfigChoice choice;
+    if(autoConfigChoose(fps, minResolution, measured->bytesPerSecond, &choice)){
+        commandLink->print("No settings reach ");
+        commandLink->print(fps);
+        commandLink->print(" fps over ");
+        commandLink->print(measured->bytesPerSecond);
+        commandLink->println(" bytes/s, lower --fps or --min-res.");
+        return COMMAND_FAILED;
+    }
+
+    if(applyAutoConfig(&choice, CAMERA_CONFIGURATION_MAXTRIES, true) != 0){
+        commandLink->println("Unexpected error, check syntax with the flag \"--help\" and try again.");
+        return COMMAND_FAILED;
+    }
+    startAutoConfig(fps, minResolution, link, measured->bytesPerSecond, &choice);
+
+    commandLink->print("autoConfig: ");
+    printAutoConfigChoice(&choice);
+    commandLink->print(" of ");
+    commandLink->print(measured->bytesPerSecond);
+    commandLink->println(" measured.");
+    commandLink->println("Camera settings applied correctly.");
+    return COMMAND_OK;
+}
+
+struct {
+    struct arg_rex* arg_cmd;
+    struct arg_rex* arg_action;
+    struct arg_lit* arg_help;
+    struct arg_end* arg_end;
+} modeMachine_argtable;
+command_struct modeMachine_command;
+
+int modeMachine_function(){
+    if(modeMachine_argtable.arg_help->count == 1){
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, modeMachine_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, modeMachine_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(modeMachine_command.helpMsg);
+        commandLink->println("Every command then answers with \"R <id> <status> <micros> <payload bytes>\\r\\n\", 25 bytes, and the payload:");
+        commandLink->println("<id> is the command's place in \"help\" from 00 (99 for no command), <status> 0 ok, 1 failed, 2 camera busy,");
+        commandLink->println("3 unknown command, <micros> the time the command took. Queries send their output, failures their message.");
+        return COMMAND_OK;
+    }
+
+    outputMode = OUTPUT_MACHINE;
+    return COMMAND_OK;
+}
+
+struct {
+    struct arg_rex* arg_cmd;
+    struct arg_rex* arg_action;
+    struct arg_lit* arg_help;
+    struct arg_end* arg_end;
+} modeHuman_argtable;
+command_struct modeHuman_command;
+
+int modeHuman_function(){
+    if(modeHuman_argtable.arg_help->count == 1){
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, modeHuman_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, modeHuman_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(modeHuman_command.helpMsg);
+        return COMMAND_OK;
+    }
+
+    outputMode = OUTPUT_HUMAN;
+    return COMMAND_OK;
+}
+
+struct {
+    struct arg_rex* arg_cmd;
+    struct arg_str* arg_classes;
+    struct arg_lit* arg_help;
+    struct arg_end* arg_end;
+} events_argtable;
+command_struct events_command;
+
+int events_function(){
+    if(events_argtable.arg_help->count == 1){
+        commandLink->println("Usage: ");
+        arg_print_syntax_custom(commandLink, events_command.argtable, "\n");
+        arg_print_glossary_custom(commandLink, events_command.argtable,"      %-20s %s\n");
+        commandLink->println("\nDetails: ");
+        commandLink->println(events_command.helpMsg);
+        commandLink->println("Without a class shows the classes subscribed to. The records go to the frame link, between frames:");
+        commandLink->println("capture: \"EVENT start <photo|stream> <micros>\\r\\n\" and \"EVENT end <frames> <micros>\\r\\n\",");
+        commandLink->println("frame: \"EVENT frame <sequence> <bytes> <micros>\\r\\n\" once a frame was read, before its bytes,");
+        commandLink->println("error: \"EVENT error <timeout|memory|abandoned> <micros>\\r\\n\".");
+        return COMMAND_OK;
+    }
+
+    if(events_argtable.arg_classes->count > 0){
+        uint8_t classes = 0;
+        for(int index = 0; index < events_argtable.arg_classes->count; index++){
+            const char* name = events_argtable.arg_classes->sval[index];
+            uint8_t eventClass = 0;
+            for(uint8_t classIndex = 0; classIndex < EVENT_CLASSES; classIndex++){
+                if(strcmp(name, eventClassNames[classIndex]) == 0){
+                    eventClass = 1 << classIndex;
+                }
+            }
+            if(strcmp(name, "all") == 0){
+                eventClass = EVENT_ALL;
+            }
+            if(eventClass == 0 && strcmp(name, "none") != 0){
+                commandLink->println("Invalid <class> value, use \"events --help\" for more details.");
+                return COMMAND_FAILED;
+            }
+            classes |= eventClass;
+        }
+        events.link = commandLink->frames();
+        events.classes = classes;
+    }
+
+    commandLink->print("Events: ");
+    printEventClasses();
+    if(events.link != NULL){
+        commandLink->print(" on ");
+        commandLink->print(events.link->name());
+    }
+    commandLink->print(", ");
+    commandLink->print(events.sent);
+    commandLink->print(" sent, ");
+    commandLink->print(events.dropped);
+    commandLink->println(" dropped.");
+    return COMMAND_OK;
 }
 
 int setupCommands(){
     commandList = (command_struct**) malloc(COMMANDS * sizeof(command_struct*));
+    bootTraceMark("commandList");
 
     help_argtable.arg_cmd = arg_rex1(NULL, NULL, "help", NULL, REG_ICASE, NULL);
     help_argtable.arg_end = arg_end(1);
     help_command_struct.argtable = (void**) &help_argtable;
     help_command_struct.helpMsg = "Shows a list of commands.";
     help_command_struct.function = &help_function;
+    help_command_struct.payload = true;
     commandList[0] = &help_command_struct;
+    bootTraceStep("help");
 
     setResolution_argtable.arg_cmd = arg_rex1(NULL, NULL, "setResolution", NULL, REG_ICASE, NULL);
     setResolution_argtable.arg_int = arg_int0(NULL, NULL, "<resolution>", "Camera resolution");
@@ -203,6 +1128,7 @@ int setupCommands(){
     setResolution_command.helpMsg = "Sets the camera resolution.";
     setResolution_command.function = &setResolution_function;
     commandList[1] = &setResolution_command;
+    bootTraceStep("setResolution");
     
     setFormat_argtable.arg_cmd = arg_rex1(NULL, NULL, "setFormat", NULL, REG_ICASE, NULL);
     setFormat_argtable.arg_int = arg_int0(NULL, NULL, "<format>", "Camera format");
@@ -212,53 +1138,288 @@ int setupCommands(){
     setFormat_command.helpMsg = "Sets the camera format.";
     setFormat_command.function = &setFormat_function;
     commandList[2] = &setFormat_command;
+    bootTraceStep("setFormat");
 
     getCameraSettings_argtable.arg_cmd = arg_rex1(NULL, NULL, "getCameraSettings", NULL, REG_ICASE, NULL);
+    getCameraSettings_argtable.arg_json = arg_lit0(NULL, "json", "As one line of JSON");
+    getCameraSettings_argtable.arg_cbor = arg_lit0(NULL, "cbor", "As a CBOR map");
     getCameraSettings_argtable.arg_help = arg_lit0(NULL, "help", "Show help");
-    getCameraSettings_argtable.arg_end = arg_end(2);
+    getCameraSettings_argtable.arg_end = arg_end(4);
     getCameraSettings_command.argtable = (void**) &getCameraSettings_argtable;
     getCameraSettings_command.helpMsg = "Shows the camera current settings.";
     getCameraSettings_command.function = &getCameraSettings_function;
+    getCameraSettings_command.payload = true;
     commandList[3] = &getCameraSettings_command;
+    bootTraceStep("getCameraSettings");
 
     takePhoto_argtable.arg_cmd = arg_rex1(NULL, NULL, "takePhoto", NULL, REG_ICASE, NULL);
+    takePhoto_argtable.arg_chunked = arg_lit0(NULL, "chunked", "Send in acknowledged chunks");
+    takePhoto_argtable.arg_chunkBytes = arg_int0(NULL, "chunk-bytes", "<n>", "Chunk size, 1024 by default");
+    takePhoto_argtable.arg_window = arg_int0(NULL, "window", "<n>", "Chunks sent ahead of the acks, 16 by default");
     takePhoto_argtable.arg_help = arg_lit0(NULL, "help", "Show help");
-    takePhoto_argtable.arg_end = arg_end(2);
+    takePhoto_argtable.arg_end = arg_end(5);
     takePhoto_command.argtable = (void**) &takePhoto_argtable;
     takePhoto_command.helpMsg = "Take a photo and send it.";
     takePhoto_command.function = &takePhoto_function;
     commandList[4] = &takePhoto_command;
+    bootTraceStep("takePhoto");
+
+    profileDefine_argtable.arg_cmd = arg_rex1(NULL, NULL, "profile", NULL, REG_ICASE, NULL);
+    profileDefine_argtable.arg_action = arg_rex1(NULL, NULL, "define", NULL, REG_ICASE, NULL);
+    profileDefine_argtable.arg_name = arg_str0(NULL, NULL, "<name>", "Profile name");
+    profileDefine_argtable.arg_res = arg_int0(NULL, "res", "<resolution>", "Camera resolution");
+    profileDefine_argtable.arg_fmt = arg_int0(NULL, "fmt", "<format>", "Camera format");
+    profileDefine_argtable.arg_fps = arg_int0(NULL, "fps", "<fps>", "Frame rate");
+    profileDefine_argtable.arg_roi = arg_str0(NULL, "roi", "<x,y,w,h>", "Region of interest");
+    profileDefine_argtable.arg_scale = arg_int0(NULL, "scale", "<n>", "Downscale factor (1-8)");
+    profileDefine_argtable.arg_help = arg_lit0(NULL, "help", "Show help");
+    profileDefine_argtable.arg_end = arg_end(8);
+    profileDefine_command.argtable = (void**) &profileDefine_argtable;
+    profileDefine_command.helpMsg = "Defines a named resolution, format and window.";
+    profileDefine_command.function = &profileDefine_function;
+    commandList[5] = &profileDefine_command;
+    bootTraceStep("profileDefine");
+
+    profileUse_argtable.arg_cmd = arg_rex1(NULL, NULL, "profile", NULL, REG_ICASE, NULL);
+    profileUse_argtable.arg_action = arg_rex1(NULL, NULL, "use", NULL, REG_ICASE, NULL);
+    profileUse_argtable.arg_name = arg_str0(NULL, NULL, "<name>", "Profile name");
+    profileUse_argtable.arg_help = arg_lit0(NULL, "help", "Show help");
+    profileUse_argtable.arg_end = arg_end(3);
+    profileUse_command.argtable = (void**) &profileUse_argtable;
+    profileUse_command.helpMsg = "Applies a profile with a single register update.";
+    profileUse_command.function = &profileUse_function;
+    commandList[6] = &profileUse_command;
+    bootTraceStep("profileUse");
+
+    profileList_argtable.arg_cmd = arg_rex1(NULL, NULL, "profile", NULL, REG_ICASE, NULL);
+    profileList_argtable.arg_action = arg_rex1(NULL, NULL, "list", NULL, REG_ICASE, NULL);
+    profileList_argtable.arg_help = arg_lit0(NULL, "help", "Show help");
+    profileList_argtable.arg_end = arg_end(2);
+    profileList_command.argtable = (void**) &profileList_argtable;
+    profileList_command.helpMsg = "Shows the defined profiles.";
+    profileList_command.function = &profileList_function;
+    profileList_command.payload = true;
+    commandList[7] = &profileList_command;
+    bootTraceStep("profileList");
+
+    setFPS_argtable.arg_cmd = arg_rex1(NULL, NULL, "setFPS", NULL, REG_ICASE, NULL);
+    setFPS_argtable.arg_int = arg_int0(NULL, NULL, "<fps>", "Frames per second");
+    setFPS_argtable.arg_help = arg_lit0(NULL, "help", "Show help");
+    setFPS_argtable.arg_end = arg_end(3);
+    setFPS_command.argtable = (void**) &setFPS_argtable;
+    setFPS_command.helpMsg = "Sets the camera frame rate.";
+    setFPS_command.function = &setFPS_function;
+    commandList[8] = &setFPS_command;
+    bootTraceStep("setFPS");
+
+    status_argtable.arg_cmd = arg_rex1(NULL, NULL, "status", NULL, REG_ICASE, NULL);
+    status_argtable.arg_help = arg_lit0(NULL, "help", "Show help");
+    status_argtable.arg_end = arg_end(2);
+    status_command.argtable = (void**) &status_argtable;
+    status_command.helpMsg = "Shows uptime and camera state.";
+    status_command.function = &status_function;
+    status_command.payload = true;
+    commandList[9] = &status_command;
+    bootTraceStep("status");
+
+    bootTrace_argtable.arg_cmd = arg_rex1(NULL, NULL, "bootTrace", NULL, REG_ICASE, NULL);
+    bootTrace_argtable.arg_help = arg_lit0(NULL, "help", "Show help");
+    bootTrace_argtable.arg_end = arg_end(2);
+    bootTrace_command.argtable = (void**) &bootTrace_argtable;
+    bootTrace_command.helpMsg = "Shows the power-on to first frame timeline.";
+    bootTrace_command.function = &bootTrace_function;
+    bootTrace_command.payload = true;
+    commandList[10] = &bootTrace_command;
+    bootTraceStep("bootTrace");
+
+    streamStart_argtable.arg_cmd = arg_rex1(NULL, NULL, "stream", NULL, REG_ICASE, NULL);
+    streamStart_argtable.arg_action = arg_rex1(NULL, NULL, "start", NULL, REG_ICASE, NULL);
+    streamStart_argtable.arg_frames = arg_int0(NULL, "frames", "<n>", "Frames to send, 0 until stopped");
+    streamStart_argtable.arg_threads = arg_lit0(NULL, "threads", "Capture and transmit threads");
+    streamStart_argtable.arg_help = arg_lit0(NULL, "help", "Show help");
+    streamStart_argtable.arg_end = arg_end(5);
+    streamStart_command.argtable = (void**) &streamStart_argtable;
+    streamStart_command.helpMsg = "Sends frames continuously while serving commands.";
+    streamStart_command.function = &streamStart_function;
+    commandList[11] = &streamStart_command;
+    bootTraceStep("streamStart");
+
+    streamStop_argtable.arg_cmd = arg_rex1(NULL, NULL, "stream", NULL, REG_ICASE, NULL);
+    streamStop_argtable.arg_action = arg_rex1(NULL, NULL, "stop", NULL, REG_ICASE, NULL);
+    streamStop_argtable.arg_help = arg_lit0(NULL, "help", "Show help");
+    streamStop_argtable.arg_end = arg_end(2);
+    streamStop_command.argtable = (void**) &streamStop_argtable;
+    streamStop_command.helpMsg = "Stops the stream, the frame being read is discarded.";
+    streamStop_command.function = &streamStop_function;
+    commandList[12] = &streamStop_command;
+    bootTraceStep("streamStop");
+
+    stats_argtable.arg_cmd = arg_rex1(NULL, NULL, "stats", NULL, REG_ICASE, NULL);
+    stats_argtable.arg_help = arg_lit0(NULL, "help", "Show help");
+    stats_argtable.arg_end = arg_end(2);
+    stats_command.argtable = (void**) &stats_argtable;
+    stats_command.helpMsg = "Shows capture engine counters.";
+    stats_command.function = &stats_function;
+    stats_command.payload = true;
+    commandList[13] = &stats_command;
+    bootTraceStep("stats");
+
+    mem_argtable.arg_cmd = arg_rex1(NULL, NULL, "mem", NULL, REG_ICASE, NULL);
+    mem_argtable.arg_help = arg_lit0(NULL, "help", "Show help");
+    mem_argtable.arg_end = arg_end(2);
+    mem_command.argtable = (void**) &mem_argtable;
+    mem_command.helpMsg = "Shows heap and stack usage and the resolutions that fit.";
+    mem_command.function = &mem_function;
+    mem_command.payload = true;
+    commandList[14] = &mem_command;
+    bootTraceStep("mem");
+
+    transferAck_argtable.arg_cmd = arg_rex1(NULL, NULL, "transfer", NULL, REG_ICASE, NULL);
+    transferAck_argtable.arg_action = arg_rex1(NULL, NULL, "ack", NULL, REG_ICASE, NULL);
+    transferAck_argtable.arg_chunk = arg_int0(NULL, NULL, "<chunk>", "Chunks received before this one");
+    transferAck_argtable.arg_help = arg_lit0(NULL, "help", "Show help");
+    transferAck_argtable.arg_end = arg_end(4);
+    transferAck_command.argtable = (void**) &transferAck_argtable;
+    transferAck_command.helpMsg = "Acknowledges the chunks of a photo transfer the host received.";
+    transferAck_command.function = &transferAck_function;
+    commandList[15] = &transferAck_command;
+    bootTraceStep("transferAck");
+
+    transferNack_argtable.arg_cmd = arg_rex1(NULL, NULL, "transfer", NULL, REG_ICASE, NULL);
+    transferNack_argtable.arg_action = arg_rex1(NULL, NULL, "nack", NULL, REG_ICASE, NULL);
+    transferNack_argtable.arg_chunk = arg_int0(NULL, NULL, "<chunk>", "Chunk to send again");
+    transferNack_argtable.arg_help = arg_lit0(NULL, "help", "Show help");
+    transferNack_argtable.arg_end = arg_end(4);
+    transferNack_command.argtable = (void**) &transferNack_argtable;
+    transferNack_command.helpMsg = "Asks for a chunk of a photo transfer again.";
+    transferNack_command.function = &transferNack_function;
+    commandList[16] = &transferNack_command;
+    bootTraceStep("transferNack");
+
+    transferAbort_argtable.arg_cmd = arg_rex1(NULL, NULL, "transfer", NULL, REG_ICASE, NULL);
+    transferAbort_argtable.arg_action = arg_rex1(NULL, NULL, "abort", NULL, REG_ICASE, NULL);
+    transferAbort_argtable.arg_help = arg_lit0(NULL, "help", "Show help");
+    transferAbort_argtable.arg_end = arg_end(2);
+    transferAbort_command.argtable = (void**) &transferAbort_argtable;
+    transferAbort_command.helpMsg = "Ends a photo transfer, the photo is not sent.";
+    transferAbort_command.function = &transferAbort_function;
+    commandList[17] = &transferAbort_command;
+    bootTraceStep("transferAbort");
+
+    benchLink_argtable.arg_cmd = arg_rex1(NULL, NULL, "benchLink", NULL, REG_ICASE, NULL);
+    benchLink_argtable.arg_bytes = arg_int0(NULL, "bytes", "<n>", "Bytes per run, 32768 by default");
+    benchLink_argtable.arg_chunk = arg_int0(NULL, "chunk", "<n>", "Bytes per write, 64 to 4096 when left out");
+    benchLink_argtable.arg_help = arg_lit0(NULL, "help", "Show help");
+    benchLink_argtable.arg_end = arg_end(4);
+    benchLink_command.argtable = (void**) &benchLink_argtable;
+    benchLink_command.helpMsg = "Measures the throughput of the link with a known pattern.";
+    benchLink_command.function = &benchLink_function;
+    benchLink_command.payload = true;
+    commandList[18] = &benchLink_command;
+    bootTraceStep("benchLink");
+
+    autoConfig_argtable.arg_cmd = arg_rex1(NULL, NULL, "autoConfig", NULL, REG_ICASE, NULL);
+    autoConfig_argtable.arg_fps = arg_int0(NULL, "fps", "<fps>", "Frame rate to reach");
+    autoConfig_argtable.arg_minRes = arg_int0(NULL, "min-res", "<resolution>", "Smallest resolution allowed");
+    autoConfig_argtable.arg_off = arg_lit0(NULL, "off", "Stop adjusting the settings");
+    autoConfig_argtable.arg_help = arg_lit0(NULL, "help", "Show help");
+    autoConfig_argtable.arg_end = arg_end(5);
+    autoConfig_command.argtable = (void**) &autoConfig_argtable;
+    autoConfig_command.helpMsg = "Picks the camera settings the link carries at a frame rate.";
+    autoConfig_command.function = &autoConfig_function;
+    commandList[19] = &autoConfig_command;
+    bootTraceStep("autoConfig");
+
+    modeMachine_argtable.arg_cmd = arg_rex1(NULL, NULL, "mode", NULL, REG_ICASE, NULL);
+    modeMachine_argtable.arg_action = arg_rex1(NULL, NULL, "machine", NULL, REG_ICASE, NULL);
+    modeMachine_argtable.arg_help = arg_lit0(NULL, "help", "Show help");
+    modeMachine_argtable.arg_end = arg_end(2);
+    modeMachine_command.argtable = (void**) &modeMachine_argtable;
+    modeMachine_command.helpMsg = "Answers every command with a fixed size status record.";
+    modeMachine_command.function = &modeMachine_function;
+    commandList[20] = &modeMachine_command;
+    bootTraceStep("modeMachine");
+
+    modeHuman_argtable.arg_cmd = arg_rex1(NULL, NULL, "mode", NULL, REG_ICASE, NULL);
+    modeHuman_argtable.arg_action = arg_rex1(NULL, NULL, "human", NULL, REG_ICASE, NULL);
+    modeHuman_argtable.arg_help = arg_lit0(NULL, "help", "Show help");
+    modeHuman_argtable.arg_end = arg_end(2);
+    modeHuman_command.argtable = (void**) &modeHuman_argtable;
+    modeHuman_command.helpMsg = "Answers the commands in prose, the default.";
+    modeHuman_command.function = &modeHuman_function;
+    commandList[21] = &modeHuman_command;
+    bootTraceStep("modeHuman");
+
+    events_argtable.arg_cmd = arg_rex1(NULL, NULL, "events", NULL, REG_ICASE, NULL);
+    events_argtable.arg_classes = arg_strn(NULL, NULL, "<class>", 0, EVENT_CLASSES + 1, "capture, frame, error, all or none");
+    events_argtable.arg_help = arg_lit0(NULL, "help", "Show help");
+    events_argtable.arg_end = arg_end(3);
+    events_command.argtable = (void**) &events_argtable;
+    events_command.helpMsg = "Subscribes to capture, frame and error notifications.";
+    events_command.function = &events_function;
+    events_command.payload = true;
+    commandList[22] = &events_command;
+    bootTraceStep("events");
 
     bool failedCommand = false;
     for(size_t commandIndex = 0; commandIndex < COMMANDS; commandIndex++){
         while(true){
-            Serial.print("Command ");
-            Serial.print(commandIndex + 1);
-            Serial.print("/");
-            Serial.print(COMMANDS);
+            commandLink->print("Command ");
+            commandLink->print(commandIndex + 1);
+            commandLink->print("/");
+            commandLink->print(COMMANDS);
             if(arg_nullcheck(commandList[commandIndex]->argtable) == 0){
-                Serial.println(" registered succesfully.");
+                commandLink->println(" registered succesfully.");
                 break;
             }
             else{
-                Serial.println(" failed register.");
+                commandLink->println(" failed register.");
             }
             delay(500);
         }
     }
 
+    bootTraceMark("setupCommands");
     return (failedCommand) ? 1 : 0;
 }
 
+// In machine mode the command prints to machineLink, which stays in place afterwards and drops the prose of the
+// stream and the transfers. A record answers "mode machine" as well as any command run in machine mode.
 void executeCommands(int argc, char** argv){
+    transport* link = commandLink;
+    bool machine = (outputMode == OUTPUT_MACHINE);
+    if(machine){
+        machineLink.attach(link, true);
+        commandLink = &machineLink;
+    }
+    uint32_t start = micros();
+    uint8_t id = COMMAND_ID_UNKNOWN;
+    int status = COMMAND_UNKNOWN;
     for(size_t commandIndex = 0; commandIndex < COMMANDS; commandIndex++){
         commandList[commandIndex]->parseErrors = arg_parse(argc, argv, commandList[commandIndex]->argtable);
         if(commandList[commandIndex]->parseErrors == 0){
-            commandList[commandIndex]->function();
-            return;
+            if(firstCommandMillis == 0){
+                firstCommandMillis = millis();
+                bootTraceMark("firstCommand");
+            }
+            id = commandIndex;
+            status = commandList[commandIndex]->function();
+            break;
         }
     }
 
-    Serial.println("Invalid command, use the command \"help\" to get a list of commands.");
+    if(status == COMMAND_UNKNOWN){
+        commandLink->println("Invalid command, use the command \"help\" to get a list of commands.");
+    }
+    uint32_t elapsed = micros() - start;
+    if(machine || outputMode == OUTPUT_MACHINE){
+        bool payload = machine && (status != COMMAND_OK || commandList[id]->payload);
+        sendCommandRecord(link, id, status, elapsed, payload);
+    }
+    commandLink = link;
+    if(outputMode == OUTPUT_MACHINE){
+        machineLink.attach(link, false);
+        commandLink = &machineLink;
+    }
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,110 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <Arduino.h>
+#include <mbed.h>
+#include <stdarg.h>
+#include <transport.h>
+
+#define EVENT_CAPTURE 0x01          // "start" and "end" of a photo or stream.
+#define EVENT_FRAME 0x02            // "frame": a frame was read, sent ahead of its bytes.
+#define EVENT_ERROR 0x04            // "error": no frame from the camera, no memory for it, a transfer abandoned.
+#define EVENT_ALL (EVENT_CAPTURE | EVENT_FRAME | EVENT_ERROR)
+#define EVENT_CLASSES 3
+#define EVENT_QUEUE 8               // Events waiting for the end of the frame being sent, more are dropped.
+#define EVENT_RECORD_BYTES 48
+#define EVENT_SUFFIX_BYTES 13       // " <micros>\r\n" with the longest micros, kept free of the fields.
+
+// "events <class>...": the device sends, unasked, one record per event of the classes subscribed to, to the frame
+// link of the link that subscribed:
+//     EVENT start <photo|stream> <micros>\r\n
+//     EVENT frame <sequence> <bytes> <micros>\r\n     micros of the frame's VSYNC, as in the FRAME record
+//     EVENT end <frames> <micros>\r\n
+//     EVENT error <timeout|memory|abandoned> <micros>\r\n
+// A record never splits a frame: while a stream sends one, the events wait and go out before the next FRAME record.
+typedef struct{
+    uint8_t classes;
+    transport* link;
+    char queue[EVENT_QUEUE][EVENT_RECORD_BYTES];
+    uint8_t queued;
+    uint32_t photos;        // Sequence of the next photo.
+    uint32_t sent;
+    uint32_t dropped;
+    rtos::Mutex mutex;      // The capture thread posts too.
+} eventChannel;
+
+eventChannel events;
+const char* eventClassNames[EVENT_CLASSES] = {"capture", "frame", "error"}; // EVENT_CAPTURE, EVENT_FRAME and EVENT_ERROR.
+
+bool eventsHeld();          // src/stream.h
+
+// Sends the queued events, called where no frame is part way out on the link.
+void sendEvents(){
+    char records[EVENT_QUEUE][EVENT_RECORD_BYTES];
+    transportSegment segments[EVENT_QUEUE];
+    events.mutex.lock();
+    uint8_t count = events.queued;
+    for(uint8_t index = 0; index < count; index++){
+        memcpy(records[index], events.queue[index], EVENT_RECORD_BYTES);
+        segments[index] = {records[index], strlen(records[index])};
+    }
+    events.queued = 0;
+    events.mutex.unlock();
+    if(count == 0 || events.link == NULL){
+        return;
+    }
+    events.link->writev(segments, count);
+    events.link->flush();
+    events.sent += count;
+}
+
+// From loop(): what a stream held back once its frame is out.
+void serviceEvents(){
+    if(events.queued != 0 && !eventsHeld()){
+        sendEvents();
+    }
+}
+
+// "EVENT <name> <fields> <micros>\r\n", sent at once unless a frame is being sent.
+void postEvent(uint8_t eventClass, uint32_t eventMicros, const char* format, ...){
+    if((events.classes & eventClass) == 0){
+        return;
+    }
+    events.mutex.lock();
+    if(events.queued == EVENT_QUEUE){
+        events.dropped++;
+        events.mutex.unlock();
+        return;
+    }
+    char* record = events.queue[events.queued];
+    size_t length = snprintf(record, EVENT_RECORD_BYTES, "EVENT ");
+    va_list arguments;
+    va_start(arguments, format);
+    size_t fieldBytes = EVENT_RECORD_BYTES - EVENT_SUFFIX_BYTES;
+    length += vsnprintf(record + length, fieldBytes - length, format, arguments);
+    va_end(arguments);
+    // Fields that did not fit are cut, the record still ends in its micros and "\r\n".
+    if(length >= fieldBytes){
+        length = fieldBytes - 1;
+    }
+    snprintf(record + length, EVENT_RECORD_BYTES - length, " %lu\r\n", (unsigned long) eventMicros);
+    events.queued++;
+    events.mutex.unlock();
+    serviceEvents();
+}
+
+void printEventClasses(){
+    if(events.classes == 0){
+        commandLink->print("none");
+    }
+    bool first = true;
+    for(uint8_t index = 0; index < EVENT_CLASSES; index++){
+        if(events.classes & (1 << index)){
+            commandLink->print(first ? "" : " ");
+            commandLink->print(eventClassNames[index]);
+            first = false;
+        }
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,156 @@
+#ifndef LINKBENCH_H
+#define LINKBENCH_H
+
+#include <Arduino.h>
+#include <transport.h>
+#include <chunkTransfer.h>
+
+#define LINK_BENCH_DEFAULT_BYTES 32768
+#define LINK_BENCH_MAX_BYTES 1048576
+#define LINK_BENCH_MIN_CHUNK 16
+#define LINK_BENCH_MAX_CHUNK 4096
+#define LINK_BENCH_SWEEP_FIRST 64   // Without --chunk the writes go from one USB packet up to LINK_BENCH_MAX_CHUNK, doubling.
+#define LINK_BENCH_LINKS 2          // Links a result is kept for, serial and BLE.
+
+// "benchLink": a pattern of known CRC-32 written to the frame link in writes of a given size, timed on the device.
+// Every run is "BENCH <run> <bytes> <chunk> <crc32>\r\n", the pattern and "\r\n", then a result line on the command
+// link. The best run of each link is kept for the modes that pick a resolution and rate by the link's throughput.
+typedef struct{
+    transport* link;
+    uint32_t bytesPerSecond;
+    uint16_t chunkBytes;
+    uint32_t jitterMicros;      // Standard deviation of the time a write took.
+    uint32_t measuredMillis;
+} linkBenchResult;
+
+linkBenchResult linkBenchResults[LINK_BENCH_LINKS];
+uint16_t linkBenchRuns = 0;
+
+// Byte <index> of the pattern, tools/linkBench.py generates the same one.
+inline byte linkBenchPattern(uint32_t index){
+    return (byte) (index ^ (index >> 8) ^ (index >> 16));
+}
+
+// The kept result of a link, NULL before its first "benchLink".
+linkBenchResult* linkBenchFor(transport* link){
+    for(uint8_t index = 0; index < LINK_BENCH_LINKS; index++){
+        if(linkBenchResults[index].link == link){
+            return &linkBenchResults[index];
+        }
+    }
+    return NULL;
+}
+
+// A faster run replaces the kept one, as does a new run with the same writes, the link may have slowed down since.
+void linkBenchKeep(transport* link, uint32_t bytesPerSecond, uint16_t chunkBytes, uint32_t jitterMicros){
+    linkBenchResult* result = linkBenchFor(link);
+    if(result == NULL){
+        result = linkBenchFor(NULL);
+        if(result == NULL){
+            return;
+        }
+        result->link = link;
+        result->bytesPerSecond = 0;
+    }
+    if(bytesPerSecond > result->bytesPerSecond || chunkBytes == result->chunkBytes){
+        result->bytesPerSecond = bytesPerSecond;
+        result->chunkBytes = chunkBytes;
+        result->jitterMicros = jitterMicros;
+        result->measuredMillis = millis();
+    }
+}
+
+// One run, the writes block as long as the link takes to accept them.
+int runLinkBench(uint32_t bytes, uint16_t chunkBytes){
+    byte* chunk = (byte*) malloc(chunkBytes);
+    if(chunk == NULL){
+        commandLink->println("No enough memory for the benchmark writes, try a smaller --chunk.");
+        return 1;
+    }
+    uint32_t crc = 0;
+    for(uint32_t offset = 0; offset < bytes; offset += chunkBytes){
+        uint16_t size = (bytes - offset < chunkBytes) ? bytes - offset : chunkBytes;
+        for(uint16_t index = 0; index < size; index++){
+            chunk[index] = linkBenchPattern(offset + index);
+        }
+        crc = crc32Update(crc, chunk, size);
+    }
+
+    transport* link = commandLink->frames();
+    link->print("BENCH ");
+    link->print(++linkBenchRuns);
+    link->print(" ");
+    link->print(bytes);
+    link->print(" ");
+    link->print(chunkBytes);
+    link->print(" ");
+    link->print(crc, HEX);
+    link->print("\r\n");
+    link->flush();
+
+    uint32_t writes = 0;
+    double sum = 0;
+    double squares = 0;
+    uint32_t longest = 0;
+    uint32_t start = micros();
+    for(uint32_t offset = 0; offset < bytes; offset += chunkBytes){
+        uint16_t size = (bytes - offset < chunkBytes) ? bytes - offset : chunkBytes;
+        for(uint16_t index = 0; index < size; index++){
+            chunk[index] = linkBenchPattern(offset + index);
+        }
+        uint32_t writeStart = micros();
+        link->write(chunk, size);
+        uint32_t took = micros() - writeStart;
+        writes++;
+        sum += took;
+        squares += (double) took * took;
+        longest = (took > longest) ? took : longest;
+    }
+    link->print("\r\n");
+    link->flush();
+    uint32_t elapsed = micros() - start;
+    free(chunk);
+
+    double mean = sum / writes;
+    double variance = squares / writes - mean * mean;
+    uint32_t jitter = (variance > 0) ? (uint32_t) sqrt(variance) : 0;
+    uint32_t bytesPerSecond = (elapsed != 0) ? (uint32_t) ((uint64_t) bytes * 1000000 / elapsed) : 0;
+    linkBenchKeep(link, bytesPerSecond, chunkBytes, jitter);
+
+    commandLink->print("Link ");
+    commandLink->print(link->name());
+    commandLink->print(": ");
+    commandLink->print(writes);
+    commandLink->print(" writes of ");
+    commandLink->print(chunkBytes);
+    commandLink->print(" bytes in ");
+    commandLink->print(elapsed);
+    commandLink->print(" us, ");
+    commandLink->print(bytesPerSecond);
+    commandLink->print(" bytes/s, write ");
+    commandLink->print((uint32_t) mean);
+    commandLink->print(" us mean, jitter ");
+    commandLink->print(jitter);
+    commandLink->print(" us, longest ");
+    commandLink->print(longest);
+    commandLink->println(" us.");
+    return 0;
+}
+
+void printLinkBenchResult(transport* link){
+    linkBenchResult* result = linkBenchFor(link);
+    if(result == NULL){
+        return;
+    }
+    commandLink->print("Kept for ");
+    commandLink->print(link->name());
+    commandLink->print(": ");
+    commandLink->print(result->bytesPerSecond);
+    commandLink->print(" bytes/s with ");
+    commandLink->print(result->chunkBytes);
+    commandLink->print(" byte writes, jitter ");
+    commandLink->print(result->jitterMicros);
+    commandLink->println(" us.");
+}
+
+#endif
\ No newline at end of file
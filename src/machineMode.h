@@ -0,0 +1,71 @@
+#ifndef MACHINEMODE_H
+#define MACHINEMODE_H
+
+#include <Arduino.h>
+#include <transport.h>
+
+#define OUTPUT_HUMAN 0
+#define OUTPUT_MACHINE 1
+
+#define COMMAND_OK 0
+#define COMMAND_FAILED 1
+#define COMMAND_BUSY 2              // A capture or photo transfer holds the camera.
+#define COMMAND_UNKNOWN 3           // No command matched the line.
+#define COMMAND_ID_UNKNOWN 99
+
+#define MACHINE_PAYLOAD_BYTES 4096  // Output of a command kept for its record, the rest is dropped.
+#define MACHINE_RECORD_BYTES 25
+
+// "mode machine": every command answers with "R <id> <status> <micros> <payload bytes>\r\n", always 25 bytes:
+// the command's index in "help" (2 digits, 99 when none matched), its status (1 digit), the time it took in
+// microseconds (10 digits) and the bytes that follow the record (5 digits). Queries send their output as the
+// payload, failures their message, the prose of the other commands is dropped.
+uint8_t outputMode = OUTPUT_HUMAN;
+
+// Stands in for the command link in machine mode: what the commands print is kept for the record or, between
+// commands, dropped. Everything else goes to the link, so the frames of a photo or stream are not held back.
+class machineTransport : public transport{
+    public:
+        void attach(transport* link, bool keep){
+            this->link = link;
+            this->keep = keep;
+            length = 0;
+        }
+
+        using transport::write;
+        size_t write(const uint8_t* buffer, size_t size) override{
+            if(keep){
+                size_t count = (size < MACHINE_PAYLOAD_BYTES - length) ? size : MACHINE_PAYLOAD_BYTES - length;
+                memcpy(payload + length, buffer, count);
+                length += count;
+            }
+            return size;
+        }
+
+        int availableForWrite() override{ return MACHINE_PAYLOAD_BYTES - length; }
+        size_t read(byte* buffer, size_t size) override{ return link->read(buffer, size); }
+        bool connected() override{ return link->connected(); }
+        const char* name() override{ return link->name(); }
+        transport* frames() override{ return link->frames(); }
+
+        transport* link = &serialLink;
+        uint8_t payload[MACHINE_PAYLOAD_BYTES];
+        size_t length = 0;
+
+    private:
+        bool keep = false;
+};
+
+machineTransport machineLink;
+
+// The record and the payload in one write, no frame record gets between them.
+void sendCommandRecord(transport* link, uint8_t id, uint8_t status, uint32_t elapsedMicros, bool payload){
+    size_t length = payload ? machineLink.length : 0;
+    char record[2 * MACHINE_RECORD_BYTES];
+    snprintf(record, sizeof(record), "R %02u %1u %010lu %05u\r\n", id, status, (unsigned long) elapsedMicros, (unsigned) length);
+    transportSegment segments[2] = {{record, MACHINE_RECORD_BYTES}, {machineLink.payload, length}};
+    link->writev(segments, 2);
+    link->flush();
+}
+
+#endif
\ No newline at end of file
@@ -3,30 +3,67 @@
 #include <camera.h>
 #include <parser.h>
 #include <commands.h>
+#include <transport.h>
+#include <bleTransport.h>
 
 #define COMMAND_LINE_WIDTH 128
+#define SERIAL_WAIT_MS 2000       // Longest wait for the host to open the port before serving commands anyway.
+#define CAMERA_IDLE_START_MS 1000 // Idle time after which the camera is brought up ahead of its first use.
+#define CAMERA_IDLE_START_TRIES 1 // One Camera.begin() per idle bring-up, loop() is blocked while it runs (about 1 s).
+#define COMMAND_LINKS 2
 char commandLineBuffer[COMMAND_LINE_WIDTH];
+transport* commandLinks[COMMAND_LINKS] = {&serialLink, &bleLink};
 uint32_t lastAlive;
+uint32_t lastCommand;
 bool ledStatus;
 
 void setup() {
+  memoryBegin();
+  bootTraceStart();
+  bootTraceMark("setup");
   pinMode(LED_BUILTIN, OUTPUT);
   Serial.begin(115200);
-  delay(7500);
-  setupCamera(0);
+  bootTraceMark("Serial.begin");
+  while(!Serial && millis() < SERIAL_WAIT_MS);
+  bootTraceMark("serialWait");
+  arenaBegin();
   setupCommands();
+  arenaSeal();
+  if(bleLink.begin() == 0){
+    bootTraceMark("BLE.begin");
+  }
 }
 
 void loop() {
-  if(Serial.available() > 0){
-    memset(&commandLineBuffer, 0, COMMAND_LINE_WIDTH);
-    Serial.readBytesUntil('\r', commandLineBuffer, COMMAND_LINE_WIDTH);
-    if(Serial.peek() == '\n'){
-      Serial.read();
+  bool served = false;
+  for(uint8_t index = 0; index < COMMAND_LINKS; index++){
+    if(!commandLinks[index]->readLine(commandLineBuffer, COMMAND_LINE_WIDTH)){
+      continue;
     }
+    size_t length = strlen(commandLineBuffer);
+    memset(commandLineBuffer + length, 0, COMMAND_LINE_WIDTH - length);
+    commandLink = commandLinks[index];
 
+    threadBusyBegin(THREAD_COMMAND);
     argx_type argx = parseArgx(commandLineBuffer, COMMAND_LINE_WIDTH, true);
     executeCommands(argx.argc, argx.argv);
+    freeArgx(&argx);
+    arenaReset();
+    memorySample();
+    threadBusyEnd(THREAD_COMMAND);
+    lastCommand = millis();
+    served = true;
+  }
+  // Not in the background: Camera.begin() waits for the sensor inside the library and cannot be split across passes,
+  // so a command arriving meanwhile waits for it. A failed try is left to the first use, which retries.
+  if(!served && !cameraReady && !cameraStartFailed && millis() - lastCommand > CAMERA_IDLE_START_MS){
+    startCamera(CAMERA_IDLE_START_TRIES);
+  }
+  serviceCapture();
+  serviceAutoConfig(CAMERA_CONFIGURATION_MAXTRIES);
+  serviceEvents();
+  for(uint8_t index = 0; index < COMMAND_LINKS; index++){
+    commandLinks[index]->flush();
   }
   
   if(millis() > lastAlive + 1000){
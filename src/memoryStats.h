@@ -0,0 +1,183 @@
+#ifndef MEMORYSTATS_H
+#define MEMORYSTATS_H
+
+#include <Arduino.h>
+#include <malloc.h>
+#include <camera.h>
+#include <profiles.h>
+#include <bootTrace.h>
+#include <arena.h>
+#include <stream.h>
+#include <threads.h>
+
+#if defined(ARDUINO_ARCH_MBED)
+#include <mbed.h>
+#include <mbed_rtos_storage.h>
+#endif
+
+#define MEMORY_PROBE_STEP 64            // Precision of the largest free block search.
+#define MEMORY_STACK_PAINT 0xA5A5A5A5   // Written over the unused main stack at boot, the first word changed marks the deepest use.
+#define MEMORY_STACK_MARGIN 256         // Bytes under the stack pointer left unpainted for memoryBegin() itself.
+#define MEMORY_HOST_HEAP_BYTES 196608   // Heap assumed on the host, about what mbed OS and BLE leave of the 256 KB of RAM.
+#define MEMORY_HOST_STACK_BYTES 32768   // Main stack assumed on the host, the size mbed OS gives the main thread.
+
+// Heap and stack usage for the "mem" command. The heap high-water mark is sampled after every command, the one newlib
+// keeps (the sbrk() top) only grows and the largest block probe would push it to the end of the heap. The stack one is
+// exact: the unused main stack is painted at boot and the deepest word overwritten since is searched for on demand.
+typedef struct{
+    size_t heapPeak;
+    size_t heapBase;        // Host only, heap the process used before setup(), not part of the board's.
+    volatile uint32_t* stackBottom;    // Lowest address of the main thread stack.
+    volatile uint32_t* stackTop;
+} memoryStatistics;
+
+memoryStatistics memoryStats;
+
+size_t memoryHeapSize(){
+#if defined(ARDUINO_ARCH_MBED)
+    extern uint32_t mbed_heap_size;
+    return mbed_heap_size;
+#else
+    return MEMORY_HOST_HEAP_BYTES;
+#endif
+}
+
+size_t memoryHeapUsed(){
+#if defined(ARDUINO_ARCH_MBED)
+    return mallinfo().uordblks;
+#else
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd - memoryStats.heapBase; // glibc serves frame sized blocks with mmap(), outside uordblks.
+#endif
+}
+
+// Paints the main thread stack below the current frame, called first in setup(). On the host the stack is the
+// MEMORY_HOST_STACK_BYTES under setup(), well inside the one of the process.
+void memoryBegin(){
+    volatile uint32_t here = 0;
+#if defined(ARDUINO_ARCH_MBED)
+    mbed_rtos_storage_thread_t* thread = (mbed_rtos_storage_thread_t*) osThreadGetId();
+    memoryStats.stackBottom = (volatile uint32_t*) thread->stack_mem;
+    memoryStats.stackTop = (volatile uint32_t*) ((byte*) thread->stack_mem + thread->stack_size);
+#else
+    memoryStats.heapBase = memoryHeapUsed();
+    memoryStats.stackTop = &here;
+    memoryStats.stackBottom = (volatile uint32_t*) ((uintptr_t) &here - MEMORY_HOST_STACK_BYTES);
+#endif
+    volatile uint32_t* paintEnd = (volatile uint32_t*) ((uintptr_t) &here - MEMORY_STACK_MARGIN);
+    for(volatile uint32_t* word = memoryStats.stackBottom; word < paintEnd; word++){
+        *word = MEMORY_STACK_PAINT;
+    }
+    memoryStats.heapPeak = memoryHeapUsed();
+}
+
+void memorySample(){
+    size_t used = memoryHeapUsed();
+    memoryStats.heapPeak = (used > memoryStats.heapPeak) ? used : memoryStats.heapPeak;
+}
+
+// Deepest main stack use since boot, painted words still intact are the part never reached.
+size_t memoryStackPeak(){
+    volatile uint32_t* word = memoryStats.stackBottom;
+    while(word < memoryStats.stackTop && *word == MEMORY_STACK_PAINT){
+        word++;
+    }
+    return (uintptr_t) memoryStats.stackTop - (uintptr_t) word;
+}
+
+size_t memoryStackSize(){
+    return (uintptr_t) memoryStats.stackTop - (uintptr_t) memoryStats.stackBottom;
+}
+
+// Largest malloc() that succeeds now, by bisection up to the free heap.
+size_t memoryLargestFree(){
+    size_t used = memoryHeapUsed();
+    size_t low = 0;
+    size_t high = (memoryHeapSize() > used) ? memoryHeapSize() - used : 0;
+    while(high - low > MEMORY_PROBE_STEP){
+        size_t middle = low + (high - low) / 2;
+        void* block = malloc(middle);
+        if(block != NULL){
+            free(block);
+            low = middle;
+        }
+        else{
+            high = middle;
+        }
+    }
+    return low;
+}
+
+void printMemoryLine(const char* label, size_t bytes, const char* note){
+    commandLink->print("\t");
+    commandLink->print(label);
+    commandLink->print(": ");
+    commandLink->print((uint32_t) bytes);
+    commandLink->print(" bytes");
+    commandLink->print(note);
+    commandLink->print(".\n");
+}
+
+void printMemory(){
+    size_t heapSize = memoryHeapSize();
+    size_t used = memoryHeapUsed();
+    size_t heapFree = (heapSize > used) ? heapSize - used : 0;
+    size_t largest = memoryLargestFree();
+    memorySample();
+
+    commandLink->print("Memory:\n");
+    printMemoryLine("Heap", heapSize, "");
+    printMemoryLine("Heap used", used, "");
+    printMemoryLine("Heap free", heapFree, "");
+    printMemoryLine("Largest free block", largest, "");
+    commandLink->print("\tFragmentation: ");
+    commandLink->print((heapFree != 0) ? (uint32_t) (100 - largest * 100 / heapFree) : 0);
+    commandLink->print("%.\n");
+    printMemoryLine("Heap high-water", memoryStats.heapPeak, ", sampled after every command");
+    printMemoryLine("Stack high-water", memoryStackPeak(), "");
+    printMemoryLine("Stack", memoryStackSize(), "");
+
+    commandLink->print("Usage:\n");
+    printMemoryLine("Frame buffer", (frameBuffer != NULL) ? frameBufferSize : 0, "");
+    printMemoryLine("Stream slots", (stream.slots[0].data != NULL) ? STREAM_SLOTS * stream.slotBytes : 0, "");
+    printMemoryLine("Thread stacks", (captureOwner == CAPTURE_FOR_THREADS) ? 2 * THREAD_STACK_BYTES : 0, "");
+    printMemoryLine("argtable3 objects", arenaObjects.top, (arenaObjects.fallbacks != 0) ? ", some on the heap" : "");
+    printMemoryLine("argtable3 object arena", ARENA_OBJECT_BYTES, ", static");
+    printMemoryLine("Command parsing peak", arenaScratch.peak, (arenaScratch.fallbacks != 0) ? ", some on the heap" : "");
+    printMemoryLine("Command parsing arena", ARENA_SCRATCH_BYTES, ", static");
+    printMemoryLine("Profiles", sizeof(cameraProfiles), ", static");
+    printMemoryLine("Boot trace", sizeof(bootTraceEntries), ", static");
+
+    // setupFrameBuffer() and "stream start" free the current buffers first, the frame may take their place.
+    size_t available = largest;
+    size_t held = ((frameBuffer != NULL) ? frameBufferSize : 0) + ((stream.slots[0].data != NULL) ? STREAM_SLOTS * stream.slotBytes : 0);
+    available = (held > available) ? held : available;
+    static const uint8_t formats[4] = {YUV422, RGB444, RGB565, GRAYSCALE};
+    static const char* formatNames[4] = {"YUV422", "RGB444", "RGB565", "GRAYSCALE"};
+    static const char* resolutionNames[5] = {"VGA", "CIF", "QVGA", "QCIF", "QQVGA"};
+    commandLink->print("Fits now (full frames):\n");
+    for(uint8_t resolution = 0; resolution < 5; resolution++){
+        for(uint8_t format = 0; format < 4; format++){
+            size_t rowBytes = (size_t) cameraWidths[resolution] * formatBytesPerPixel(formats[format]);
+            size_t frameBytes = rowBytes * cameraHeights[resolution];
+            commandLink->print("\t");
+            commandLink->print(resolutionNames[resolution]);
+            commandLink->print(" ");
+            commandLink->print(formatNames[format]);
+            commandLink->print(": ");
+            commandLink->print((uint32_t) frameBytes);
+            commandLink->print(" bytes, photo ");
+            commandLink->print((frameBytes <= available) ? "yes" : "no");
+            commandLink->print(", stream ");
+            // The choice of setupStream(), bands only when two whole frames exceed STREAM_MEMORY_BYTES.
+            if(STREAM_SLOTS * streamSlotBytes(rowBytes, frameBytes) > available){
+                commandLink->print("no.\n");
+            }
+            else{
+                commandLink->print(streamBands(frameBytes) ? "bands.\n" : "whole frames.\n");
+            }
+        }
+    }
+}
+
+#endif
\ No newline at end of file
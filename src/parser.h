@@ -2,6 +2,7 @@
 #define PARSER_H
 
 #include <Arduino.h>
+#include <arena.h>
 
 #define SPACE ' '
 #define SIMPLE_COMMA '\''
@@ -16,7 +17,7 @@ typedef struct{
 } argx_type;
 
 argx_type parseArgx(char* command, size_t commandSize, bool foolProgramName=false){
-    char* argdata = (char*) malloc((commandSize + 1) * sizeof(char));
+    char* argdata = (char*) arenaAllocate((commandSize + 1) * sizeof(char));
     memcpy(argdata, command, commandSize);
     argdata[commandSize] = NULLCHAR;
     
@@ -35,12 +36,12 @@ argx_type parseArgx(char* command, size_t commandSize, bool foolProgramName=fals
         }
     }
     
-    char** argv = (char**) malloc(argc * sizeof(char*));
+    char** argv = (char**) arenaAllocate(argc * sizeof(char*));
     
     insideSimpleComma = false;
     insideDoubleComma = false;
     if(foolProgramName){
-        char falseProgramName = NULLCHAR;
+        static char falseProgramName = NULLCHAR;
         argv[0] = &falseProgramName;
         argv[1] = &argdata[0];
     }
@@ -69,4 +70,12 @@ argx_type parseArgx(char* command, size_t commandSize, bool foolProgramName=fals
     return output;
 }
 
+void freeArgx(argx_type* argx){
+    arenaFree(argx->argv);
+    arenaFree(argx->argdata);
+    argx->argv = NULL;
+    argx->argdata = NULL;
+    argx->argc = 0;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,78 @@
+#ifndef PROFILES_H
+#define PROFILES_H
+
+#include <Arduino.h>
+#include <camera.h>
+
+#define CAMERA_PROFILES 8
+#define CAMERA_PROFILE_NAME_LENGTH 16
+
+// Named capture setup, everything "profile use" needs is computed when the profile is defined.
+typedef struct{
+    char name[CAMERA_PROFILE_NAME_LENGTH];
+    uint8_t resolution;
+    uint8_t format;
+    uint8_t fps;
+    cameraWindow window;
+    cameraRegister registers[CAMERA_MODE_REGISTERS];
+    uint16_t frameWidth;
+    uint16_t frameHeight;
+    size_t frameSize;
+} cameraProfile;
+
+cameraProfile cameraProfiles[CAMERA_PROFILES];
+uint8_t cameraProfileCount = 0;
+
+cameraProfile* findCameraProfile(const char* name){
+    for(uint8_t index = 0; index < cameraProfileCount; index++){
+        if(strcmp(cameraProfiles[index].name, name) == 0){
+            return &cameraProfiles[index];
+        }
+    }
+    return NULL;
+}
+
+// Defining an existing name replaces it.
+cameraProfile* defineCameraProfile(const char* name, uint8_t resolution, uint8_t format, uint8_t fps, cameraWindow window){
+    if(strlen(name) == 0 || strlen(name) >= CAMERA_PROFILE_NAME_LENGTH || resolution > 4 || (format != GRAYSCALE && format > RGB565)){
+        return NULL;
+    }
+    if(fps == 0 || fps > cameraMaxFPS(resolution, format) || validateCameraWindow(&window, resolution, format)){
+        return NULL;
+    }
+
+    cameraProfile* profile = findCameraProfile(name);
+    if(profile == NULL){
+        if(cameraProfileCount == CAMERA_PROFILES){
+            return NULL;
+        }
+        profile = &cameraProfiles[cameraProfileCount++];
+    }
+
+    strcpy(profile->name, name);
+    profile->resolution = resolution;
+    profile->format = format;
+    profile->fps = fps;
+    profile->window = window;
+    cameraModeRegisters(resolution, format, fps, profile->registers);
+    profile->frameWidth = (window.width + window.scale - 1) / window.scale;
+    profile->frameHeight = (window.height + window.scale - 1) / window.scale;
+    profile->frameSize = (size_t) profile->frameWidth * profile->frameHeight * ((format == GRAYSCALE) ? 1 : 2);
+    return profile;
+}
+
+// One register delta against the sensor, a full Camera.begin() only when it fails.
+int useCameraProfile(cameraProfile* profile, uint8_t maxTries){
+    cameraResolution = profile->resolution;
+    cameraFormat = profile->format;
+    cameraFPS = profile->fps;
+    cameraRoi = profile->window;
+#if CAMERA_DELTA_RECONFIGURATION
+    if(applyCameraRegisters(profile->registers) == 0){
+        return 0;
+    }
+#endif
+    return cameraReady ? setupCamera(maxTries) : startCamera(maxTries);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,115 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Indices written by different sides are kept apart so a core polling one does not pull the other's cache line.
+// The Cortex-M4 has no data cache, word alignment is enough there.
+#if defined(ARDUINO_ARCH_MBED)
+#define RING_INDEX_ALIGN 4
+#else
+#define RING_INDEX_ALIGN 64
+#endif
+
+// Fixed-capacity ring handing slots from one producer to one consumer, an ISR or thread on one side and loop() on the other.
+// The slots live in the ring, no heap: the producer claim()s the next free slot, fills it in place and commit()s it,
+// the consumer peek()s the oldest one and release()s it once done. Indices run freely and are masked on access,
+// the producer publishes a slot with a release store of head that the consumer's acquire load of head pairs with,
+// and the other way round for tail.
+template<typename T, size_t CAPACITY>
+class spscRing{
+    static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "spscRing capacity must be a power of two");
+
+    public:
+        static constexpr size_t capacity(){ return CAPACITY; }
+
+        // Producer side. claim() returns NULL when the ring is full, the same slot until it is committed.
+        T* claim(){
+            size_t head = producer.head.load(std::memory_order_relaxed);
+            if(head - producer.tailCache == CAPACITY){
+                producer.tailCache = consumer.tail.load(std::memory_order_acquire);
+                if(head - producer.tailCache == CAPACITY){
+                    return NULL;
+                }
+            }
+            return &slots[head & (CAPACITY - 1)];
+        }
+
+        void commit(){
+            producer.head.store(producer.head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        bool push(const T& value){
+            T* slot = claim();
+            if(slot == NULL){
+                return false;
+            }
+            *slot = value;
+            commit();
+            return true;
+        }
+
+        // Consumer side. peek() returns NULL when the ring is empty, the same slot until it is released.
+        T* peek(){
+            size_t tail = consumer.tail.load(std::memory_order_relaxed);
+            if(tail == consumer.headCache){
+                consumer.headCache = producer.head.load(std::memory_order_acquire);
+                if(tail == consumer.headCache){
+                    return NULL;
+                }
+            }
+            return &slots[tail & (CAPACITY - 1)];
+        }
+
+        void release(){
+            consumer.tail.store(consumer.tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        bool pop(T& value){
+            T* slot = peek();
+            if(slot == NULL){
+                return false;
+            }
+            value = *slot;
+            release();
+            return true;
+        }
+
+        // Occupancy, exact only when the other side is idle. tail is read first: head can only have moved on since,
+        // so a third thread sees a count between 0 and CAPACITY, never one wrapped below zero.
+        size_t size() const{
+            size_t tail = consumer.tail.load(std::memory_order_acquire);
+            size_t head = producer.head.load(std::memory_order_acquire);
+            return (head - tail < CAPACITY) ? head - tail : CAPACITY;
+        }
+
+        bool empty() const{
+            return size() == 0;
+        }
+
+        // Only while neither side runs. start places both indices, the tests run them across SIZE_MAX with it.
+        void clear(size_t start = 0){
+            producer.head.store(start, std::memory_order_relaxed);
+            producer.tailCache = start;
+            consumer.tail.store(start, std::memory_order_relaxed);
+            consumer.headCache = start;
+        }
+
+    private:
+        struct alignas(RING_INDEX_ALIGN) producerIndex{
+            std::atomic<size_t> head{0};
+            size_t tailCache = 0;   // Last tail seen, refreshed only when the ring looks full.
+        };
+        struct alignas(RING_INDEX_ALIGN) consumerIndex{
+            std::atomic<size_t> tail{0};
+            size_t headCache = 0;   // Last head seen, refreshed only when the ring looks empty.
+        };
+
+        producerIndex producer;
+        consumerIndex consumer;
+        T slots[CAPACITY];
+};
+
+#endif
\ No newline at end of file
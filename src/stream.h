@@ -0,0 +1,407 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <Arduino.h>
+#include <camera.h>
+#include <capture.h>
+#include <bootTrace.h>
+#include <transport.h>
+#include <events.h>
+#include <atomic>
+
+#define STREAM_SLOTS 2
+#define STREAM_MEMORY_BYTES 160000  // Heap the stream slots may take, about what the nRF52840 has left next to BLE and the command tables.
+#define STREAM_BAND_ROWS 8          // Rows per slot when two whole frames do not fit.
+#define TRANSMIT_CHUNK_BYTES 64     // One USB full-speed packet, the longest a write waits for the link.
+#define TRANSMIT_HEADER_BYTES 40    // Longest "FRAME" header, written only when the link takes it without waiting.
+#define TRANSMIT_DRAIN_MS 1000      // Longest "stream stop" waits for the host to take the frame being sent.
+
+// Frames requested by commands and read from loop() through serviceCapture().
+typedef enum{
+    CAPTURE_FOR_NONE,
+    CAPTURE_FOR_PHOTO,
+    CAPTURE_FOR_STREAM,
+    CAPTURE_FOR_THREADS,    // Stream read and sent by the threads of threads.h, loop() only serves commands.
+    CAPTURE_FOR_TRANSFER    // Photo read, sent in chunks until the host acknowledges it (chunkTransfer.h).
+} captureClient;
+
+// A slot belongs to one stage at a time: the capture stage fills it, hands it to the transmit stage, which frees it once sent.
+typedef enum{
+    SLOT_FREE,
+    SLOT_CAPTURE,
+    SLOT_TRANSMIT
+} slotOwner;
+
+typedef struct{
+    byte* data;
+    size_t size;            // Bytes captured, set on handover.
+    uint32_t sequence;
+    uint32_t frameMicros;
+    bool frameStart;
+    bool frameEnd;
+    bool torn;              // The frame was dropped after part of it was handed over, the rest is sent as zeros.
+    slotOwner owner;
+} streamSlot;
+
+// The fields marked shared are written by the capture or transmit thread in "--threads" mode and read by the others.
+typedef struct{
+    streamSlot slots[STREAM_SLOTS];
+    size_t slotBytes;
+    size_t frameBytes;
+    bool bands;             // Slots hold STREAM_BAND_ROWS rows instead of whole frames.
+    uint8_t captureSlot;
+    uint8_t transmitSlot;
+    bool frameOpen;         // Part of the frame being read was handed over.
+    std::atomic<bool> capturing;        // More frames are wanted, shared.
+    uint32_t sequence;      // Sequence of the frame being read.
+    std::atomic<uint32_t> remaining;    // Frames left to read, 0 streams until "stream stop", shared.
+    size_t transmitOffset;
+    bool headerSent;
+    std::atomic<size_t> frameSent;      // Bytes of the frame being sent, padding included, shared.
+    std::atomic<uint32_t> framesSent;   // Shared.
+    std::atomic<uint32_t> framesTorn;   // Shared.
+    std::atomic<uint32_t> overruns;     // Bands dropped because the transmit stage still held the other slot, shared.
+    std::atomic<uint32_t> bytesSent;    // Shared, 32 bits as the Cortex-M4 has no 64-bit atomics: users take differences.
+    uint32_t startMillis;
+    uint32_t reportedMillis;            // "stats" rate over the time since the last report.
+    uint32_t reportedBytes;
+} streamPipeline;
+
+captureClient captureOwner = CAPTURE_FOR_NONE;
+streamPipeline stream;
+
+void stopStreamThreads();   // src/threads.h
+void serviceStreamThreads();
+bool chunkTransferWanted(); // src/chunkTransfer.h
+void chunkTransferBegin(const byte* frame, size_t frameBytes);
+void chunkTransferEnd();
+void serviceChunkTransfer();
+
+// Bytes the frame link takes without waiting.
+inline size_t transmitRoom(){
+    int room = frameLink->availableForWrite();
+    return (room > 0) ? room : 0;
+}
+
+int startPhotoCapture(){
+    if(setupFrameBuffer(&frameBuffer, &frameBufferSize)){
+        postEvent(EVENT_ERROR, micros(), "error memory");
+        commandLink->println("Failed to setup frame buffer.");
+        return 1;
+    }
+    captureOwner = CAPTURE_FOR_PHOTO;
+    frameLink = commandLink->frames();
+    captureBegin(frameBuffer);
+    postEvent(EVENT_CAPTURE, micros(), "start photo");
+    return 0;
+}
+
+void freeStreamSlots(){
+    for(uint8_t index = 0; index < STREAM_SLOTS; index++){
+        free(stream.slots[index].data);
+        stream.slots[index].data = NULL;
+        stream.slots[index].owner = SLOT_FREE;
+    }
+}
+
+void handOverSlot(streamSlot* slot, size_t size, bool frameEnd){
+    slot->size = size;
+    slot->sequence = stream.sequence;
+    slot->frameMicros = capture.frameMicros;
+    slot->frameStart = !stream.frameOpen;
+    slot->frameEnd = frameEnd;
+    slot->torn = false;
+    slot->owner = SLOT_TRANSMIT;
+    stream.frameOpen = !frameEnd;
+    if(frameEnd){
+        stream.sequence++;
+    }
+}
+
+// Capture engine hooks, called between two lines with interrupts off.
+byte* streamNextBand(){
+    streamSlot* next = &stream.slots[stream.captureSlot ^ 1];
+    if(next->owner != SLOT_FREE){
+        stream.overruns++;
+        return NULL;
+    }
+    handOverSlot(&stream.slots[stream.captureSlot], stream.slotBytes, false);
+    stream.captureSlot ^= 1;
+    next->owner = SLOT_CAPTURE;
+    return next->data;
+}
+
+byte* streamRestart(){
+    streamSlot* current = &stream.slots[stream.captureSlot];
+    if(!stream.frameOpen){
+        return current->data; // Nothing of the frame left the capture stage, its slot is reused.
+    }
+    handOverSlot(current, capture.write - current->data, true);
+    current->torn = true;
+    stream.framesTorn++;
+    stream.captureSlot ^= 1;
+    streamSlot* next = &stream.slots[stream.captureSlot];
+    if(next->owner != SLOT_FREE){
+        return NULL;
+    }
+    next->owner = SLOT_CAPTURE;
+    return next->data;
+}
+
+// Starts the next frame once the capture stage owns a free slot.
+void startStreamFrame(){
+    streamSlot* slot = &stream.slots[stream.captureSlot];
+    if(slot->owner == SLOT_TRANSMIT){
+        return;
+    }
+    slot->owner = SLOT_CAPTURE;
+    if(stream.bands){
+        captureBeginBands(slot->data, stream.slotBytes, &streamNextBand, &streamRestart);
+    }
+    else{
+        captureBegin(slot->data);
+    }
+}
+
+// Two whole frames when they fit in STREAM_MEMORY_BYTES, two bands of STREAM_BAND_ROWS rows otherwise.
+bool streamBands(size_t frameBytes){
+    return STREAM_SLOTS * frameBytes > STREAM_MEMORY_BYTES;
+}
+
+size_t streamSlotBytes(size_t rowBytes, size_t frameBytes){
+    return streamBands(frameBytes) ? rowBytes * STREAM_BAND_ROWS : frameBytes;
+}
+
+// The slots streamSlotBytes() picks, allocated once per stream.
+int setupStream(uint32_t frames){
+    freeFrameBuffer(&frameBuffer);
+    frameBufferSize = 0;
+    freeStreamSlots();
+
+    size_t rowBytes = (size_t) cameraOutputWidth() * cameraBytesPerPixel();
+    stream.frameBytes = rowBytes * cameraOutputHeight();
+    stream.bands = streamBands(stream.frameBytes);
+    stream.slotBytes = streamSlotBytes(rowBytes, stream.frameBytes);
+    for(uint8_t index = 0; index < STREAM_SLOTS; index++){
+        stream.slots[index].data = (byte*) malloc(stream.slotBytes);
+        if(stream.slots[index].data == NULL){
+            freeStreamSlots();
+            postEvent(EVENT_ERROR, micros(), "error memory");
+            commandLink->print("No enough memory for stream buffers, requested: ");
+            commandLink->print(STREAM_SLOTS * stream.slotBytes);
+            commandLink->println(" bytes. Try to downgrade the camera resolution and format, \"mem\" lists the ones that fit.");
+            return 1;
+        }
+    }
+
+    frameLink = commandLink->frames();
+    stream.captureSlot = 0;
+    stream.transmitSlot = 0;
+    stream.frameOpen = false;
+    stream.capturing = true;
+    stream.sequence = 0;
+    stream.remaining = frames;
+    stream.transmitOffset = 0;
+    stream.headerSent = false;
+    stream.frameSent = 0;
+    stream.framesSent = 0;
+    stream.framesTorn = 0;
+    stream.overruns = 0;
+    stream.bytesSent = 0;
+    stream.startMillis = millis();
+    stream.reportedMillis = stream.startMillis;
+    stream.reportedBytes = 0;
+    return 0;
+}
+
+int startStream(uint32_t frames){
+    if(setupStream(frames)){
+        return 1;
+    }
+    captureOwner = CAPTURE_FOR_STREAM;
+    startStreamFrame();
+    return 0;
+}
+
+bool streamRunning(){
+    return captureOwner == CAPTURE_FOR_STREAM || captureOwner == CAPTURE_FOR_THREADS;
+}
+
+// The engine is driven from loop(), which must not idle between calls.
+bool loopDrivesCapture(){
+    return captureBusy() && captureOwner != CAPTURE_FOR_THREADS;
+}
+
+bool streamTransmitPending(){
+    return stream.slots[stream.transmitSlot].owner == SLOT_TRANSMIT;
+}
+
+// Events wait while a frame is part way out, or for the transmit thread, which sends them between its frames.
+bool eventsHeld(){
+    return captureOwner == CAPTURE_FOR_THREADS || (captureOwner == CAPTURE_FOR_STREAM && stream.headerSent);
+}
+
+// Sends slots in capture order for about spareMicros. Each frame is "FRAME <sequence> <bytes> <micros>\r\n",
+// the frame and "\r\n", or "!\r\n" when it was torn and its missing rows were sent as zeros.
+void serviceTransmit(uint32_t spareMicros){
+    static const byte zeros[TRANSMIT_CHUNK_BYTES] = {0};
+    uint32_t start = micros();
+    while(micros() - start < spareMicros){
+        streamSlot* slot = &stream.slots[stream.transmitSlot];
+        if(slot->owner != SLOT_TRANSMIT){
+            return;
+        }
+        if(slot->frameStart && !stream.headerSent){
+            if(transmitRoom() < TRANSMIT_HEADER_BYTES){
+                return;
+            }
+            sendEvents();
+            frameLink->print("FRAME ");
+            frameLink->print(slot->sequence);
+            frameLink->print(" ");
+            frameLink->print(stream.frameBytes);
+            frameLink->print(" ");
+            frameLink->print(slot->frameMicros);
+            frameLink->print("\r\n");
+            stream.headerSent = true;
+        }
+
+        size_t room = transmitRoom();
+        if(room == 0){
+            return;
+        }
+        room = (room < TRANSMIT_CHUNK_BYTES) ? room : TRANSMIT_CHUNK_BYTES;
+        if(stream.transmitOffset < slot->size){
+            size_t chunk = slot->size - stream.transmitOffset;
+            chunk = (chunk < room) ? chunk : room;
+            frameLink->write(slot->data + stream.transmitOffset, chunk);
+            stream.transmitOffset += chunk;
+            stream.frameSent += chunk;
+            stream.bytesSent += chunk;
+            continue;
+        }
+        if(slot->frameEnd){
+            if(stream.frameSent < stream.frameBytes){
+                size_t chunk = stream.frameBytes - stream.frameSent;
+                chunk = (chunk < room) ? chunk : room;
+                frameLink->write(zeros, chunk);
+                stream.frameSent += chunk;
+                continue;
+            }
+            frameLink->print(slot->torn ? "!\r\n" : "\r\n");
+            stream.framesSent++;
+            stream.frameSent = 0;
+            stream.headerSent = false;
+        }
+        stream.transmitOffset = 0;
+        slot->owner = SLOT_FREE;
+        stream.transmitSlot ^= 1;
+    }
+}
+
+// The frame being sent is completed (torn) so the host stays in sync, then the slots are released.
+void stopStream(){
+    captureAbort();
+    stream.capturing = false;
+    if(stream.frameOpen){
+        streamRestart();
+    }
+    uint32_t start = millis();
+    while(streamTransmitPending() && millis() - start < TRANSMIT_DRAIN_MS){
+        serviceTransmit(CAPTURE_SLICE_MICROS);
+    }
+    freeStreamSlots();
+    captureOwner = CAPTURE_FOR_NONE;
+}
+
+void stopCapture(){
+    if(captureOwner == CAPTURE_FOR_STREAM){
+        stopStream();
+        return;
+    }
+    if(captureOwner == CAPTURE_FOR_THREADS){
+        stopStreamThreads();
+        return;
+    }
+    if(captureOwner == CAPTURE_FOR_TRANSFER){
+        chunkTransferEnd();
+        return;
+    }
+    captureAbort();
+    captureOwner = CAPTURE_FOR_NONE;
+}
+
+// Capture stage of the stream: one line per call, so the transmit stage runs in every horizontal blanking.
+void serviceStream(){
+    captureState state = captureStep(CAPTURE_LINE_SLICE);
+    if(state == CAPTURE_DONE){
+        capture.state = CAPTURE_IDLE;
+        postEvent(EVENT_FRAME, capture.frameMicros, "frame %lu %lu", (unsigned long) stream.sequence, (unsigned long) stream.frameBytes);
+        handOverSlot(&stream.slots[stream.captureSlot], capture.write - stream.slots[stream.captureSlot].data, true);
+        stream.captureSlot ^= 1;
+        if(stream.remaining != 0 && --stream.remaining == 0){
+            stream.capturing = false;
+        }
+    }
+    else if(state == CAPTURE_FAILED){
+        capture.state = CAPTURE_IDLE;
+        stopStream();
+        postEvent(EVENT_ERROR, micros(), "error timeout");
+        commandLink->println("Failed to read frame.");
+        commandLink->println("Stream stopped.");
+        return;
+    }
+
+    if(stream.capturing && !captureBusy()){
+        startStreamFrame();
+    }
+    serviceTransmit(captureSpareMicros());
+
+    if(!stream.capturing && !captureBusy() && !streamTransmitPending()){
+        freeStreamSlots();
+        captureOwner = CAPTURE_FOR_NONE;
+        postEvent(EVENT_CAPTURE, micros(), "end %lu", (unsigned long) stream.framesSent);
+        commandLink->println("Stream finished.");
+    }
+}
+
+// Called on every loop(), reads at most one slice of the frame being captured.
+void serviceCapture(){
+    if(captureOwner == CAPTURE_FOR_STREAM){
+        serviceStream();
+        return;
+    }
+    if(captureOwner == CAPTURE_FOR_THREADS){
+        serviceStreamThreads();
+        return;
+    }
+    if(captureOwner == CAPTURE_FOR_TRANSFER){
+        serviceChunkTransfer();
+        return;
+    }
+    if(captureOwner == CAPTURE_FOR_NONE){
+        return;
+    }
+
+    captureState state = captureStep(CAPTURE_SLICE_MICROS);
+    if(state == CAPTURE_DONE){
+        captureOwner = CAPTURE_FOR_NONE;
+        capture.state = CAPTURE_IDLE;
+        bootTraceClose("firstFrame");
+        postEvent(EVENT_FRAME, capture.frameMicros, "frame %lu %lu", (unsigned long) events.photos++, (unsigned long) frameBufferSize);
+        if(chunkTransferWanted()){
+            chunkTransferBegin(frameBuffer, frameBufferSize);
+            return;
+        }
+        transportSegment segments[2] = {{frameBuffer, frameBufferSize}, {"\r\n", 2}};
+        frameLink->writev(segments, 2);
+    }
+    else if(state == CAPTURE_FAILED){
+        stopCapture();
+        postEvent(EVENT_ERROR, micros(), "error timeout");
+        commandLink->println("Failed to read frame.");
+        commandLink->println("Failed to take photo.");
+    }
+}
+
+#endif
\ No newline at end of file
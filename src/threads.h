@@ -0,0 +1,300 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+#include <Arduino.h>
+#include <mbed.h>
+#include <stdio.h>
+#include <atomic>
+#include <ring.h>
+#include <capture.h>
+#include <stream.h>
+
+#define THREAD_STACK_BYTES 4096
+#define THREAD_IDLE_SLEEP_MS 1      // Poll period of a thread with nothing to do, one RTOS tick.
+#define THREAD_SLEEP_MIN_MICROS 2000 // Capture thread sleeps only when the sensor leaves it this long, a sleep can end a tick late.
+
+// "stream start --threads": a capture thread reads frames (or bands) into the stream slots and queues them, a transmit
+// thread sends and frees them, and the Arduino loop() thread is left with the commands. The queues are SPSC rings of
+// slot pointers, bounded by the slots themselves so neither side ever allocates or blocks the other.
+typedef enum{
+    THREAD_CAPTURE,
+    THREAD_TRANSMIT,
+    THREAD_COMMAND,
+    THREADS
+} threadIndex;
+
+typedef struct{
+    uint64_t busyMicros;    // Time between waking up and going back to sleep.
+    uint64_t linkMicros;    // Part of busyMicros spent writing to the link, the thread is blocked on the USB stack there.
+    uint32_t busySince;
+    uint32_t sleeps;
+} threadStatistics;
+
+typedef struct{
+    uint32_t pushes;
+    uint32_t peak;
+    uint64_t occupancySum;  // Queued slots after each push, the mean occupancy is occupancySum / pushes.
+    uint32_t freeWaits;     // Capture thread found no free slot, the transmit thread held all of them.
+} queueStatistics;
+
+typedef struct{
+    rtos::Thread* capture;
+    rtos::Thread* transmit;
+    spscRing<streamSlot*, STREAM_SLOTS> filled;     // Capture to transmit, in capture order.
+    spscRing<streamSlot*, STREAM_SLOTS> free;       // Transmit back to capture.
+    streamSlot* captureSlot;    // Slot the engine writes, NULL while the capture thread waits for one.
+    std::atomic<bool> stopping;
+    std::atomic<bool> captureFinished;
+    std::atomic<bool> transmitFinished;
+    std::atomic<bool> failed;
+    uint32_t startMicros;
+    threadStatistics stats[THREADS];
+    queueStatistics queue;
+} streamThreads;
+
+const char* threadNames[THREADS] = {"capture", "transmit", "command"};
+streamThreads threads;
+
+void threadBusyBegin(threadIndex index){
+    threads.stats[index].busySince = micros();
+}
+
+void threadBusyEnd(threadIndex index){
+    threads.stats[index].busyMicros += micros() - threads.stats[index].busySince;
+}
+
+void threadSleep(threadIndex index, uint32_t milliseconds){
+    threadBusyEnd(index);
+    threads.stats[index].sleeps++;
+    rtos::ThisThread::sleep_for(std::chrono::milliseconds(milliseconds));
+    threadBusyBegin(index);
+}
+
+// From the capture thread, the producer of filled: its count is exact or one high while a slot is being released.
+void queueSlot(streamSlot* slot, size_t size, bool frameEnd, bool torn){
+    handOverSlot(slot, size, frameEnd);
+    slot->torn = torn;
+    threads.filled.push(slot);  // Never full, it has room for every slot.
+    size_t queued = threads.filled.size();
+    threads.queue.pushes++;
+    threads.queue.occupancySum += queued;
+    if(queued > threads.queue.peak){
+        threads.queue.peak = queued;
+    }
+}
+
+streamSlot* takeFreeSlot(){
+    streamSlot* slot;
+    if(!threads.free.pop(slot)){
+        return NULL;
+    }
+    slot->owner = SLOT_CAPTURE;
+    return slot;
+}
+
+// Capture engine hooks, run by the capture thread between two lines.
+byte* threadNextBand(){
+    streamSlot* next = takeFreeSlot();
+    if(next == NULL){
+        stream.overruns++;
+        return NULL;
+    }
+    queueSlot(threads.captureSlot, stream.slotBytes, false, false);
+    threads.captureSlot = next;
+    return next->data;
+}
+
+byte* threadRestart(){
+    if(!stream.frameOpen){
+        return threads.captureSlot->data;
+    }
+    queueSlot(threads.captureSlot, capture.write - threads.captureSlot->data, true, true);
+    stream.framesTorn++;
+    threads.captureSlot = takeFreeSlot();
+    return (threads.captureSlot != NULL) ? threads.captureSlot->data : NULL;
+}
+
+bool startThreadFrame(){
+    if(threads.captureSlot == NULL){
+        threads.captureSlot = takeFreeSlot();
+        if(threads.captureSlot == NULL){
+            return false;
+        }
+    }
+    if(stream.bands){
+        captureBeginBands(threads.captureSlot->data, stream.slotBytes, &threadNextBand, &threadRestart);
+    }
+    else{
+        captureBegin(threads.captureSlot->data);
+    }
+    return true;
+}
+
+// Highest priority: reads every line as it comes and sleeps through the blankings long enough for an RTOS tick.
+void captureThreadMain(){
+    threadBusyBegin(THREAD_CAPTURE);
+    while(!threads.stopping){
+        if(!captureBusy()){
+            if(!stream.capturing){
+                break;
+            }
+            if(!startThreadFrame()){
+                threads.queue.freeWaits++;
+                threadSleep(THREAD_CAPTURE, THREAD_IDLE_SLEEP_MS);
+                continue;
+            }
+        }
+
+        captureState state = captureStep(CAPTURE_LINE_SLICE);
+        if(state == CAPTURE_DONE){
+            capture.state = CAPTURE_IDLE;
+            postEvent(EVENT_FRAME, capture.frameMicros, "frame %lu %lu", (unsigned long) stream.sequence, (unsigned long) stream.frameBytes);
+            queueSlot(threads.captureSlot, capture.write - threads.captureSlot->data, true, false);
+            threads.captureSlot = NULL;
+            if(stream.remaining != 0 && --stream.remaining == 0){
+                stream.capturing = false;
+            }
+            continue;
+        }
+        if(state == CAPTURE_FAILED){
+            capture.state = CAPTURE_IDLE;
+            threads.failed = true;
+            break;
+        }
+
+        uint32_t spare = captureSpareMicros();
+        if(captureBusy() && spare >= THREAD_SLEEP_MIN_MICROS){
+            threadSleep(THREAD_CAPTURE, spare / 1000 - THREAD_IDLE_SLEEP_MS);
+        }
+    }
+
+    // Stopped in the middle of a frame: the part already queued is completed as a torn frame.
+    captureAbort();
+    if(stream.frameOpen){
+        queueSlot(threads.captureSlot, capture.write - threads.captureSlot->data, true, true);
+        stream.framesTorn++;
+    }
+    threads.captureFinished = true;
+    threadBusyEnd(THREAD_CAPTURE);
+}
+
+// Same records as serviceTransmit(), the header and the slot go out in one writev() so a command response cannot split them.
+void transmitThreadSlot(streamSlot* slot){
+    static const byte zeros[TRANSMIT_CHUNK_BYTES] = {0};
+    uint32_t start = micros();
+    char header[TRANSMIT_HEADER_BYTES];
+    transportSegment segments[2];
+    size_t count = 0;
+    if(slot->frameStart){
+        snprintf(header, sizeof(header), "FRAME %lu %lu %lu\r\n", (unsigned long) slot->sequence, (unsigned long) stream.frameBytes, (unsigned long) slot->frameMicros);
+        segments[count++] = {header, strlen(header)};
+    }
+    segments[count++] = {slot->data, slot->size};
+    frameLink->writev(segments, count);
+    stream.frameSent += slot->size;
+    stream.bytesSent += slot->size;
+    if(slot->frameEnd){
+        while(stream.frameSent < stream.frameBytes){
+            size_t chunk = stream.frameBytes - stream.frameSent;
+            chunk = (chunk < TRANSMIT_CHUNK_BYTES) ? chunk : TRANSMIT_CHUNK_BYTES;
+            frameLink->write(zeros, chunk);
+            stream.frameSent += chunk;
+        }
+        frameLink->print(slot->torn ? "!\r\n" : "\r\n");
+        frameLink->flush();
+        stream.framesSent++;
+        stream.frameSent = 0;
+    }
+    threads.stats[THREAD_TRANSMIT].linkMicros += micros() - start;
+}
+
+// Above the command thread: sends queued slots in order and ends once the capture thread ended and the queue is empty.
+void transmitThreadMain(){
+    threadBusyBegin(THREAD_TRANSMIT);
+    while(true){
+        bool captureFinished = threads.captureFinished;
+        streamSlot* slot;
+        if(!threads.filled.pop(slot)){
+            if(captureFinished){
+                break;
+            }
+            if(stream.frameSent == 0){
+                sendEvents();   // Between frames, the capture thread posted them.
+            }
+            threadSleep(THREAD_TRANSMIT, THREAD_IDLE_SLEEP_MS);
+            continue;
+        }
+        if(slot->frameStart){
+            sendEvents();
+        }
+        transmitThreadSlot(slot);
+        slot->owner = SLOT_FREE;
+        threads.free.push(slot);
+    }
+    threads.transmitFinished = true;
+    threadBusyEnd(THREAD_TRANSMIT);
+}
+
+int startStreamThreads(uint32_t frames){
+    if(setupStream(frames)){
+        return 1;
+    }
+
+    threads.filled.clear();
+    threads.free.clear();
+    for(uint8_t index = 0; index < STREAM_SLOTS; index++){
+        threads.free.push(&stream.slots[index]);
+    }
+    threads.captureSlot = NULL;
+    threads.stopping = false;
+    threads.captureFinished = false;
+    threads.transmitFinished = false;
+    threads.failed = false;
+    memset(threads.stats, 0, sizeof(threads.stats));
+    memset(&threads.queue, 0, sizeof(threads.queue));
+    threads.startMicros = micros();
+    threadBusyBegin(THREAD_COMMAND); // Called from "stream start", its time counts from here.
+
+    threads.capture = new rtos::Thread(osPriorityHigh, THREAD_STACK_BYTES, NULL, threadNames[THREAD_CAPTURE]);
+    threads.transmit = new rtos::Thread(osPriorityAboveNormal, THREAD_STACK_BYTES, NULL, threadNames[THREAD_TRANSMIT]);
+    captureOwner = CAPTURE_FOR_THREADS;
+    threads.transmit->start(&transmitThreadMain);
+    threads.capture->start(&captureThreadMain);
+    return 0;
+}
+
+void joinStreamThreads(){
+    threads.capture->join();
+    threads.transmit->join();
+    delete threads.capture;
+    delete threads.transmit;
+    threads.capture = NULL;
+    threads.transmit = NULL;
+    freeStreamSlots();
+    captureOwner = CAPTURE_FOR_NONE;
+}
+
+// From the command thread: the capture thread stops at its next line, the transmit thread sends what was queued.
+void stopStreamThreads(){
+    threads.stopping = true;
+    joinStreamThreads();
+}
+
+// From loop(): reports the end of a stream of --frames frames or a failure, once both threads returned.
+void serviceStreamThreads(){
+    if(!threads.captureFinished || !threads.transmitFinished){
+        return;
+    }
+    bool failed = threads.failed;
+    joinStreamThreads();
+    if(failed){
+        postEvent(EVENT_ERROR, micros(), "error timeout");
+        commandLink->println("Failed to read frame.");
+        commandLink->println("Stream stopped.");
+        return;
+    }
+    postEvent(EVENT_CAPTURE, micros(), "end %lu", (unsigned long) stream.framesSent);
+    commandLink->println("Stream finished.");
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,271 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <Arduino.h>
+#include <mbed.h>
+
+#define TRANSPORT_LINE_BYTES 128        // Longest command line, the rest of a longer one is dropped.
+#define TRANSPORT_PACKET_BYTES 64       // USB full-speed bulk packet, what the CDC data endpoint sends at once.
+#define TRANSPORT_BATCH_BYTES 512       // Eight packets, output is gathered up to it between flushes.
+#define SERIAL_TRANSPORT_ROOM 64        // Room reported on mbed, where the USB CDC class does not: about one packet per write.
+#define LOOPBACK_BYTES 4096
+
+// One piece of a scattered write.
+typedef struct{
+    const void* data;
+    size_t size;
+} transportSegment;
+
+// A link to the host: commands are read from it without blocking, responses and frames are written to it.
+// It is a Print, so the commands print to it the way they printed to Serial. Small writes may be held back until
+// flush(), which loop() calls after every pass. writev() sends its segments back to back, so a record written with it
+// is never split by output from another thread.
+class transport : public Print{
+    public:
+        using Print::write;
+        size_t write(uint8_t value) override{ return write(&value, 1); }
+        size_t write(const uint8_t* buffer, size_t size) override = 0;
+
+        virtual size_t writev(const transportSegment* segments, size_t count){
+            size_t written = 0;
+            for(size_t index = 0; index < count; index++){
+                written += write((const uint8_t*) segments[index].data, segments[index].size);
+            }
+            return written;
+        }
+
+        // Bytes write() takes without waiting for the link.
+        int availableForWrite() override = 0;
+        void flush() override{}
+
+        // Bytes received so far, at most size, 0 when there are none.
+        virtual size_t read(byte* buffer, size_t size) = 0;
+
+        virtual bool connected() = 0;
+        virtual const char* name() = 0;
+
+        // Link the photos and streams asked for on this one are sent to.
+        virtual transport* frames(){ return this; }
+
+        // Gathers received bytes into a command line, true once a '\r' or '\n' ended one. The '\n' of "\r\n" is dropped.
+        bool readLine(char* line, size_t width){
+            byte value;
+            while(read(&value, 1) == 1){
+                if(value == '\n' && lastCarriageReturn){
+                    lastCarriageReturn = false;
+                    continue;
+                }
+                lastCarriageReturn = (value == '\r');
+                if(value == '\r' || value == '\n'){
+                    size_t length = (lineLength < width - 1) ? lineLength : width - 1;
+                    memcpy(line, lineBuffer, length);
+                    line[length] = '\0';
+                    lineLength = 0;
+                    return true;
+                }
+                if(lineLength < TRANSPORT_LINE_BYTES){
+                    lineBuffer[lineLength++] = (char) value;
+                }
+            }
+            return false;
+        }
+
+    private:
+        char lineBuffer[TRANSPORT_LINE_BYTES];
+        size_t lineLength = 0;
+        bool lastCarriageReturn = false;
+};
+
+// Output counted at the USB CDC endpoint. A write() of the CDC class sends its bytes in 64 byte packets and ends with
+// a short one unless its size is a multiple of 64, which ends the host's read and costs a bus frame before the next.
+typedef struct{
+    uint64_t bytes;
+    uint32_t packets;
+    uint32_t shortPackets;
+    uint32_t writes;        // Calls into the CDC class.
+    uint32_t reportedAt;    // micros() of the last "stats", rates are over the time since.
+    uint64_t reportedBytes;
+    uint32_t reportedPackets;
+} serialLinkStatistics;
+
+// USB serial. Output is gathered in a batch and leaves in whole packets: a write that fills the batch sends it, one
+// longer than the batch goes out from the caller's buffer rounded down to whole packets and its tail is gathered.
+// Only flush(), at the end of a command, a frame record or a loop() pass, sends a short packet. The capture and
+// transmit threads write too, a mutex keeps the gathered bytes and the records whole.
+class serialTransport : public transport{
+    public:
+        explicit serialTransport(HardwareSerial& serial) : serial(serial){}
+
+        using transport::write;
+        size_t write(const uint8_t* buffer, size_t size) override{
+            mutex.lock();
+            append(buffer, size);
+            mutex.unlock();
+            return size;
+        }
+
+        size_t writev(const transportSegment* segments, size_t count) override{
+            size_t written = 0;
+            mutex.lock();
+            for(size_t index = 0; index < count; index++){
+                append((const uint8_t*) segments[index].data, segments[index].size);
+                written += segments[index].size;
+            }
+            mutex.unlock();
+            return written;
+        }
+
+        int availableForWrite() override{
+#if defined(ARDUINO_ARCH_MBED)
+            return SERIAL_TRANSPORT_ROOM;
+#else
+            int room = serial.availableForWrite();
+            return (room > (int) batched) ? room - (int) batched : 0;
+#endif
+        }
+
+        void flush() override{
+            mutex.lock();
+            if(batched != 0){
+                send(batch, batched);
+                batched = 0;
+            }
+            mutex.unlock();
+        }
+
+        size_t read(byte* buffer, size_t size) override{
+            size_t count = 0;
+            while(count < size && serial.available() > 0){
+                buffer[count++] = serial.read();
+            }
+            return count;
+        }
+
+        bool connected() override{ return (bool) serial; }
+        const char* name() override{ return "serial"; }
+
+        serialLinkStatistics stats = {};
+
+    private:
+        void append(const uint8_t* buffer, size_t size){
+            while(size != 0){
+                if(batched == 0 && size >= TRANSPORT_BATCH_BYTES){
+                    size_t direct = size - size % TRANSPORT_PACKET_BYTES;
+                    send(buffer, direct);
+                    buffer += direct;
+                    size -= direct;
+                    continue;
+                }
+                size_t count = (size < TRANSPORT_BATCH_BYTES - batched) ? size : TRANSPORT_BATCH_BYTES - batched;
+                memcpy(batch + batched, buffer, count);
+                batched += count;
+                buffer += count;
+                size -= count;
+                if(batched == TRANSPORT_BATCH_BYTES){
+                    send(batch, batched);
+                    batched = 0;
+                }
+            }
+        }
+
+        void send(const uint8_t* buffer, size_t size){
+            serial.write(buffer, size);
+            stats.bytes += size;
+            stats.packets += (size + TRANSPORT_PACKET_BYTES - 1) / TRANSPORT_PACKET_BYTES;
+            stats.shortPackets += (size % TRANSPORT_PACKET_BYTES != 0) ? 1 : 0;
+            stats.writes++;
+        }
+
+        HardwareSerial& serial;
+        rtos::Mutex mutex;
+        uint8_t batch[TRANSPORT_BATCH_BYTES];
+        size_t batched = 0;
+};
+
+// In memory link for host tests and benchmarks: feed() queues command bytes, take() returns the output.
+// Output beyond LOOPBACK_BYTES is counted and dropped.
+class loopbackTransport : public transport{
+    public:
+        using transport::write;
+        size_t write(const uint8_t* buffer, size_t size) override{
+            size_t room = LOOPBACK_BYTES - outputLength;
+            size_t count = (size < room) ? size : room;
+            memcpy(output + outputLength, buffer, count);
+            outputLength += count;
+            dropped += size - count;
+            writes++;
+            return size;
+        }
+
+        int availableForWrite() override{ return LOOPBACK_BYTES - outputLength; }
+
+        size_t read(byte* buffer, size_t size) override{
+            size_t count = (inputLength - inputRead < size) ? inputLength - inputRead : size;
+            memcpy(buffer, input + inputRead, count);
+            inputRead += count;
+            return count;
+        }
+
+        bool connected() override{ return true; }
+        const char* name() override{ return "loopback"; }
+
+        size_t feed(const char* text){
+            memmove(input, input + inputRead, inputLength - inputRead);
+            inputLength -= inputRead;
+            inputRead = 0;
+            size_t size = strlen(text);
+            size = (size < LOOPBACK_BYTES - inputLength) ? size : LOOPBACK_BYTES - inputLength;
+            memcpy(input + inputLength, text, size);
+            inputLength += size;
+            return size;
+        }
+
+        size_t take(char* buffer, size_t size){
+            size_t count = (outputLength < size) ? outputLength : size;
+            memcpy(buffer, output, count);
+            memmove(output, output + count, outputLength - count);
+            outputLength -= count;
+            return count;
+        }
+
+        size_t outputLength = 0;
+        uint32_t writes = 0;
+        size_t dropped = 0;
+
+    private:
+        byte input[LOOPBACK_BYTES];
+        size_t inputLength = 0;
+        size_t inputRead = 0;
+        byte output[LOOPBACK_BYTES];
+};
+
+serialTransport serialLink(Serial);
+transport* commandLink = &serialLink;  // Link of the command being served, its output goes back there.
+transport* frameLink = &serialLink;    // Link of the photo or stream being captured.
+
+// USB serial counters for "stats", the rates over the time since the last report.
+void printSerialStats(){
+    serialLinkStatistics& stats = serialLink.stats;
+    uint32_t now = micros();
+    uint32_t elapsed = now - stats.reportedAt;
+    uint64_t bytes = stats.bytes - stats.reportedBytes;
+    uint32_t packets = stats.packets - stats.reportedPackets;
+    commandLink->print("\tSerial: ");
+    commandLink->print((uint32_t) stats.bytes);
+    commandLink->print(" bytes in ");
+    commandLink->print(stats.packets);
+    commandLink->print(" USB packets (");
+    commandLink->print(stats.shortPackets);
+    commandLink->print(" short) and ");
+    commandLink->print(stats.writes);
+    commandLink->print(" writes, ");
+    commandLink->print((elapsed != 0) ? (uint32_t) (bytes * 1000000 / elapsed) : 0);
+    commandLink->print(" bytes/s and ");
+    commandLink->print((elapsed != 0) ? (uint32_t) ((uint64_t) packets * 1000000 / elapsed) : 0);
+    commandLink->print(" packets/s since the last stats.\n");
+    stats.reportedAt = now;
+    stats.reportedBytes = stats.bytes;
+    stats.reportedPackets = stats.packets;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,2 @@
+// The Arduino shims of [env:native]. The test build leaves src/ and tools/ out, so the suite compiles them here.
+#include "../../tools/native/shims.cpp"
@@ -0,0 +1,107 @@
+// bleTransport against the mock ArduinoBLE stack and central, run by "pio test -e native --filter test_ble".
+// Each test connects the central with the link it models and sends a frame the way loop() flushes the links.
+
+#include <Arduino.h>
+#include <ArduinoBLE.h>
+#include <bleTransport.h>
+
+#include <unity.h>
+
+#define BLE_TEST_TIMEOUT_MS 10000   // Longest a frame may take to reach the central.
+
+static byte frame[9600];
+
+// Writes bytes of the frame and flushes until the central received them all, false when it timed out.
+static bool sendFrame(size_t bytes){
+    bleData.received.clear();
+    bleData.lengths.clear();
+    bleDataLink.write(frame, bytes);
+    uint32_t start = millis();
+    while(bleData.received.size() < bytes){
+        if(millis() - start > BLE_TEST_TIMEOUT_MS){
+            return false;
+        }
+        bleLink.flush();
+        BLE.poll();
+        delayMicroseconds(200);
+    }
+    return true;
+}
+
+void setUp(void){
+}
+
+// As loop() would: the link sees the central leave, the next connection starts afresh.
+void tearDown(void){
+    BLE.disconnect();
+    bleLink.flush();
+}
+
+// Every notification but the last carries min(MTU - 3, 244) bytes.
+void test_notifications_fill_the_mtu(){
+    const uint16_t mtus[4] = {23, 185, 247, 517};
+    for(uint8_t index = 0; index < 4; index++){
+        BLE.connect(mtus[index], 7500, 3, 6);
+        size_t payload = (mtus[index] - 3 < BLE_MAX_PAYLOAD) ? mtus[index] - 3 : BLE_MAX_PAYLOAD;
+        TEST_ASSERT_TRUE(sendFrame(3000));
+        TEST_ASSERT_EQUAL_size_t((3000 + payload - 1) / payload, bleData.lengths.size());
+        for(size_t notification = 0; notification + 1 < bleData.lengths.size(); notification++){
+            TEST_ASSERT_EQUAL_size_t(payload, bleData.lengths[notification]);
+        }
+        TEST_ASSERT_EQUAL_UINT32(0, (uint32_t) BLE.stats.truncated);
+        tearDown();
+    }
+}
+
+// A controller queue deeper than the credits: the credits alone bound what it holds.
+void test_credits_bound_notifications_in_flight(){
+    BLE.connect(247, 15000, 3, 4 * BLE_CREDITS);
+    TEST_ASSERT_TRUE(sendFrame(sizeof(frame)));
+    TEST_ASSERT_TRUE(BLE.stats.peakQueued <= BLE_CREDITS);
+    TEST_ASSERT_EQUAL_UINT32(0, (uint32_t) BLE.stats.rejected);
+}
+
+void test_no_refusals_when_the_controller_keeps_up(){
+    const uint32_t intervals[2] = {15000, 7500};
+    for(uint8_t index = 0; index < 2; index++){
+        uint32_t refused = ble.refused;
+        uint32_t blocked = ble.blocked;
+        BLE.connect(247, intervals[index], 3, 6);
+        TEST_ASSERT_TRUE(sendFrame(sizeof(frame)));
+        TEST_ASSERT_EQUAL_UINT32(refused, ble.refused);
+        TEST_ASSERT_EQUAL_UINT32(blocked, ble.blocked);
+        TEST_ASSERT_EQUAL_UINT32(0, (uint32_t) BLE.stats.rejected);
+        tearDown();
+    }
+}
+
+// One notification per 15 ms event where the first estimate assumes three: refusals lengthen the time per credit to
+// the controller's pace, the frames after a few go out with at most a refusal or two.
+void test_creditMicros_converges_after_refusals(){
+    BLE.connect(247, 15000, 1, 2);
+    uint32_t refused = ble.refused;
+    TEST_ASSERT_TRUE(sendFrame(sizeof(frame)));
+    TEST_ASSERT_TRUE(ble.refused > refused);
+    for(uint8_t index = 0; index < 3; index++){
+        TEST_ASSERT_TRUE(sendFrame(sizeof(frame)));
+    }
+    refused = ble.refused;
+    TEST_ASSERT_TRUE(sendFrame(sizeof(frame)));
+    TEST_ASSERT_TRUE(ble.refused - refused <= 2);
+    TEST_ASSERT_UINT32_WITHIN(15000 / 2, 15000, ble.creditMicros);
+}
+
+int main(int argc, char** argv){
+    for(size_t index = 0; index < sizeof(frame); index++){
+        frame[index] = index;
+    }
+    BLE.radio = true;
+    bleLink.begin();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_notifications_fill_the_mtu);
+    RUN_TEST(test_credits_bound_notifications_in_flight);
+    RUN_TEST(test_no_refusals_when_the_controller_keeps_up);
+    RUN_TEST(test_creditMicros_converges_after_refusals);
+    return UNITY_END();
+}
@@ -0,0 +1,3 @@
+// The Arduino and camera shims of [env:native]. The test build leaves src/ and tools/ out, so the suite compiles them here.
+#include "../../tools/native/shims.cpp"
+#include "../../tools/native/camera.cpp"
@@ -0,0 +1,309 @@
+// Command line parsing, dispatch and frame buffer sizing on the host, run by "pio test -e native".
+// Lines go through a loopbackTransport as loop() reads them from the serial or BLE link.
+
+#include <Arduino.h>
+#include <camera.h>
+#include <parser.h>
+#include <commands.h>
+#include <transport.h>
+#include "../../tools/native/simulation.h"
+
+#include <fcntl.h>
+#include <unity.h>
+
+#define COMMAND_LINE_WIDTH 128 // Same line buffer as src/main.cpp.
+
+static loopbackTransport loopback;
+static char commandLine[COMMAND_LINE_WIDTH];
+static char output[LOOPBACK_BYTES + 1];
+
+static void readCommandLine(const char* command){
+    loopback.feed(command);
+    loopback.feed("\r\n");
+    memset(commandLine, 0, sizeof(commandLine));
+    TEST_ASSERT_TRUE(loopback.readLine(commandLine, sizeof(commandLine)));
+}
+
+static const char* takeOutput(){
+    size_t length = loopback.take(output, LOOPBACK_BYTES);
+    output[length] = '\0';
+    return output;
+}
+
+// Parses the line against one command only and runs it, returns the command's status.
+static int runCommand(command_struct& command, const char* line){
+    readCommandLine(line);
+    argx_type argx = parseArgx(commandLine, sizeof(commandLine), true);
+    TEST_ASSERT_EQUAL_INT(0, arg_parse(argx.argc, argx.argv, command.argtable));
+    int status = command.function();
+    freeArgx(&argx);
+    arenaReset();
+    return status;
+}
+
+// The loop() path, the command is picked by executeCommands().
+static const char* executeLine(const char* line){
+    readCommandLine(line);
+    commandLink = &loopback;
+    argx_type argx = parseArgx(commandLine, sizeof(commandLine), true);
+    executeCommands(argx.argc, argx.argv);
+    freeArgx(&argx);
+    arenaReset();
+    return takeOutput();
+}
+
+void setUp(void){
+    commandLink = &loopback;
+    outputMode = OUTPUT_HUMAN;
+    machineLink.attach(&serialLink, false);
+    resetCameraWindow(&cameraRoi);
+    takeOutput();
+}
+
+void tearDown(void){
+    commandLink = &serialLink;
+}
+
+void test_parseArgx_splits_words(){
+    readCommandLine("setResolution 2");
+    argx_type argx = parseArgx(commandLine, sizeof(commandLine), true);
+    TEST_ASSERT_EQUAL_INT(3, argx.argc);
+    TEST_ASSERT_EQUAL_STRING("", argx.argv[0]);
+    TEST_ASSERT_EQUAL_STRING("setResolution", argx.argv[1]);
+    TEST_ASSERT_EQUAL_STRING("2", argx.argv[2]);
+    freeArgx(&argx);
+    TEST_ASSERT_EQUAL_INT(0, argx.argc);
+    TEST_ASSERT_NULL(argx.argv);
+    arenaReset();
+}
+
+void test_parseArgx_without_program_name(){
+    readCommandLine("stream start --frames 10");
+    argx_type argx = parseArgx(commandLine, sizeof(commandLine));
+    TEST_ASSERT_EQUAL_INT(4, argx.argc);
+    TEST_ASSERT_EQUAL_STRING("stream", argx.argv[0]);
+    TEST_ASSERT_EQUAL_STRING("start", argx.argv[1]);
+    TEST_ASSERT_EQUAL_STRING("--frames", argx.argv[2]);
+    TEST_ASSERT_EQUAL_STRING("10", argx.argv[3]);
+    freeArgx(&argx);
+    arenaReset();
+}
+
+void test_parseArgx_keeps_quoted_spaces(){
+    readCommandLine("profile define \"night mode\" --res 4 'a b'");
+    argx_type argx = parseArgx(commandLine, sizeof(commandLine), true);
+    TEST_ASSERT_EQUAL_INT(7, argx.argc);
+    TEST_ASSERT_EQUAL_STRING("\"night mode\"", argx.argv[3]);
+    TEST_ASSERT_EQUAL_STRING("--res", argx.argv[4]);
+    TEST_ASSERT_EQUAL_STRING("4", argx.argv[5]);
+    TEST_ASSERT_EQUAL_STRING("'a b'", argx.argv[6]);
+    freeArgx(&argx);
+    arenaReset();
+}
+
+void test_parseArgx_ignores_trailing_space(){
+    readCommandLine("help ");
+    argx_type argx = parseArgx(commandLine, sizeof(commandLine), true);
+    TEST_ASSERT_EQUAL_INT(2, argx.argc);
+    freeArgx(&argx);
+    arenaReset();
+}
+
+void test_parseArgx_uses_the_scratch_arena(){
+    readCommandLine("getCameraSettings --json");
+    size_t top = arenaScratch.top;
+    argx_type argx = parseArgx(commandLine, sizeof(commandLine), true);
+    TEST_ASSERT_TRUE(arenaOwns(&arenaScratch, argx.argdata));
+    TEST_ASSERT_TRUE(arenaOwns(&arenaScratch, argx.argv));
+    freeArgx(&argx);
+    TEST_ASSERT_EQUAL_size_t(top, arenaScratch.top);
+    arenaReset();
+}
+
+// A block for an empty request, also when the region has exactly one header left.
+void test_arenaAllocate_zero_size(){
+    arenaReset();
+    void* block = arenaAllocate(0);
+    TEST_ASSERT_TRUE(arenaOwns(&arenaScratch, block));
+    TEST_ASSERT_EQUAL_size_t(2 * ARENA_ALIGN, arenaScratch.top);
+    arenaFree(block);
+    TEST_ASSERT_EQUAL_size_t(0, arenaScratch.top);
+
+    void* filler = arenaAllocate(ARENA_SCRATCH_BYTES - 2 * ARENA_ALIGN);
+    TEST_ASSERT_EQUAL_size_t(ARENA_SCRATCH_BYTES - ARENA_ALIGN, arenaScratch.top);
+    uint32_t fallbacks = arenaScratch.fallbacks;
+    block = arenaAllocate(0);
+    TEST_ASSERT_NOT_NULL(block);
+    TEST_ASSERT_FALSE(arenaOwns(&arenaScratch, block));
+    TEST_ASSERT_EQUAL_UINT32(fallbacks + 1, arenaScratch.fallbacks);
+    arenaFree(block);
+    arenaFree(filler);
+    TEST_ASSERT_EQUAL_size_t(0, arenaScratch.top);
+}
+
+// main() ran setupCommands() and arenaSeal(): every command table must be in the object region, none on the heap.
+void test_setupCommands_fits_object_arena(){
+    TEST_ASSERT_EQUAL_UINT32(0, arenaObjects.fallbacks);
+    TEST_ASSERT_TRUE(arenaObjects.top <= ARENA_OBJECT_BYTES);
+}
+
+void test_setResolution_status(){
+    TEST_ASSERT_EQUAL_INT(COMMAND_OK, runCommand(setResolution_command, "setResolution 3"));
+    TEST_ASSERT_EQUAL_UINT8(QCIF, cameraResolution);
+    TEST_ASSERT_EQUAL_INT(COMMAND_FAILED, runCommand(setResolution_command, "setResolution 9"));
+    TEST_ASSERT_EQUAL_UINT8(QCIF, cameraResolution);
+    TEST_ASSERT_EQUAL_INT(COMMAND_FAILED, runCommand(setResolution_command, "setResolution"));
+    TEST_ASSERT_EQUAL_INT(COMMAND_OK, runCommand(setResolution_command, "setResolution --help"));
+    TEST_ASSERT_EQUAL_INT(COMMAND_OK, runCommand(setResolution_command, "setResolution 2"));
+    TEST_ASSERT_EQUAL_UINT8(QVGA, cameraResolution);
+}
+
+void test_setFormat_status(){
+    TEST_ASSERT_EQUAL_INT(COMMAND_OK, runCommand(setFormat_command, "setFormat 3"));
+    TEST_ASSERT_EQUAL_UINT8(GRAYSCALE, cameraFormat);
+    TEST_ASSERT_EQUAL_INT(COMMAND_FAILED, runCommand(setFormat_command, "setFormat 7"));
+    TEST_ASSERT_EQUAL_UINT8(GRAYSCALE, cameraFormat);
+    TEST_ASSERT_EQUAL_INT(COMMAND_OK, runCommand(setFormat_command, "setFormat 2"));
+    TEST_ASSERT_EQUAL_UINT8(RGB565, cameraFormat);
+}
+
+void test_getCameraSettings_status(){
+    TEST_ASSERT_EQUAL_INT(COMMAND_OK, runCommand(getCameraSettings_command, "getCameraSettings --json"));
+    const char* json = takeOutput();
+    TEST_ASSERT_TRUE(strncmp(json, "{\"model\":", 9) == 0);
+    TEST_ASSERT_NOT_NULL(strstr(json, "\"width\":320,\"height\":240"));
+    TEST_ASSERT_EQUAL_INT(COMMAND_FAILED, runCommand(getCameraSettings_command, "getCameraSettings --json --cbor"));
+}
+
+// Every head size of cborHead(): 1 byte below 24, 2 up to 0xFF, 3 up to 0xFFFF (320) and 5 above (1 fps frame period).
+void test_cameraSettingsCbor_encoding(){
+    cameraSettings settings = {"OV7675", "QVGA", 320, 240, "RGB565", 320, 240, 2, 153600, 1, 1000000, {0, 0, 320, 240, 1},
+                               {8, 25, 24, 9, 1, 10, 0, 2, 3, 5, 6, 200}};
+    static const byte expected[] = {
+        0xAD, 0x65, 0x6D, 0x6F, 0x64, 0x65, 0x6C, 0x66, 0x4F, 0x56, 0x37, 0x36, 0x37, 0x35, 0x6A, 0x72,
+        0x65, 0x73, 0x6F, 0x6C, 0x75, 0x74, 0x69, 0x6F, 0x6E, 0x64, 0x51, 0x56, 0x47, 0x41, 0x6B, 0x73,
+        0x65, 0x6E, 0x73, 0x6F, 0x72, 0x57, 0x69, 0x64, 0x74, 0x68, 0x19, 0x01, 0x40, 0x6C, 0x73, 0x65,
+        0x6E, 0x73, 0x6F, 0x72, 0x48, 0x65, 0x69, 0x67, 0x68, 0x74, 0x18, 0xF0, 0x66, 0x66, 0x6F, 0x72,
+        0x6D, 0x61, 0x74, 0x66, 0x52, 0x47, 0x42, 0x35, 0x36, 0x35, 0x65, 0x77, 0x69, 0x64, 0x74, 0x68,
+        0x19, 0x01, 0x40, 0x66, 0x68, 0x65, 0x69, 0x67, 0x68, 0x74, 0x18, 0xF0, 0x6D, 0x62, 0x79, 0x74,
+        0x65, 0x73, 0x50, 0x65, 0x72, 0x50, 0x69, 0x78, 0x65, 0x6C, 0x02, 0x6A, 0x66, 0x72, 0x61, 0x6D,
+        0x65, 0x42, 0x79, 0x74, 0x65, 0x73, 0x1A, 0x00, 0x02, 0x58, 0x00, 0x63, 0x66, 0x70, 0x73, 0x01,
+        0x6D, 0x66, 0x72, 0x61, 0x6D, 0x65, 0x50, 0x65, 0x72, 0x69, 0x6F, 0x64, 0x55, 0x73, 0x1A, 0x00,
+        0x0F, 0x42, 0x40, 0x66, 0x77, 0x69, 0x6E, 0x64, 0x6F, 0x77, 0xA5, 0x61, 0x78, 0x00, 0x61, 0x79,
+        0x00, 0x65, 0x77, 0x69, 0x64, 0x74, 0x68, 0x19, 0x01, 0x40, 0x66, 0x68, 0x65, 0x69, 0x67, 0x68,
+        0x74, 0x18, 0xF0, 0x65, 0x73, 0x63, 0x61, 0x6C, 0x65, 0x01, 0x64, 0x70, 0x69, 0x6E, 0x73, 0xA5,
+        0x65, 0x76, 0x73, 0x79, 0x6E, 0x63, 0x08, 0x64, 0x68, 0x72, 0x65, 0x66, 0x18, 0x19, 0x64, 0x70,
+        0x63, 0x6C, 0x6B, 0x18, 0x18, 0x64, 0x78, 0x63, 0x6C, 0x6B, 0x09, 0x64, 0x64, 0x61, 0x74, 0x61,
+        0x88, 0x01, 0x0A, 0x00, 0x02, 0x03, 0x05, 0x06, 0x18, 0xC8,
+    };
+    byte document[CAMERA_SETTINGS_DOCUMENT_BYTES];
+    TEST_ASSERT_EQUAL_size_t(sizeof(expected), cameraSettingsCbor(&settings, document, sizeof(document)));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, document, sizeof(expected));
+    TEST_ASSERT_EQUAL_size_t(0, cameraSettingsCbor(&settings, document, sizeof(expected) - 1));
+}
+
+// The longest names and the widest values still fit the document buffer, in both encodings.
+void test_cameraSettings_fit_the_document(){
+    cameraSettings settings = {"UNKNOWN", "UNKNOWN", UINT16_MAX, UINT16_MAX, "GRAYSCALE", UINT16_MAX, UINT16_MAX, UINT8_MAX,
+                               UINT32_MAX, UINT8_MAX, UINT32_MAX, {UINT16_MAX, UINT16_MAX, UINT16_MAX, UINT16_MAX, UINT8_MAX}, {}};
+    memset(settings.pins, UINT8_MAX, sizeof(settings.pins));
+    byte document[CAMERA_SETTINGS_DOCUMENT_BYTES];
+    TEST_ASSERT_TRUE(cameraSettingsJson(&settings, (char*) document, sizeof(document)) != 0);
+    TEST_ASSERT_TRUE(cameraSettingsCbor(&settings, document, sizeof(document)) != 0);
+}
+
+// 65537 would reach chunkTransferAck() as chunk 1 once cut to 16 bits.
+void test_transfer_ack_range(){
+    TEST_ASSERT_EQUAL_INT(COMMAND_FAILED, runCommand(transferAck_command, "transfer ack 3"));
+    TEST_ASSERT_EQUAL_INT(COMMAND_FAILED, runCommand(transferAck_command, "transfer ack 65537"));
+    TEST_ASSERT_EQUAL_INT(COMMAND_FAILED, runCommand(transferAck_command, "transfer ack"));
+    TEST_ASSERT_EQUAL_INT(COMMAND_FAILED, runCommand(transferNack_command, "transfer nack 65537"));
+    TEST_ASSERT_NOT_NULL(strstr(takeOutput(), "Invalid transfer nack"));
+}
+
+// Fields too long for the record are cut, its micros and "\r\n" are still sent.
+void test_postEvent_keeps_suffix(){
+    events.classes = EVENT_ERROR;
+    events.link = &loopback;
+    postEvent(EVENT_ERROR, 4294967295UL, "error %s", "abandoned abandoned abandoned abandoned");
+    events.classes = 0;
+    events.link = NULL;
+    const char* record = takeOutput();
+    TEST_ASSERT_EQUAL_size_t(EVENT_RECORD_BYTES - 1, strlen(record));
+    TEST_ASSERT_EQUAL_STRING(" 4294967295\r\n", record + strlen(record) - EVENT_SUFFIX_BYTES);
+    TEST_ASSERT_TRUE(strncmp(record, "EVENT error abandoned", 21) == 0);
+}
+
+void test_executeCommands_unknown(){
+    TEST_ASSERT_NOT_NULL(strstr(executeLine("setResolutions 2"), "Invalid command"));
+    TEST_ASSERT_NOT_NULL(strstr(executeLine("help"), "setResolution"));
+}
+
+// The record carries executeCommands()' status: "R <id> <status> <micros> <payload bytes>\r\n".
+void test_executeCommands_machine_status(){
+    TEST_ASSERT_TRUE(strncmp(executeLine("mode machine"), "R 20 0 ", 7) == 0);
+    TEST_ASSERT_TRUE(strncmp(executeLine("setResolution 2"), "R 01 0 ", 7) == 0);
+    TEST_ASSERT_TRUE(strncmp(executeLine("setResolution 9"), "R 01 1 ", 7) == 0);
+    TEST_ASSERT_TRUE(strncmp(executeLine("takePhotos"), "R 99 3 ", 7) == 0);
+    TEST_ASSERT_TRUE(strncmp(executeLine("mode human"), "R 21 0 ", 7) == 0);
+    TEST_ASSERT_EQUAL_UINT8(OUTPUT_HUMAN, outputMode);
+}
+
+void test_setupFrameBuffer_sizes(){
+    const size_t pixels[5] = {640 * 480, 352 * 240, 320 * 240, 176 * 144, 160 * 120};
+    const uint8_t formats[4] = {YUV422, RGB444, RGB565, GRAYSCALE};
+    uint8_t resolution = cameraResolution;
+    uint8_t format = cameraFormat;
+    byte* buffer = NULL;
+    size_t size = 0;
+    for(uint8_t index = 0; index < 5; index++){
+        for(uint8_t formatIndex = 0; formatIndex < 4; formatIndex++){
+            cameraResolution = index;
+            cameraFormat = formats[formatIndex];
+            TEST_ASSERT_EQUAL_INT(0, setupFrameBuffer(&buffer, &size));
+            TEST_ASSERT_NOT_NULL(buffer);
+            TEST_ASSERT_EQUAL_size_t(pixels[index] * formatBytesPerPixel(cameraFormat), size);
+        }
+    }
+    cameraResolution = QVGA;
+    cameraFormat = RGB565;
+    cameraRoi = {10, 20, 101, 60, 2};
+    TEST_ASSERT_EQUAL_INT(0, setupFrameBuffer(&buffer, &size));
+    TEST_ASSERT_EQUAL_size_t(51 * 30 * 2, size);
+    freeFrameBuffer(&buffer);
+    TEST_ASSERT_NULL(buffer);
+    cameraResolution = resolution;
+    cameraFormat = format;
+}
+
+int main(int argc, char** argv){
+    simulation.beginMillis = 0;
+    Serial.fd = open("/dev/null", O_WRONLY);
+    Serial.begin(115200);
+    commandLink = &loopback;
+    setupCamera(1);
+    arenaBegin();
+    setupCommands();
+    arenaSeal();
+    takeOutput();
+
+    UNITY_BEGIN();
+    RUN_TEST(test_parseArgx_splits_words);
+    RUN_TEST(test_parseArgx_without_program_name);
+    RUN_TEST(test_parseArgx_keeps_quoted_spaces);
+    RUN_TEST(test_parseArgx_ignores_trailing_space);
+    RUN_TEST(test_parseArgx_uses_the_scratch_arena);
+    RUN_TEST(test_arenaAllocate_zero_size);
+    RUN_TEST(test_setupCommands_fits_object_arena);
+    RUN_TEST(test_setResolution_status);
+    RUN_TEST(test_setFormat_status);
+    RUN_TEST(test_getCameraSettings_status);
+    RUN_TEST(test_cameraSettingsCbor_encoding);
+    RUN_TEST(test_cameraSettings_fit_the_document);
+    RUN_TEST(test_transfer_ack_range);
+    RUN_TEST(test_postEvent_keeps_suffix);
+    RUN_TEST(test_executeCommands_unknown);
+    RUN_TEST(test_executeCommands_machine_status);
+    RUN_TEST(test_setupFrameBuffer_sizes);
+    return UNITY_END();
+}
@@ -0,0 +1,129 @@
+// spscRing on the host, run by "pio test -e native --filter test_ring".
+
+#include <ring.h>
+
+#include <thread>
+#include <unity.h>
+
+#define RING_TEST_CAPACITY 8
+#define RING_TEST_VALUES 1000000    // Pushed through by the two thread test, many times around the ring.
+
+static spscRing<uint32_t, RING_TEST_CAPACITY> ring;
+
+void setUp(void){
+    ring.clear();
+}
+
+void tearDown(void){
+}
+
+void test_empty_ring(){
+    uint32_t value = 0;
+    TEST_ASSERT_TRUE(ring.empty());
+    TEST_ASSERT_EQUAL_size_t(0, ring.size());
+    TEST_ASSERT_NULL(ring.peek());
+    TEST_ASSERT_FALSE(ring.pop(value));
+    TEST_ASSERT_TRUE(ring.push(1));
+    TEST_ASSERT_TRUE(ring.pop(value));
+    TEST_ASSERT_EQUAL_UINT32(1, value);
+    TEST_ASSERT_TRUE(ring.empty());
+    TEST_ASSERT_NULL(ring.peek());
+}
+
+void test_full_ring(){
+    for(uint32_t index = 0; index < RING_TEST_CAPACITY; index++){
+        TEST_ASSERT_TRUE(ring.push(index));
+    }
+    TEST_ASSERT_EQUAL_size_t(RING_TEST_CAPACITY, ring.size());
+    TEST_ASSERT_NULL(ring.claim());
+    TEST_ASSERT_FALSE(ring.push(RING_TEST_CAPACITY));
+
+    uint32_t value = 0;
+    TEST_ASSERT_TRUE(ring.pop(value));
+    TEST_ASSERT_EQUAL_UINT32(0, value);
+    TEST_ASSERT_TRUE(ring.push(RING_TEST_CAPACITY));
+    TEST_ASSERT_FALSE(ring.push(RING_TEST_CAPACITY + 1));
+    for(uint32_t index = 1; index <= RING_TEST_CAPACITY; index++){
+        TEST_ASSERT_TRUE(ring.pop(value));
+        TEST_ASSERT_EQUAL_UINT32(index, value);
+    }
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+void test_claim_returns_the_same_slot_until_commit(){
+    uint32_t* slot = ring.claim();
+    TEST_ASSERT_NOT_NULL(slot);
+    *slot = 7;
+    TEST_ASSERT_EQUAL_PTR(slot, ring.claim());
+    TEST_ASSERT_NULL(ring.peek());              // Not published before commit().
+    ring.commit();
+
+    uint32_t* next = ring.claim();
+    TEST_ASSERT_NOT_NULL(next);
+    TEST_ASSERT_TRUE(next != slot);
+    TEST_ASSERT_EQUAL_PTR(slot, ring.peek());
+    TEST_ASSERT_EQUAL_PTR(slot, ring.peek());   // The same slot until release().
+    TEST_ASSERT_EQUAL_UINT32(7, *ring.peek());
+    ring.release();
+    TEST_ASSERT_NULL(ring.peek());
+}
+
+void test_indices_wrap_past_SIZE_MAX(){
+    ring.clear(SIZE_MAX - 2);
+    uint32_t value = 0;
+    uint32_t expected = 0;
+    for(uint32_t index = 0; index < 3 * RING_TEST_CAPACITY; index++){
+        TEST_ASSERT_TRUE(ring.push(index));
+        TEST_ASSERT_EQUAL_size_t(1, ring.size());
+        TEST_ASSERT_TRUE(ring.pop(value));
+        TEST_ASSERT_EQUAL_UINT32(expected++, value);
+    }
+
+    ring.clear(SIZE_MAX - RING_TEST_CAPACITY / 2);
+    for(uint32_t index = 0; index < RING_TEST_CAPACITY; index++){
+        TEST_ASSERT_TRUE(ring.push(index));
+        TEST_ASSERT_EQUAL_size_t(index + 1, ring.size());
+    }
+    TEST_ASSERT_FALSE(ring.push(RING_TEST_CAPACITY));  // Full with head past zero and tail below SIZE_MAX.
+    for(uint32_t index = 0; index < RING_TEST_CAPACITY; index++){
+        TEST_ASSERT_TRUE(ring.pop(value));
+        TEST_ASSERT_EQUAL_UINT32(index, value);
+    }
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+// One producer and one consumer thread, the values come out in order, none lost or repeated.
+void test_two_threads_keep_order(){
+    ring.clear(SIZE_MAX - RING_TEST_VALUES / 2);
+    std::thread producer([](){
+        for(uint32_t index = 0; index < RING_TEST_VALUES; index++){
+            while(!ring.push(index)){
+                std::this_thread::yield();
+            }
+        }
+    });
+    uint32_t expected = 0;
+    uint32_t outOfOrder = 0;
+    uint32_t value = 0;
+    while(expected < RING_TEST_VALUES){
+        if(!ring.pop(value)){
+            std::this_thread::yield();
+            continue;
+        }
+        outOfOrder += (value != expected);
+        expected++;
+    }
+    producer.join();
+    TEST_ASSERT_EQUAL_UINT32(0, outOfOrder);
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+int main(int argc, char** argv){
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_ring);
+    RUN_TEST(test_full_ring);
+    RUN_TEST(test_claim_returns_the_same_slot_until_commit);
+    RUN_TEST(test_indices_wrap_past_SIZE_MAX);
+    RUN_TEST(test_two_threads_keep_order);
+    return UNITY_END();
+}
@@ -0,0 +1,170 @@
+"""End-to-end throughput benchmark over resolution x format x encoding.
+
+Drives the firmware command set (setResolution, setFormat, getCameraSettings,
+takePhoto) through the savePhoto.py transport on a single open connection, so
+it runs unchanged against a board or the pty simulator. For every combination
+it records command latency, capture time (command to first payload byte),
+transfer time (first to last byte), bytes per frame and sustained fps, then
+writes the results as JSON and prints a summary table.
+"""
+
+import argparse
+import json
+import re
+import sys
+import time
+
+import cv2 as cv
+import frameDecode
+import rawContainer
+import savePhoto
+
+# Index sent to setResolution/setFormat, as listed by "setResolution --help" and "setFormat --help".
+resolutions = ["VGA", "CIF", "QVGA", "QCIF", "QQVGA"]
+formats = ["YUV422", "RGB444", "RGB565", "GRAYSCALE"]
+encodings = ["raw", "jpeg", "png"]
+
+defaultFrames = 5
+defaultTimeout = 10
+terminalLine = re.compile(rb"applied correctly\.|Unexpected error|Invalid|Missing")
+
+def readResponse(serialDevice, timeout):
+    """Reads response lines until a line that ends a configuration command."""
+    lines = []
+    deadline = time.perf_counter() + timeout
+    while time.perf_counter() < deadline:
+        line = serialDevice.read_until(b"\r\n")
+        if not line:
+            continue
+        lines.append(line)
+        if terminalLine.search(line):
+            break
+    return lines
+
+def runCommand(serialDevice, message, timeout):
+    serialDevice.reset_input_buffer()
+    start = time.perf_counter()
+    serialDevice.write((message + savePhoto.defaultCommandTerminator).encode("utf-8"))
+    lines = readResponse(serialDevice, timeout)
+    elapsed = time.perf_counter() - start
+    succeeded = bool(lines) and b"applied correctly" in lines[-1]
+    return elapsed, succeeded, lines
+
+def readSettings(serialDevice):
+    serialDevice.reset_input_buffer()
+    settings = savePhoto.readCameraSettings(serialDevice)
+    return settings["width"], settings["height"], rawContainer.formatFromName(settings["format"])
+
+def captureFrame(serialDevice, frameSize, timeout):
+    serialDevice.reset_input_buffer()
+    start = time.perf_counter()
+    serialDevice.write(("takePhoto" + savePhoto.defaultCommandTerminator).encode("utf-8"))
+
+    firstByte = serialDevice.read(1)
+    if not firstByte:
+        return None
+    firstByteTime = time.perf_counter()
+
+    payload = firstByte + serialDevice.read(frameSize + len(savePhoto.defaultStopBytes) - 1)
+    end = time.perf_counter()
+    if len(payload) < frameSize:
+        return None
+    return firstByteTime - start, end - firstByteTime, payload[:frameSize]
+
+def encodeFrame(payload, width, height, photoFormat, encoding):
+    if encoding == "raw":
+        return 0.0, len(payload)
+    start = time.perf_counter()
+    image = frameDecode.decodeFrame(payload, width, height, photoFormat)
+    encoded, data = cv.imencode(".jpg" if encoding == "jpeg" else ".png", image)
+    elapsed = time.perf_counter() - start
+    return elapsed, len(data) if encoded else 0
+
+def mean(values):
+    return sum(values) / len(values) if values else 0.0
+
+def benchmarkCombination(serialDevice, resolution, photoFormat, selectedEncodings, frames, timeout):
+    result = {"resolution": resolution, "format": photoFormat, "status": "ok"}
+
+    resolutionLatency, resolutionApplied, _ = runCommand(serialDevice, f"setResolution {resolutions.index(resolution)}", timeout)
+    formatLatency, formatApplied, _ = runCommand(serialDevice, f"setFormat {formats.index(photoFormat)}", timeout)
+    result["setResolutionLatency"] = resolutionLatency
+    result["setFormatLatency"] = formatLatency
+    if not resolutionApplied or not formatApplied:
+        result["status"] = "configurationFailed"
+        return result
+
+    width, height, formatCode = readSettings(serialDevice)
+    frameSize = width * height * rawContainer.formatBytesPerPixel[formatCode]
+    result.update({"width": width, "height": height, "bytesPerFrame": frameSize})
+
+    captureFrame(serialDevice, frameSize, timeout) # Warm up, the first frame after a reconfiguration is often unstable.
+
+    captureTimes = []
+    transferTimes = []
+    lastPayload = None
+    start = time.perf_counter()
+    for _ in range(frames):
+        frame = captureFrame(serialDevice, frameSize, timeout)
+        if frame is None:
+            result["status"] = "captureFailed"
+            break
+        captureTimes.append(frame[0])
+        transferTimes.append(frame[1])
+        lastPayload = frame[2]
+    elapsed = time.perf_counter() - start
+
+    result["frames"] = len(captureTimes)
+    result["captureTime"] = mean(captureTimes)
+    result["transferTime"] = mean(transferTimes)
+    result["transferRate"] = frameSize / result["transferTime"] if result["transferTime"] > 0 else 0.0
+    result["fps"] = len(captureTimes) / elapsed if captureTimes else 0.0
+
+    result["encodings"] = {}
+    if lastPayload is not None:
+        for encoding in selectedEncodings:
+            encodeTime, encodedSize = encodeFrame(lastPayload, width, height, formatCode, encoding)
+            result["encodings"][encoding] = {"encodeTime": encodeTime, "bytes": encodedSize, "ratio": frameSize / encodedSize if encodedSize else 0.0}
+    return result
+
+def printSummary(results):
+    header = f"{'resolution':<10} {'format':<10} {'bytes':>8} {'setRes ms':>10} {'setFmt ms':>10} {'capture ms':>11} {'transfer ms':>12} {'kB/s':>8} {'fps':>7} {'jpeg x':>7} {'png x':>7}  status"
+    print(header)
+    print("-" * len(header))
+    for result in sorted(results, key=lambda result: result.get("fps", 0.0), reverse=True):
+        encodingsResult = result.get("encodings", {})
+        print(f"{result['resolution']:<10} {result['format']:<10} {result.get('bytesPerFrame', 0):>8} "
+              f"{1000 * result['setResolutionLatency']:>10.1f} {1000 * result['setFormatLatency']:>10.1f} "
+              f"{1000 * result.get('captureTime', 0.0):>11.1f} {1000 * result.get('transferTime', 0.0):>12.1f} "
+              f"{result.get('transferRate', 0.0) / 1000:>8.1f} {result.get('fps', 0.0):>7.2f} "
+              f"{encodingsResult.get('jpeg', {}).get('ratio', 0.0):>7.1f} {encodingsResult.get('png', {}).get('ratio', 0.0):>7.1f}  {result['status']}")
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark frame throughput for every resolution/format combination")
+    parser.add_argument("--port", "-p", type=str, required=True, help="Serial port of the board or simulator")
+    parser.add_argument("--baudrate", "-b", type=int, help="Baud rate", default=115200)
+    parser.add_argument("--resolutions", type=str, nargs="+", choices=resolutions, default=resolutions)
+    parser.add_argument("--formats", type=str, nargs="+", choices=formats, default=formats)
+    parser.add_argument("--encodings", type=str, nargs="+", choices=encodings, default=encodings)
+    parser.add_argument("--frames", "-n", type=int, help="Frames per combination", default=defaultFrames)
+    parser.add_argument("--timeout", "-t", type=float, help="Timeout per command in seconds", default=defaultTimeout)
+    parser.add_argument("--output", "-o", type=str, help="JSON results file", default="benchmark.json")
+
+    args = parser.parse_args()
+
+    results = []
+    with savePhoto.openDevice(args.port, args.baudrate, timeout=args.timeout) as serialDevice:
+        for resolution in args.resolutions:
+            for photoFormat in args.formats:
+                result = benchmarkCombination(serialDevice, resolution, photoFormat, args.encodings, args.frames, args.timeout)
+                print(f"{resolution}/{photoFormat}: {result['status']}, {result.get('fps', 0.0):.2f} fps", file=sys.stderr)
+                results.append(result)
+
+    with open(args.output, "w") as outputFile:
+        json.dump({"port": args.port, "baudrate": args.baudrate, "frames": args.frames, "results": results}, outputFile, indent=2)
+
+    printSummary(results)
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
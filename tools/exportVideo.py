@@ -0,0 +1,260 @@
+"""Streams captured frames into Y4M (raw YUV) or MJPEG AVI files.
+
+Frames come from .n3raw containers or live from the device and are converted
+one by one: decoding and encoding run on a process pool with a bounded window
+of frames in flight, the AVI index is spooled to a temporary file, so memory
+stays constant whatever the length of the capture.
+"""
+
+import argparse
+import os
+import struct
+import sys
+import tempfile
+from collections import deque, namedtuple
+from fractions import Fraction
+from multiprocessing import Pool
+
+import cv2 as cv
+import frameDecode
+import rawContainer
+import savePhoto
+
+defaultFPS = 5
+defaultJpegQuality = 90
+defaultWorkers = os.cpu_count() or 1
+defaultWindowPerWorker = 4
+defaultSegmentSize = 1 << 30 # AVI 1.0 readers expect RIFF chunks below 1 GiB.
+
+SourceFrame = namedtuple("SourceFrame", ["width", "height", "format", "timestamp", "payload"])
+
+def containerFrames(paths):
+    for path in paths:
+        with rawContainer.RawContainerReader(path) as container:
+            for frame in container:
+                yield SourceFrame(frame.width, frame.height, frame.format, frame.timestamp, bytes(frame.payload))
+
+def liveFrames(port, baudrate, frames, timeout=savePhoto.defaultTimeout):
+    savePhoto.getCameraConfig(port=port, baudrate=baudrate, timeout=timeout)
+    photoFormat = rawContainer.formatFromName(savePhoto.cameraFormat)
+    frameSize = savePhoto.cameraResolutionWidth * savePhoto.cameraResolutionHeight * rawContainer.formatBytesPerPixel[photoFormat]
+
+    frameIndex = 0
+    while frames == 0 or frameIndex < frames:
+        response = savePhoto.communicate_device(
+            port=port,
+            baudrate=baudrate,
+            message="takePhoto",
+            timeout=savePhoto.requestPhotoTimeoutMultiply * timeout,
+            encodeInput=True,
+            encodeOutput=False,
+            printSent=False,
+            printReceived=False,
+            maxSize=frameSize + len(savePhoto.defaultStopBytes),
+            stopBytes=None
+        )
+        if response is None or len(response) < frameSize:
+            print(f"Frame {frameIndex} incomplete, skipped.", file=sys.stderr)
+        else:
+            yield SourceFrame(savePhoto.cameraResolutionWidth, savePhoto.cameraResolutionHeight, photoFormat, 0, response[:frameSize])
+        frameIndex += 1
+
+def encodeJpegTask(task):
+    frame, quality = task
+    image = frameDecode.decodeFrame(frame.payload, frame.width, frame.height, frame.format)
+    encoded, jpeg = cv.imencode(".jpg", image, [cv.IMWRITE_JPEG_QUALITY, quality])
+    if not encoded:
+        raise RuntimeError("JPEG encoding failed")
+    return frame.width, frame.height, jpeg.tobytes()
+
+def encodePlanesTask(task):
+    frame, chroma = task
+    return frame.width, frame.height, frameDecode.framePlanes(frame.payload, frame.width, frame.height, frame.format, chroma)
+
+def orderedMap(pool, function, tasks, window):
+    """Like Pool.imap, but never reads more than window tasks ahead of the consumer."""
+    pending = deque()
+    for task in tasks:
+        pending.append(pool.apply_async(function, (task,)))
+        if len(pending) >= window:
+            yield pending.popleft().get()
+    while pending:
+        yield pending.popleft().get()
+
+class Y4MWriter:
+    def __init__(self, path, width, height, fps, chroma):
+        rate = Fraction(fps).limit_denominator(1000)
+        self.file = open(path, "wb")
+        self.file.write(f"YUV4MPEG2 W{width} H{height} F{rate.numerator}:{rate.denominator} Ip A1:1 C{chroma} XCOLORRANGE=FULL\n".encode("ascii"))
+        self.frameCount = 0
+
+    def write(self, planes):
+        self.file.write(b"FRAME\n")
+        self.file.write(planes)
+        self.frameCount += 1
+
+    def close(self):
+        self.file.close()
+
+class MjpegAviWriter:
+    """AVI 1.0 writer, rolls over to a new numbered file when a segment reaches segmentSize."""
+
+    def __init__(self, path, width, height, fps, segmentSize=defaultSegmentSize):
+        self.basePath, self.extension = os.path.splitext(path)
+        self.width = width
+        self.height = height
+        self.rate = Fraction(fps).limit_denominator(1000)
+        self.segmentSize = segmentSize
+        self.segmentIndex = 0
+        self.totalFrames = 0
+        self.file = None
+        self.paths = []
+        self._openSegment()
+
+    def _segmentPath(self):
+        if self.segmentIndex == 0:
+            return self.basePath + self.extension
+        return f"{self.basePath}_{self.segmentIndex:03d}{self.extension}"
+
+    def _openSegment(self):
+        path = self._segmentPath()
+        self.paths.append(path)
+        self.file = open(path, "w+b")
+        self.index = tempfile.TemporaryFile()
+        self.frameCount = 0
+        self.maxFrameSize = 0
+
+        microSecPerFrame = round(1000000 * self.rate.denominator / self.rate.numerator)
+        avih = struct.pack("<IIIIIIIIII16x", microSecPerFrame, 0, 0, 0x10, 0, 0, 1, 0, self.width, self.height)
+        strh = struct.pack("<4s4sIHHIIIIIIIIhhhh", b"vids", b"MJPG", 0, 0, 0, 0, self.rate.denominator, self.rate.numerator, 0, 0, 0, 0xFFFFFFFF, 0, 0, 0, self.width, self.height)
+        strf = struct.pack("<IiiHH4sIiiII", 40, self.width, self.height, 1, 24, b"MJPG", self.width * self.height * 3, 0, 0, 0, 0)
+        strl = b"strl" + self._chunk(b"strh", strh) + self._chunk(b"strf", strf)
+        hdrl = b"hdrl" + self._chunk(b"avih", avih) + self._chunk(b"LIST", strl)
+
+        self.file.write(b"RIFF\0\0\0\0AVI ")
+        self.avihOffset = self.file.tell() + 12 + 8
+        self.strhOffset = self.avihOffset + len(avih) + 12 + 8
+        self.file.write(self._chunk(b"LIST", hdrl))
+        self.moviOffset = self.file.tell()
+        self.file.write(b"LIST\0\0\0\0movi")
+
+    @staticmethod
+    def _chunk(fourcc, data):
+        padding = b"\0" if len(data) & 1 else b""
+        return fourcc + struct.pack("<I", len(data)) + data + padding
+
+    def _closeSegment(self):
+        moviEnd = self.file.tell()
+        self.index.seek(0)
+        self.file.write(b"idx1" + struct.pack("<I", self.frameCount * 16))
+        while True:
+            entries = self.index.read(1 << 16)
+            if not entries:
+                break
+            self.file.write(entries)
+        self.index.close()
+        riffEnd = self.file.tell()
+
+        self.file.seek(4)
+        self.file.write(struct.pack("<I", riffEnd - 8))
+        self.file.seek(self.avihOffset + 16)
+        self.file.write(struct.pack("<I", self.frameCount))
+        self.file.seek(self.avihOffset + 28)
+        self.file.write(struct.pack("<I", self.maxFrameSize))
+        self.file.seek(self.strhOffset + 32)
+        self.file.write(struct.pack("<II", self.frameCount, self.maxFrameSize))
+        self.file.seek(self.moviOffset + 4)
+        self.file.write(struct.pack("<I", moviEnd - self.moviOffset - 8))
+        self.file.close()
+
+    def write(self, jpeg):
+        chunkSize = 8 + len(jpeg) + (len(jpeg) & 1)
+        if self.frameCount > 0 and self.file.tell() + chunkSize + 16 * (self.frameCount + 1) + 8 > self.segmentSize:
+            self._closeSegment()
+            self.segmentIndex += 1
+            self._openSegment()
+
+        chunkOffset = self.file.tell() - (self.moviOffset + 8)
+        self.file.write(self._chunk(b"00dc", jpeg))
+        self.index.write(b"00dc" + struct.pack("<III", 0x10, chunkOffset, len(jpeg)))
+        self.frameCount += 1
+        self.totalFrames += 1
+        self.maxFrameSize = max(self.maxFrameSize, len(jpeg))
+
+    def close(self):
+        self._closeSegment()
+
+def defaultChroma(photoFormat):
+    if photoFormat == rawContainer.formatYUV422:
+        return "422"
+    if photoFormat == rawContainer.formatGRAYSCALE:
+        return "mono"
+    return "444"
+
+def exportVideo(frames, outputPath, outputFormat, fps=defaultFPS, chroma=None, quality=defaultJpegQuality, workers=defaultWorkers, segmentSize=defaultSegmentSize):
+    frames = iter(frames)
+    firstFrame = next(frames, None)
+    if firstFrame is None:
+        print("No frames to export.")
+        return 0
+
+    def allFrames():
+        yield firstFrame
+        yield from frames
+
+    if outputFormat == "y4m":
+        chroma = chroma or defaultChroma(firstFrame.format)
+        writer = Y4MWriter(outputPath, firstFrame.width, firstFrame.height, fps, chroma)
+        function, tasks = encodePlanesTask, ((frame, chroma) for frame in allFrames())
+    else:
+        writer = MjpegAviWriter(outputPath, firstFrame.width, firstFrame.height, fps, segmentSize)
+        function, tasks = encodeJpegTask, ((frame, quality) for frame in allFrames())
+
+    skipped = 0
+    try:
+        with Pool(workers) as pool:
+            for width, height, data in orderedMap(pool, function, tasks, workers * defaultWindowPerWorker):
+                if (width, height) != (firstFrame.width, firstFrame.height):
+                    skipped += 1 # Both containers need a fixed frame size.
+                    continue
+                writer.write(data)
+    finally:
+        writer.close() # Keeps the output playable when a live capture is interrupted.
+
+    if skipped:
+        print(f"{skipped} frames skipped because their resolution differs from the first frame.")
+    print(f"{writer.frameCount if outputFormat == 'y4m' else writer.totalFrames} frames exported to {outputPath}")
+    return 0
+
+def main():
+    parser = argparse.ArgumentParser(description="Export captured frames to Y4M or MJPEG AVI")
+    parser.add_argument("output", type=str, help="Output file (.y4m or .avi)")
+    parser.add_argument("--input", "-i", type=str, nargs="+", help="Raw .n3raw containers to export")
+    parser.add_argument("--port", "-p", type=str, help="Capture live from the device on this serial port")
+    parser.add_argument("--baudrate", "-b", type=int, help="Baud rate", default=115200)
+    parser.add_argument("--frames", "-n", type=int, help="Frames to capture live, 0 captures until interrupted", default=0)
+    parser.add_argument("--format", "-f", choices=["y4m", "avi"], help="Output format (default from the output extension)")
+    parser.add_argument("--fps", type=float, help="Output frame rate", default=defaultFPS)
+    parser.add_argument("--chroma", choices=["420jpeg", "422", "444", "mono"], help="Y4M chroma layout (default from the frame format)")
+    parser.add_argument("--quality", "-q", type=int, help="JPEG quality", default=defaultJpegQuality)
+    parser.add_argument("--workers", "-w", type=int, help="Encoding processes", default=defaultWorkers)
+    parser.add_argument("--segmentSize", type=int, help="Maximum AVI segment size in bytes", default=defaultSegmentSize)
+
+    args = parser.parse_args()
+    outputFormat = args.format or ("y4m" if args.output.lower().endswith(".y4m") else "avi")
+
+    if args.input:
+        frames = containerFrames(args.input)
+    elif args.port:
+        frames = liveFrames(args.port, args.baudrate, args.frames)
+    else:
+        parser.error("either --input or --port is required")
+
+    try:
+        return exportVideo(frames, args.output, outputFormat, args.fps, args.chroma, args.quality, args.workers, args.segmentSize)
+    except KeyboardInterrupt:
+        print("Export interrupted.")
+        return 1
+
+if __name__ == "__main__":
+    sys.exit(main())
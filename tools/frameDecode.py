@@ -0,0 +1,96 @@
+"""Vectorised decoders for the raw frames sent by the firmware.
+
+The camera data pins D0 and D1 arrive swapped, every format undoes it with
+bitShuffleBytes() before decoding.
+"""
+
+import numpy as np
+import cv2 as cv
+from rawContainer import formatYUV422, formatRGB444, formatRGB565, formatGRAYSCALE
+
+def bitShuffleBytes(rawData):
+    return (rawData & 0xFC) | ((rawData & 0x01) << 1) | ((rawData & 0x02) >> 1)
+
+def rawArray(rawBytes, photoWidth, photoHeight, bytesPerPixel, bitShuffle=True):
+    rawData = np.frombuffer(rawBytes, dtype=np.uint8, count=photoWidth * photoHeight * bytesPerPixel)
+    if bitShuffle:
+        rawData = bitShuffleBytes(rawData)
+    return rawData.reshape(photoHeight, photoWidth * bytesPerPixel)
+
+def decodeRGB565(rawBytes, photoWidth, photoHeight, bitShuffle=True):
+    rawData = rawArray(rawBytes, photoWidth, photoHeight, 2, bitShuffle)
+    pixelHigh = rawData[:, 0::2]
+    pixelLow = rawData[:, 1::2]
+
+    # BGR565
+    # FEDCBA98 76543210
+    # RRRRRGGG GGGBBBBB
+    rawImage = np.empty((photoHeight, photoWidth, 3), dtype=np.uint8)
+    rawImage[:, :, 0] = (pixelLow & 0x1F) << 3
+    rawImage[:, :, 1] = ((pixelHigh & 0x07) << 5) | (((pixelLow >> 5) & 0x07) << 2)
+    rawImage[:, :, 2] = ((pixelHigh >> 3) & 0x1F) << 3
+    return rawImage
+
+def decodeRGB444(rawBytes, photoWidth, photoHeight, bitShuffle=True):
+    rawData = rawArray(rawBytes, photoWidth, photoHeight, 2, bitShuffle)
+    pixelHigh = rawData[:, 0::2]
+    pixelLow = rawData[:, 1::2]
+
+    # xRGB444
+    # FEDCBA98 76543210
+    # xxxxRRRR GGGGBBBB
+    rawImage = np.empty((photoHeight, photoWidth, 3), dtype=np.uint8)
+    rawImage[:, :, 0] = (pixelLow & 0x0F) << 4
+    rawImage[:, :, 1] = pixelLow & 0xF0
+    rawImage[:, :, 2] = (pixelHigh & 0x0F) << 4
+    return rawImage
+
+def splitYUV422(rawBytes, photoWidth, photoHeight, bitShuffle=True):
+    """Returns the Y, U and V planes of a YUYV frame (U/V at half horizontal resolution)."""
+    rawData = rawArray(rawBytes, photoWidth, photoHeight, 2, bitShuffle)
+    return rawData[:, 0::2], rawData[:, 1::4], rawData[:, 3::4]
+
+def decodeYUV422(rawBytes, photoWidth, photoHeight, bitShuffle=True):
+    rawData = rawArray(rawBytes, photoWidth, photoHeight, 2, bitShuffle)
+    return cv.cvtColor(rawData.reshape(photoHeight, photoWidth, 2), cv.COLOR_YUV2BGR_YUYV)
+
+def decodeGrayscale(rawBytes, photoWidth, photoHeight, bitShuffle=True):
+    return rawArray(rawBytes, photoWidth, photoHeight, 1, bitShuffle)
+
+def decodeFrame(rawBytes, photoWidth, photoHeight, photoFormat, bitShuffle=True):
+    """Decodes any firmware format to a BGR image (grayscale frames stay single channel)."""
+    if photoFormat == formatRGB565:
+        return decodeRGB565(rawBytes, photoWidth, photoHeight, bitShuffle)
+    if photoFormat == formatRGB444:
+        return decodeRGB444(rawBytes, photoWidth, photoHeight, bitShuffle)
+    if photoFormat == formatYUV422:
+        return decodeYUV422(rawBytes, photoWidth, photoHeight, bitShuffle)
+    if photoFormat == formatGRAYSCALE:
+        return decodeGrayscale(rawBytes, photoWidth, photoHeight, bitShuffle)
+    raise ValueError(f"Unsupported frame format: {photoFormat}")
+
+def framePlanes(rawBytes, photoWidth, photoHeight, photoFormat, chroma, bitShuffle=True):
+    """Returns the planar Y4M payload of a frame for the given chroma layout (420jpeg, 422, 444 or mono)."""
+    if photoFormat == formatYUV422 and chroma == "422":
+        return b"".join(plane.tobytes() for plane in splitYUV422(rawBytes, photoWidth, photoHeight, bitShuffle))
+
+    if photoFormat == formatGRAYSCALE:
+        luma = decodeGrayscale(rawBytes, photoWidth, photoHeight, bitShuffle)
+        if chroma == "mono":
+            return luma.tobytes()
+        yuv = np.dstack((luma, np.full_like(luma, 128), np.full_like(luma, 128)))
+    else:
+        image = decodeFrame(rawBytes, photoWidth, photoHeight, photoFormat, bitShuffle)
+        yuv = cv.cvtColor(image, cv.COLOR_BGR2YCrCb)[:, :, (0, 2, 1)]
+
+    if chroma == "mono":
+        return yuv[:, :, 0].tobytes()
+    if chroma == "444":
+        return yuv.transpose(2, 0, 1).tobytes()
+    if chroma == "422":
+        chromaPlanes = yuv[:, :, 1:].reshape(photoHeight, photoWidth // 2, 2, 2).mean(axis=2).round().astype(np.uint8)
+    elif chroma == "420jpeg":
+        chromaPlanes = yuv[:, :, 1:].reshape(photoHeight // 2, 2, photoWidth // 2, 2, 2).mean(axis=(1, 3)).round().astype(np.uint8)
+    else:
+        raise ValueError(f"Unsupported chroma layout: {chroma}")
+    return yuv[:, :, 0].tobytes() + chromaPlanes[..., 0].tobytes() + chromaPlanes[..., 1].tobytes()
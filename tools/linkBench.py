@@ -0,0 +1,131 @@
+"""Link bandwidth self-test, the host side of the firmware "benchLink" command.
+
+The board writes a pattern of known CRC-32 in writes of a given size and times them; this
+tool checks every byte against the same pattern and times their arrival. For each write
+size it reports the throughput and jitter seen on both ends, then the write size that
+moved the pattern fastest. The board keeps its own best run per link for the modes that
+choose a resolution and rate from it. Runs unchanged against a board or the simulator.
+"""
+
+import argparse
+import json
+import re
+import statistics
+import sys
+import time
+import zlib
+
+import savePhoto
+
+defaultBytes = 32768
+defaultTimeout = 10
+arrivalBlockBytes = 4096    # Jitter is the spread of the time between successive blocks of this size.
+
+benchRecord = re.compile(rb"BENCH (\d+) (\d+) (\d+) ([0-9A-Fa-f]+)\r\n")
+deviceResult = re.compile(rb"Link (\w+): (\d+) writes of (\d+) bytes in (\d+) us, (\d+) bytes/s, write (\d+) us mean, jitter (\d+) us, longest (\d+) us\.")
+keptResult = re.compile(rb"Kept for (\w+): (\d+) bytes/s with (\d+) byte writes, jitter (\d+) us\.")
+
+def pattern(size):
+    """Byte i is i ^ (i >> 8) ^ (i >> 16), as linkBenchPattern() in src/linkBench.h."""
+    return bytes((index ^ (index >> 8) ^ (index >> 16)) & 0xFF for index in range(size))
+
+def readRun(serialDevice, timeout):
+    """Reads one BENCH record and the result line after it, None when no record came.
+    The payload is checked later, the board starts the next run right away."""
+    deadline = time.perf_counter() + timeout
+    header = b""
+    while not benchRecord.search(header):
+        line = serialDevice.read_until(b"\r\n")
+        if keptResult.search(line) or time.perf_counter() > deadline:
+            return None, line
+        header = line
+    headerTime = time.perf_counter()    # The board flushes the record before its first write.
+    run, size, chunk, crc = benchRecord.search(header).groups()
+    size = int(size)
+
+    payload = bytearray()
+    arrivals = []
+    while len(payload) < size and time.perf_counter() < deadline:
+        data = serialDevice.read(min(size - len(payload), max(1, serialDevice.in_waiting)))
+        now = time.perf_counter()
+        if not data:
+            continue
+        before = len(payload)
+        payload += data
+        arrivals += [now] * (len(payload) // arrivalBlockBytes - before // arrivalBlockBytes)
+    lastByte = time.perf_counter()
+    serialDevice.read_until(b"\r\n")
+    result = deviceResult.search(serialDevice.read_until(b"\r\n"))
+
+    gaps = [(later - earlier) * 1e6 for earlier, later in zip(arrivals, arrivals[1:])]
+    return {
+        "run": int(run),
+        "chunk": int(chunk),
+        "bytes": size,
+        "received": len(payload),
+        "crc": int(crc, 16),
+        "payload": payload,
+        "hostBytesPerSecond": len(payload) / (lastByte - headerTime) if lastByte > headerTime else 0,
+        "hostJitterUs": statistics.pstdev(gaps) if len(gaps) > 1 else 0,
+        "deviceBytesPerSecond": int(result.group(5)) if result else None,
+        "deviceWriteMeanUs": int(result.group(6)) if result else None,
+        "deviceJitterUs": int(result.group(7)) if result else None,
+        "deviceLongestUs": int(result.group(8)) if result else None,
+    }, None
+
+def benchLink(serialDevice, size, chunks, timeout):
+    """One "benchLink" per write size, or the board's own sweep when none is given."""
+    commands = [f"benchLink --bytes {size} --chunk {chunk}" for chunk in chunks] or [f"benchLink --bytes {size}"]
+    runs = []
+    kept = None
+    for command in commands:
+        serialDevice.reset_input_buffer()
+        serialDevice.write((command + savePhoto.defaultCommandTerminator).encode("utf-8"))
+        while True:
+            run, line = readRun(serialDevice, timeout)
+            if run is None:
+                kept = keptResult.search(line) or kept
+                break
+            runs.append(run)
+    for run in runs:
+        payload = run.pop("payload")
+        run["crcOk"] = zlib.crc32(payload) == run["crc"]
+        run["patternOk"] = bytes(payload) == pattern(run["bytes"])
+    return runs, kept
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure the link to the board with its benchLink command")
+    parser.add_argument("--port", "-p", type=str, required=True, help="Serial port")
+    parser.add_argument("--baudrate", "-b", type=int, default=115200, help="Baud rate")
+    parser.add_argument("--bytes", "-n", type=int, default=defaultBytes, help=f"Pattern bytes per run (default {defaultBytes})")
+    parser.add_argument("--chunk", "-c", type=int, action="append", default=[], help="Write size to measure, repeatable (default: the board sweeps 64 to 4096)")
+    parser.add_argument("--timeout", "-t", type=float, default=defaultTimeout, help="Seconds to wait for a run")
+    parser.add_argument("--json", type=str, help="Write the runs as JSON to this path")
+    args = parser.parse_args()
+
+    with savePhoto.openDevice(args.port, args.baudrate, timeout=0.5) as serialDevice:
+        runs, kept = benchLink(serialDevice, args.bytes, args.chunk, args.timeout)
+
+    if not runs:
+        print("No benchLink run received.")
+        return 1
+
+    print(f"{'chunk':>6} {'device B/s':>11} {'jitter us':>9} {'host B/s':>11} {'jitter us':>9}  check")
+    for run in runs:
+        check = "ok" if run["crcOk"] and run["patternOk"] else f"BAD ({run['received']}/{run['bytes']} bytes)"
+        print(f"{run['chunk']:>6} {run['deviceBytesPerSecond'] or 0:>11} {run['deviceJitterUs'] or 0:>9} {run['hostBytesPerSecond']:>11.0f} {run['hostJitterUs']:>9.0f}  {check}")
+
+    valid = [run for run in runs if run["crcOk"] and run["patternOk"]]
+    if valid:
+        best = max(valid, key=lambda run: run["hostBytesPerSecond"])
+        print(f"Optimal write size: {best['chunk']} bytes, {best['hostBytesPerSecond']:.0f} bytes/s at the host.")
+    if kept:
+        print(f"Kept on the board for {kept.group(1).decode()}: {kept.group(2).decode()} bytes/s with {kept.group(3).decode()} byte writes.")
+
+    if args.json:
+        with open(args.json, "w") as output:
+            json.dump({"runs": runs, "optimalChunk": best["chunk"] if valid else None}, output, indent=2)
+    return 0 if len(valid) == len(runs) else 1
+
+if __name__ == "__main__":
+    sys.exit(main())
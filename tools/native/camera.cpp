@@ -0,0 +1,390 @@
+// Simulated OV767X: synthetic or replayed frames with the sensor frame timing.
+// The sensor answers SCCB transactions on Wire and clocks its frames out on the bus read by src/camera.h.
+
+#include <Arduino.h>
+#include <Arduino_OV767X.h>
+#include <Wire.h>
+#include "simulation.h"
+#include "../rawContainer.h"
+
+#include <stdio.h>
+
+#define SENSOR_SCCB_ADDRESS 0x21
+#define SENSOR_HREF_FRACTION 0.8 // Part of each line period with HREF high, the rest is horizontal blanking.
+
+OV767X Camera;
+TwoWire Wire;
+
+static const int resolutionWidth[5] = {640, 352, 320, 176, 160};
+static const int resolutionHeight[5] = {480, 240, 240, 144, 120};
+
+static uint8_t sensorRegisters[256];
+static uint8_t sensorPointer = 0;
+static bool sensorClocked = false;
+static int sensorResolution = QVGA;
+static int sensorFormat = RGB565;   // Format on the bus, GRAYSCALE is YUV422 there.
+static double sensorFps = 1;       // 30 fps divided by the CLKRC prescaler.
+static uint8_t sensorFrame[640 * 480 * 2]; // Static, the firmware heap seen by "mem" is the board's alone.
+static uint64_t busFrame = UINT64_MAX;    // Frame being clocked out, generated when its VSYNC is seen.
+static uint64_t busLine = 0;
+static size_t busByte = 0;
+static bool hrefHigh = false;
+static double busSlip = 0;          // Microseconds the lines of the frame on the bus were held back by a slow reader.
+
+static rawContainerReader replay;
+static bool replayOpened = false;
+static uint32_t replayNext = 0;
+static uint64_t frameEpoch = 0;
+static uint32_t frameSequence = 0;
+
+// The board wires D0 and D1 swapped, the host tools swap them back.
+static uint8_t wireByte(uint8_t value){
+    return (value & 0xFC) | ((value & 0x01) << 1) | ((value & 0x02) >> 1);
+}
+
+static void patternPixel(int x, int y, int width, int height, uint32_t sequence, uint8_t* r, uint8_t* g, uint8_t* b){
+    static const uint8_t bars[8][3] = {{255, 255, 255}, {255, 255, 0}, {0, 255, 255}, {0, 255, 0}, {255, 0, 255}, {255, 0, 0}, {0, 0, 255}, {0, 0, 0}};
+    int boxSize = height / 4;
+    int boxX = (sequence * 8) % (width - boxSize);
+    int boxY = height / 2 - boxSize / 2;
+
+    if(x >= boxX && x < boxX + boxSize && y >= boxY && y < boxY + boxSize){
+        *r = *g = *b = (sequence & 1) ? 255 : 16;
+    }
+    else if(y >= height * 3 / 4){
+        *r = *g = *b = (uint8_t) (x * 255 / (width - 1));
+    }
+    else{
+        const uint8_t* bar = bars[x * 8 / width];
+        *r = bar[0];
+        *g = bar[1];
+        *b = bar[2];
+    }
+}
+
+static uint8_t clampByte(double value){
+    return (value <= 0) ? 0 : (value >= 255) ? 255 : (uint8_t) (value + 0.5);
+}
+
+static uint8_t luma(uint8_t r, uint8_t g, uint8_t b){
+    return clampByte(0.299 * r + 0.587 * g + 0.114 * b);
+}
+
+static void syntheticFrame(uint8_t* buffer, int width, int height, int format, uint32_t sequence){
+    for(int y = 0; y < height; y++){
+        for(int x = 0; x < width; x++){
+            uint8_t r, g, b;
+            patternPixel(x, y, width, height, sequence, &r, &g, &b);
+            switch(format){
+                case RGB565:{
+                    uint16_t value = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+                    *buffer++ = wireByte(value >> 8);
+                    *buffer++ = wireByte(value & 0xFF);
+                }
+                break;
+
+                case RGB444:
+                    *buffer++ = wireByte(r >> 4);
+                    *buffer++ = wireByte((g & 0xF0) | (b >> 4));
+                break;
+
+                case YUV422:{
+                    // YUYV, U on even pixels and V on odd pixels.
+                    double chroma = (x & 1) ? 128 + 0.5 * r - 0.418688 * g - 0.081312 * b : 128 - 0.168736 * r - 0.331264 * g + 0.5 * b;
+                    *buffer++ = wireByte(luma(r, g, b));
+                    *buffer++ = wireByte(clampByte(chroma));
+                }
+                break;
+
+                default:
+                    *buffer++ = wireByte(luma(r, g, b));
+                break;
+            }
+        }
+    }
+}
+
+static bool replayFrame(uint8_t* buffer, int width, int height, int format){
+    if(simulation.replayPath == NULL){
+        return false;
+    }
+    if(!replayOpened){
+        replayOpened = true;
+        if(rawContainerOpen(&replay, simulation.replayPath) != 0){
+            fprintf(stderr, "Cannot open replay capture %s, using synthetic frames.\n", simulation.replayPath);
+            simulation.replayPath = NULL;
+            return false;
+        }
+    }
+
+    // Next stored frame recorded with the current resolution and format.
+    for(uint32_t checked = 0; checked < replay.frameCount; checked++){
+        uint32_t frameIndex = (replayNext + checked) % replay.frameCount;
+        const rawFrameRecord* record = rawContainerRecord(&replay, frameIndex);
+        if(record->width == width && record->height == height && record->format == format && record->size == (uint32_t) (width * height * record->bytesPerPixel)){
+            memcpy(buffer, rawContainerPayload(&replay, frameIndex), record->size);
+            replayNext = frameIndex + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+void simulationFillFrame(uint8_t* buffer, int width, int height, int format, uint32_t sequence){
+    if(!replayFrame(buffer, width, height, format)){
+        syntheticFrame(buffer, width, height, format, sequence);
+    }
+}
+
+// COM7 selects RGB or YUV and the resolution preset, the downscaled modes are told apart by the scaling registers.
+static void decodeSensorMode(){
+    sensorFps = 30.0 / ((sensorRegisters[0x11] & 0x3F) + 1);
+    uint8_t com7 = sensorRegisters[0x12];
+    sensorFormat = (com7 & 0x04) ? ((sensorRegisters[0x8C] & 0x02) ? RGB444 : RGB565) : YUV422;
+    if(com7 & 0x20){
+        sensorResolution = CIF;
+    }
+    else if(com7 & 0x10){
+        sensorResolution = (sensorRegisters[0x72] == 0x22) ? QQVGA : QVGA;
+    }
+    else if(com7 & 0x08){
+        sensorResolution = QCIF;
+    }
+    else{
+        sensorResolution = (sensorRegisters[0x73] == 0xF1) ? QCIF : VGA;
+    }
+}
+
+static void sensorWrite(uint8_t address, uint8_t value){
+    if(address == 0x12 && (value & 0x80)){ // COM7 reset
+        memset(sensorRegisters, 0, sizeof(sensorRegisters));
+        value &= 0x7F;
+    }
+    if(address == 0x11 && value != sensorRegisters[address]){
+        frameEpoch = simulationMicros(); // New frame grid at the new rate.
+        busFrame = UINT64_MAX;
+    }
+    sensorRegisters[address] = value;
+    decodeSensorMode();
+}
+
+// Registers Camera.begin() leaves behind that decodeSensorMode() looks at.
+static void loadSensorMode(int resolution, int format, int fps){
+    static const uint8_t com7Resolution[5] = {0x00, 0x20, 0x10, 0x00, 0x10};
+    sensorRegisters[0x12] = ((format == RGB444 || format == RGB565) ? 0x04 : 0x00) | com7Resolution[resolution];
+    sensorRegisters[0x8C] = (format == RGB444) ? 0x02 : 0x00;
+    sensorRegisters[0x72] = (resolution == QQVGA) ? 0x22 : 0x11;
+    sensorRegisters[0x73] = (resolution == QCIF) ? 0xF1 : (resolution == QQVGA) ? 0xF2 : 0xF0;
+    sensorRegisters[0x11] = (30 / fps) - 1;
+    decodeSensorMode();
+}
+
+// 100 kHz SCCB: start, 9 bits per byte including the acknowledge, stop.
+static void sccbDelay(size_t bytes){
+    delayMicroseconds((unsigned int) ((2 + 9 * bytes) * 1000000ull / Wire.clock));
+}
+
+void TwoWire::beginTransmission(uint8_t address){
+    this->address = address;
+    transmitSize = 0;
+}
+
+size_t TwoWire::write(uint8_t value){
+    if(transmitSize >= WIRE_BUFFER_SIZE){
+        return 0;
+    }
+    transmit[transmitSize++] = value;
+    return 1;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop){
+    (void) sendStop;
+    transactions++;
+    sccbDelay(transmitSize + 1);
+    if(address != SENSOR_SCCB_ADDRESS || !sensorClocked){
+        return 2; // Address not acknowledged, the sensor needs XCLK to answer.
+    }
+    if(transmitSize > 0){
+        sensorPointer = transmit[0];
+    }
+    for(size_t index = 1; index < transmitSize; index++){
+        sensorWrite(sensorPointer++, transmit[index]);
+    }
+    return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, size_t quantity, bool sendStop){
+    (void) sendStop;
+    transactions++;
+    sccbDelay(quantity + 1);
+    receiveSize = 0;
+    receiveIndex = 0;
+    if(address != SENSOR_SCCB_ADDRESS || !sensorClocked){
+        return 0;
+    }
+    while(receiveSize < quantity && receiveSize < WIRE_BUFFER_SIZE){
+        receive[receiveSize++] = sensorRegisters[sensorPointer++];
+    }
+    return receiveSize;
+}
+
+int TwoWire::available(){
+    return receiveSize - receiveIndex;
+}
+
+int TwoWire::read(){
+    return (receiveIndex < receiveSize) ? receive[receiveIndex++] : -1;
+}
+
+// Frame timing: VSYNC pulse, vertical blanking, the active lines clocked out over readoutFraction of the period, blanking again.
+// A line is only released once the reader took all its bytes, host scheduling delays stretch the readout instead of tearing the frame.
+// The lines after a held one slip by the same time, keeping the horizontal blanking a reader returning to loop() relies on.
+// A line is held until the reader sees HREF fall, so that is when the blanking starts.
+typedef struct{
+    uint64_t frame;
+    double offset;          // Microseconds since the frame VSYNC.
+    double activeStart;
+    double linePeriod;
+} sensorTiming;
+
+static sensorTiming sensorNow(){
+    sensorTiming timing;
+    double period = 1000000.0 / sensorFps;
+    timing.activeStart = period * (1 - simulation.readoutFraction) / 2;
+    timing.linePeriod = period * simulation.readoutFraction / resolutionHeight[sensorResolution];
+    double elapsed = (double) (simulationMicros() - frameEpoch);
+    timing.frame = (uint64_t) (elapsed / period);
+    timing.offset = elapsed - timing.frame * period;
+    return timing;
+}
+
+// Microseconds since begin() at which a line of the frame on the bus starts.
+static double lineStart(uint64_t line){
+    sensorTiming timing = sensorNow();
+    return busFrame * (1000000.0 / sensorFps) + timing.activeStart + line * timing.linePeriod + busSlip;
+}
+
+// A GRAYSCALE replay capture still comes out as YUV422 on the bus.
+static void sensorFillFrame(uint64_t frame){
+    int width = resolutionWidth[sensorResolution];
+    int height = resolutionHeight[sensorResolution];
+    if(sensorFormat == YUV422 && replayFrame(sensorFrame, width, height, GRAYSCALE)){
+        for(int index = width * height - 1; index >= 0; index--){
+            sensorFrame[2 * index] = sensorFrame[index];
+            sensorFrame[2 * index + 1] = wireByte(128);
+        }
+        return;
+    }
+    simulationFillFrame(sensorFrame, width, height, sensorFormat, (uint32_t) frame);
+}
+
+bool cameraBusVsync(){
+    if(!sensorClocked){
+        return false;
+    }
+    sensorTiming timing = sensorNow();
+    if(timing.offset < timing.activeStart && busFrame != timing.frame){
+        sensorFillFrame(timing.frame); // During vertical blanking, before the first line is clocked.
+        busFrame = timing.frame;
+        busLine = 0;
+        busByte = 0;
+        busSlip = 0;
+        hrefHigh = false;
+        timing = sensorNow();
+    }
+    return timing.offset < timing.activeStart / 2;
+}
+
+bool cameraBusHref(){
+    if(!sensorClocked || busFrame == UINT64_MAX){
+        return false;
+    }
+    double elapsed = (double) (simulationMicros() - frameEpoch);
+    if(hrefHigh){
+        double lineEnd = lineStart(busLine) + sensorNow().linePeriod * SENSOR_HREF_FRACTION;
+        if(busByte < (size_t) resolutionWidth[sensorResolution] * 2 || elapsed < lineEnd){
+            return true;
+        }
+        if(elapsed > lineEnd){
+            busSlip += elapsed - lineEnd;
+        }
+        hrefHigh = false;
+        busLine++;
+        busByte = 0;
+        return false;
+    }
+    if(busLine < (uint64_t) resolutionHeight[sensorResolution] && elapsed >= lineStart(busLine)){
+        hrefHigh = true;
+    }
+    return hrefHigh;
+}
+
+// The next byte of the line HREF is high for, zero past its end.
+uint8_t cameraBusReadByte(){
+    size_t rowBytes = resolutionWidth[sensorResolution] * 2;
+    if(!hrefHigh || busByte >= rowBytes){
+        return 0;
+    }
+    return sensorFrame[busLine * rowBytes + busByte++];
+}
+
+int OV767X::begin(int resolution, int format, int fps, int camera){
+    (void) camera;
+    if(resolution < VGA || resolution > QQVGA || fps <= 0){
+        return 0;
+    }
+    _width = resolutionWidth[resolution];
+    _height = resolutionHeight[resolution];
+    _bytesPerPixel = (format == GRAYSCALE) ? 1 : 2;
+    _format = format;
+    _fps = fps;
+
+    delay(simulation.beginMillis);
+    sensorClocked = true;
+    loadSensorMode(resolution, format, (fps > 30) ? 30 : fps);
+    busFrame = UINT64_MAX;
+    frameEpoch = simulationMicros();
+    _begun = true;
+    return 1;
+}
+
+void OV767X::end(){
+    _begun = false;
+    sensorClocked = false;
+}
+
+int OV767X::width() const{
+    return _width;
+}
+
+int OV767X::height() const{
+    return _height;
+}
+
+int OV767X::bitsPerPixel() const{
+    return _bytesPerPixel * 8;
+}
+
+int OV767X::bytesPerPixel() const{
+    return _bytesPerPixel;
+}
+
+// Waits for the next VSYNC on the frame grid started by begin(), then for the active lines to be clocked out.
+void OV767X::readFrame(void* buffer){
+    if(!_begun){
+        return;
+    }
+    uint64_t framePeriod = 1000000 / _fps;
+    uint64_t now = simulationMicros();
+    uint64_t nextFrame = frameEpoch + ((now - frameEpoch) / framePeriod + 1) * framePeriod;
+    simulationSleepUntil(nextFrame + (uint64_t) (framePeriod * simulation.readoutFraction));
+    simulationFillFrame((uint8_t*) buffer, _width, _height, _format, frameSequence++);
+}
+
+void OV767X::setPins(int vsync, int href, int pclk, int xclk, const int dpins[8]){
+    (void) vsync;
+    (void) href;
+    (void) pclk;
+    (void) xclk;
+    (void) dpins;
+}
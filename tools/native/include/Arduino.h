@@ -0,0 +1,120 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+// Host (Linux) stand-in for the Arduino core, only what the firmware uses.
+// Serial is backed by a file descriptor (the simulator's pty), time by std::chrono.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define LED_BUILTIN 13
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+inline void noInterrupts(){}
+inline void interrupts(){}
+
+class Print{
+    public:
+        virtual ~Print(){}
+        virtual size_t write(uint8_t value) = 0;
+        virtual size_t write(const uint8_t* buffer, size_t size);
+        size_t write(const char* text){ return (text == NULL) ? 0 : write((const uint8_t*) text, strlen(text)); }
+        size_t write(const char* buffer, size_t size){ return write((const uint8_t*) buffer, size); }
+        virtual int availableForWrite(){ return 0; }
+        virtual void flush(){}
+
+        size_t print(const char* text){ return write(text); }
+        size_t print(char value){ return write((uint8_t) value); }
+        size_t print(unsigned char value, int base = DEC){ return printNumber(value, base); }
+        size_t print(int value, int base = DEC){ return printSigned(value, base); }
+        size_t print(unsigned int value, int base = DEC){ return printNumber(value, base); }
+        size_t print(long value, int base = DEC){ return printSigned(value, base); }
+        size_t print(unsigned long value, int base = DEC){ return printNumber(value, base); }
+        size_t print(long long value, int base = DEC){ return printSigned(value, base); }
+        size_t print(unsigned long long value, int base = DEC){ return printNumber(value, base); }
+        size_t print(double value, int digits = 2);
+
+        size_t println(){ return write("\r\n"); }
+        template<typename T> size_t println(T value){ size_t size = print(value); return size + println(); }
+        template<typename T> size_t println(T value, int format){ size_t size = print(value, format); return size + println(); }
+
+    private:
+        size_t printNumber(unsigned long long value, int base);
+        size_t printSigned(long long value, int base);
+};
+
+class Stream : public Print{
+    public:
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() = 0;
+
+        void setTimeout(unsigned long timeout){ _timeout = timeout; }
+        size_t readBytes(char* buffer, size_t length);
+        size_t readBytesUntil(char terminator, char* buffer, size_t length);
+
+    protected:
+        int timedRead();
+        unsigned long _timeout = 1000;
+};
+
+class HardwareSerial : public Stream{
+    public:
+        void begin(unsigned long baudrate);
+        void end();
+        operator bool();
+
+        int available() override;
+        int read() override;
+        int peek() override;
+        size_t write(uint8_t value) override;
+        size_t write(const uint8_t* buffer, size_t size) override;
+        int availableForWrite() override;
+        void flush() override;
+        using Print::write;
+
+        int fd = -1;
+        unsigned long baudrate = 0;
+        uint64_t writeCalls = 0;    // write() calls reaching the link, each one is at least a USB packet on the board.
+        uint64_t writtenBytes = 0;
+        uint64_t cdcPackets = 0;        // Modelled CDC bulk endpoint, see HardwareSerial::write().
+        uint64_t cdcShortPackets = 0;
+        uint64_t cdcMicros = 0;         // Bus time the packets take on the board.
+
+    private:
+        int peeked = -1;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef ARDUINO_BLE_H
+#define ARDUINO_BLE_H
+
+// Host stand-in for the ArduinoBLE calls of src/bleTransport.h, with a mock stack and central behind them.
+//
+// Without a radio (the simulator) begin() fails and the firmware runs without its BLE link. A host test sets
+// BLE.radio, calls begin() through the firmware and then BLE.connect() with the link it wants to model:
+// - the ATT MTU the central negotiated (utility/ATT.h), a notification carries at most MTU - 3 bytes and is cut like
+//   ArduinoBLE does, as is a value longer than the characteristic;
+// - the connection interval and the notifications the controller sends per connection event;
+// - the controller queue, writeValue() returns 0 when it is full (ArduinoBLE would wait inside it instead).
+// Time is micros(): the connection events due are run whenever the firmware calls into the stack.
+
+#include <Arduino.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+#define BLEBroadcast 0x01
+#define BLERead 0x02
+#define BLEWriteWithoutResponse 0x04
+#define BLEWrite 0x08
+#define BLENotify 0x10
+#define BLEIndicate 0x20
+
+#define BLE_MOCK_DEFAULT_MTU 23
+
+class BLECharacteristic;
+
+typedef struct{
+    BLECharacteristic* characteristic;
+    std::string value;
+} bleMockNotification;
+
+typedef struct{
+    uint64_t notifications;     // Sent to the central.
+    uint64_t bytes;
+    uint64_t rejected;          // writeValue() calls refused because the controller queue was full.
+    uint64_t truncated;         // Notifications longer than MTU - 3.
+    uint64_t events;            // Connection events since connect().
+    uint64_t busyEvents;        // Events that carried at least one notification.
+    uint32_t peakPerEvent;
+    uint32_t peakQueued;
+} bleMockStatistics;
+
+class BLELocalDevice{
+    public:
+        int begin(){ return radio ? 1 : 0; }
+        void end(){}
+        bool setLocalName(const char* name){ (void) name; return true; }
+        bool setAdvertisedService(const class BLEService& service){ (void) service; return true; }
+        void addService(class BLEService& service){ (void) service; }
+        void setConnectionInterval(uint16_t minimum, uint16_t maximum){
+            (void) minimum;
+            (void) maximum;
+        }
+        int advertise(){ return radio ? 1 : 0; }
+        void poll(){ runEvents(); }
+        bool connected(){ return link; }
+
+        // Mock side.
+        void connect(uint16_t negotiatedMtu, uint32_t connectionIntervalMicros, uint8_t notificationsPerEvent, uint8_t controllerQueue){
+            link = true;
+            mtu = negotiatedMtu;
+            intervalMicros = connectionIntervalMicros;
+            perEvent = notificationsPerEvent;
+            queueDepth = controllerQueue;
+            nextEvent = micros() + intervalMicros;
+            queue.clear();
+            stats = {};
+        }
+
+        void disconnect(){
+            link = false;
+            queue.clear();
+            mtu = BLE_MOCK_DEFAULT_MTU;
+        }
+
+        // Every connection event due until now: up to perEvent queued notifications reach the central.
+        void runEvents(){
+            if(!link){
+                return;
+            }
+            uint64_t now = micros();
+            while(nextEvent <= now){
+                uint32_t sent = 0;
+                while(sent < perEvent && !queue.empty()){
+                    deliver(queue.front());
+                    queue.pop_front();
+                    sent++;
+                }
+                stats.events++;
+                stats.busyEvents += (sent != 0) ? 1 : 0;
+                stats.peakPerEvent = (sent > stats.peakPerEvent) ? sent : stats.peakPerEvent;
+                nextEvent += intervalMicros;
+            }
+        }
+
+        int notify(BLECharacteristic* characteristic, const uint8_t* value, int length){
+            runEvents();
+            if(!link){
+                return 0;
+            }
+            if(queue.size() >= queueDepth){
+                stats.rejected++;
+                return 0;
+            }
+            if(length > mtu - 3){
+                stats.truncated++;
+                length = mtu - 3;
+            }
+            queue.push_back({characteristic, std::string((const char*) value, length)});
+            stats.peakQueued = (queue.size() > stats.peakQueued) ? queue.size() : stats.peakQueued;
+            return 1;
+        }
+
+        void deliver(const bleMockNotification& notification);
+
+        // Central writes to a characteristic, as a phone would send a command line.
+        void write(BLECharacteristic& characteristic, const char* value);
+
+        bool radio = false;
+        bool link = false;
+        uint16_t mtu = BLE_MOCK_DEFAULT_MTU;
+        uint32_t intervalMicros = 7500;
+        uint8_t perEvent = 1;
+        uint8_t queueDepth = 1;
+        uint64_t nextEvent = 0;
+        std::deque<bleMockNotification> queue;
+        bleMockStatistics stats = {};
+};
+
+inline BLELocalDevice BLE;
+
+class BLECharacteristic{
+    public:
+        BLECharacteristic(const char* uuid, uint16_t properties, int valueSize, bool fixedLength = false) : uuid(uuid), properties(properties), valueSizeBytes(valueSize){
+            (void) fixedLength;
+        }
+
+        bool written(){
+            BLE.runEvents();
+            bool result = writtenFlag;
+            writtenFlag = false;
+            return result;
+        }
+        const uint8_t* value(){ return (const uint8_t*) current.data(); }
+        int valueLength(){ return current.size(); }
+        int valueSize(){ return valueSizeBytes; }
+
+        int writeValue(const uint8_t* value, int length){
+            length = (length < valueSizeBytes) ? length : valueSizeBytes;
+            if(properties & (BLENotify | BLEIndicate)){
+                return subscribed() ? BLE.notify(this, value, length) : 0;
+            }
+            current.assign((const char*) value, length);
+            return 1;
+        }
+        bool subscribed(){ return BLE.link; }
+
+        const char* uuid;
+        uint16_t properties;
+        std::string current;
+        bool writtenFlag = false;
+        int valueSizeBytes;
+        std::string received;       // Mock central side, notifications received in order.
+        std::vector<size_t> lengths;    // Length of each of them.
+        uint64_t notifications = 0;
+};
+
+inline void BLELocalDevice::deliver(const bleMockNotification& notification){
+    notification.characteristic->received += notification.value;
+    notification.characteristic->lengths.push_back(notification.value.size());
+    notification.characteristic->notifications++;
+    stats.notifications++;
+    stats.bytes += notification.value.size();
+}
+
+inline void BLELocalDevice::write(BLECharacteristic& characteristic, const char* value){
+    characteristic.current = value;
+    characteristic.writtenFlag = true;
+}
+
+class BLEService{
+    public:
+        explicit BLEService(const char* uuid) : uuid(uuid){}
+        void addCharacteristic(BLECharacteristic& characteristic){ (void) characteristic; }
+
+        const char* uuid;
+};
+
+#endif
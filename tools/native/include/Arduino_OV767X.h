@@ -0,0 +1,58 @@
+#ifndef ARDUINO_OV767X_H
+#define ARDUINO_OV767X_H
+
+// Host stand-in for the Arduino_OV767X library, frames come from the simulated sensor in tools/native/camera.cpp.
+
+#include <Arduino.h>
+
+enum{
+    OV7670 = 0,
+    OV7675 = 1
+};
+
+enum{
+    YUV422 = 0,
+    RGB444 = 1,
+    RGB565 = 2,
+    // SBGGR8 = 3
+    GRAYSCALE = 4
+};
+
+enum{
+    // VGA Resolution
+    VGA = 0,
+    // CIF Resolution
+    CIF = 1,
+    // QVGA Resolution
+    QVGA = 2,
+    // QCIF Resolution
+    QCIF = 3,
+    // QQVGA Resolution
+    QQVGA = 4
+};
+
+class OV767X{
+    public:
+        int begin(int resolution, int format, int fps, int camera = OV7670);
+        void end();
+
+        int width() const;
+        int height() const;
+        int bitsPerPixel() const;
+        int bytesPerPixel() const;
+
+        void readFrame(void* buffer);
+        void setPins(int vsync, int href, int pclk, int xclk, const int dpins[8]);
+
+    private:
+        int _width = 0;
+        int _height = 0;
+        int _bytesPerPixel = 0;
+        int _format = 0;
+        int _fps = 0;
+        bool _begun = false;
+};
+
+extern OV767X Camera;
+
+#endif
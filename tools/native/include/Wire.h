@@ -0,0 +1,37 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+// Host stand-in for the Arduino Wire library, the only device on the bus is the simulated sensor in tools/native/camera.cpp.
+
+#include <Arduino.h>
+
+#define WIRE_BUFFER_SIZE 32
+
+class TwoWire{
+    public:
+        void begin(){}
+        void end(){}
+        void setClock(uint32_t frequency){ clock = frequency; }
+
+        void beginTransmission(uint8_t address);
+        size_t write(uint8_t value);
+        uint8_t endTransmission(bool sendStop = true);
+        uint8_t requestFrom(uint8_t address, size_t quantity, bool sendStop = true);
+        int available();
+        int read();
+
+        uint32_t clock = 100000;
+        uint64_t transactions = 0;
+
+    private:
+        uint8_t address = 0;
+        uint8_t transmit[WIRE_BUFFER_SIZE];
+        size_t transmitSize = 0;
+        uint8_t receive[WIRE_BUFFER_SIZE];
+        size_t receiveSize = 0;
+        size_t receiveIndex = 0;
+};
+
+extern TwoWire Wire;
+
+#endif
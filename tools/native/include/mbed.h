@@ -0,0 +1,90 @@
+#ifndef MBED_H
+#define MBED_H
+
+// Host stand-in for the mbed OS RTOS API the firmware uses: rtos::Thread runs on std::thread, rtos::Mutex (recursive,
+// as in mbed OS) on std::recursive_mutex.
+// Priorities are recorded only, the host scheduler does not know them.
+
+#include <stdint.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+typedef enum{
+    osPriorityIdle = 1,
+    osPriorityLow = 8,
+    osPriorityBelowNormal = 16,
+    osPriorityNormal = 24,
+    osPriorityAboveNormal = 32,
+    osPriorityHigh = 40,
+    osPriorityRealtime = 48
+} osPriority;
+
+typedef int32_t osStatus;
+#define osOK 0
+#define osErrorResource -3
+
+#define OS_STACK_SIZE 4096
+
+namespace rtos{
+    class Thread{
+        public:
+            Thread(osPriority priority = osPriorityNormal, uint32_t stack_size = OS_STACK_SIZE, unsigned char* stack_mem = nullptr, const char* name = nullptr) : priority(priority), name(name){
+                (void) stack_size;
+                (void) stack_mem;
+            }
+            ~Thread(){
+                join();
+            }
+
+            osStatus start(void (*task)()){
+                if(thread.joinable()){
+                    return osErrorResource;
+                }
+                thread = std::thread(task);
+                return osOK;
+            }
+
+            osStatus join(){
+                if(thread.joinable()){
+                    thread.join();
+                }
+                return osOK;
+            }
+
+            osPriority get_priority() const{ return priority; }
+            const char* get_name() const{ return name; }
+
+        private:
+            std::thread thread;
+            osPriority priority;
+            const char* name;
+    };
+
+    class Mutex{
+        public:
+            osStatus lock(){
+                mutex.lock();
+                return osOK;
+            }
+            bool trylock(){ return mutex.try_lock(); }
+            osStatus unlock(){
+                mutex.unlock();
+                return osOK;
+            }
+
+        private:
+            std::recursive_mutex mutex;
+    };
+
+    namespace ThisThread{
+        inline void sleep_for(std::chrono::duration<uint32_t, std::milli> time){
+            std::this_thread::sleep_for(time);
+        }
+        inline void yield(){
+            std::this_thread::yield();
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef ATT_H
+#define ATT_H
+
+// Host stand-in for the ArduinoBLE ATT layer: the mock central of ArduinoBLE.h is connection handle 0.
+
+#include <ArduinoBLE.h>
+
+class ATTClass{
+    public:
+        uint16_t mtu(uint16_t handle) const{
+            return (BLE.link && handle == 0) ? BLE.mtu : BLE_MOCK_DEFAULT_MTU;
+        }
+};
+
+inline ATTClass ATT;
+
+#endif
@@ -0,0 +1,846 @@
+// Microbenchmarks of the firmware hot paths, built by [env:native]:
+//   pio run -e native && .pio/build/native/program [--filter=parseArgx] [--min-time=1] [--json]
+//
+// The firmware headers define their globals, so they are included by this translation unit only.
+
+#include <Arduino.h>
+#include <camera.h>
+#include <parser.h>
+#include <profiles.h>
+#include <capture.h>
+#include <stream.h>
+#include <ring.h>
+#include <commands.h>
+#include <transport.h>
+#include "simulation.h"
+#include "microbench.h"
+
+#include <fcntl.h>
+#include <mutex>
+#include <thread>
+
+#define COMMAND_LINE_WIDTH 128 // Same line buffer as src/main.cpp.
+
+static char commandLine[COMMAND_LINE_WIDTH];
+
+static void loadCommandLine(const char* command){
+    memset(commandLine, 0, sizeof(commandLine));
+    strncpy(commandLine, command, sizeof(commandLine) - 1);
+}
+
+static void runCommandLine(const char* command, benchmarkState& state){
+    uint64_t writeCalls = Serial.writeCalls;
+    uint64_t writtenBytes = Serial.writtenBytes;
+    while(state.keepRunning()){
+        loadCommandLine(command);
+        argx_type argx = parseArgx(commandLine, sizeof(commandLine), true);
+        executeCommands(argx.argc, argx.argv);
+        freeArgx(&argx);
+        arenaReset();
+        serialLink.flush();
+    }
+    state.counters["writes/op"] = (double) (Serial.writeCalls - writeCalls) / state.iterations;
+    state.counters["bytes/op"] = (double) (Serial.writtenBytes - writtenBytes) / state.iterations;
+}
+
+// The loop() path over the in-memory link: the line is read back without blocking, served and its output taken.
+// print/op counts the writes the command made, on USB serial they are gathered into the packets of writes/op above.
+static loopbackTransport loopback;
+
+static void runLoopbackCommand(const char* command, benchmarkState& state){
+    char output[LOOPBACK_BYTES];
+    uint32_t writes = loopback.writes;
+    size_t received = 0;
+    commandLink = &loopback;
+    while(state.keepRunning()){
+        loopback.feed(command);
+        loopback.feed("\r\n");
+        memset(commandLine, 0, sizeof(commandLine));
+        while(!loopback.readLine(commandLine, sizeof(commandLine)));
+        argx_type argx = parseArgx(commandLine, sizeof(commandLine), true);
+        executeCommands(argx.argc, argx.argv);
+        freeArgx(&argx);
+        arenaReset();
+        received += loopback.take(output, sizeof(output));
+    }
+    commandLink = &serialLink;
+    state.counters["print/op"] = (double) (loopback.writes - writes) / state.iterations;
+    state.counters["bytes/op"] = (double) received / state.iterations;
+    state.counters["dropped"] = loopback.dropped;
+}
+
+void BM_loopback_help(benchmarkState& state){
+    runLoopbackCommand("help", state);
+}
+BENCHMARK(BM_loopback_help);
+
+void BM_loopback_getCameraSettings(benchmarkState& state){
+    runLoopbackCommand("getCameraSettings", state);
+}
+BENCHMARK(BM_loopback_getCameraSettings);
+
+void BM_parseArgx_single(benchmarkState& state){
+    while(state.keepRunning()){
+        loadCommandLine("takePhoto");
+        argx_type argx = parseArgx(commandLine, sizeof(commandLine), true);
+        freeArgx(&argx);
+    }
+    state.itemsProcessed = state.iterations;
+}
+BENCHMARK(BM_parseArgx_single);
+
+void BM_parseArgx_quoted(benchmarkState& state){
+    while(state.keepRunning()){
+        loadCommandLine("setResolution 2 --help \"quoted argument\" 'single quoted' tail");
+        argx_type argx = parseArgx(commandLine, sizeof(commandLine), true);
+        freeArgx(&argx);
+    }
+    state.itemsProcessed = state.iterations;
+}
+BENCHMARK(BM_parseArgx_quoted);
+
+// First entry of commandList, one arg_parse call.
+void BM_executeCommands_help(benchmarkState& state){
+    runCommandLine("help", state);
+}
+BENCHMARK(BM_executeCommands_help);
+
+// Falls through every command before reporting the error, the worst case dispatch.
+void BM_executeCommands_invalid(benchmarkState& state){
+    runCommandLine("noSuchCommand", state);
+}
+BENCHMARK(BM_executeCommands_invalid);
+
+void BM_executeCommands_getCameraSettings(benchmarkState& state){
+    runCommandLine("getCameraSettings", state);
+}
+BENCHMARK(BM_executeCommands_getCameraSettings);
+
+// The same settings encoded in one buffer and written at once.
+void BM_executeCommands_getCameraSettings_json(benchmarkState& state){
+    runCommandLine("getCameraSettings --json", state);
+}
+BENCHMARK(BM_executeCommands_getCameraSettings_json);
+
+void BM_executeCommands_getCameraSettings_cbor(benchmarkState& state){
+    runCommandLine("getCameraSettings --cbor", state);
+}
+BENCHMARK(BM_executeCommands_getCameraSettings_cbor);
+
+static void runSetupFrameBuffer(uint8_t resolution, uint8_t format, benchmarkState& state){
+    uint8_t previousResolution = cameraResolution;
+    uint8_t previousFormat = cameraFormat;
+    cameraResolution = resolution;
+    cameraFormat = format;
+    while(state.keepRunning()){
+        setupFrameBuffer(&frameBuffer, &frameBufferSize);
+    }
+    state.counters["frameBytes"] = frameBufferSize;
+    freeFrameBuffer(&frameBuffer);
+    cameraResolution = previousResolution;
+    cameraFormat = previousFormat;
+}
+
+void BM_setupFrameBuffer_QVGA_RGB565(benchmarkState& state){
+    runSetupFrameBuffer(QVGA, RGB565, state);
+}
+BENCHMARK(BM_setupFrameBuffer_QVGA_RGB565);
+
+void BM_setupFrameBuffer_QQVGA_GRAYSCALE(benchmarkState& state){
+    runSetupFrameBuffer(QQVGA, GRAYSCALE, state);
+}
+BENCHMARK(BM_setupFrameBuffer_QQVGA_GRAYSCALE);
+
+// setResolution alternating QVGA and QQVGA, the way it worked before register deltas: a full Camera.begin() each time.
+// The simulated begin() waits the library's 1 s sensor settle time, SCCB transactions take their 100 kHz bus time.
+void BM_setResolution_fullInit(benchmarkState& state){
+    unsigned long beginMillis = simulation.beginMillis;
+    simulation.beginMillis = 1000;
+    uint64_t transactions = Wire.transactions;
+    while(state.keepRunning()){
+        cameraResolution = (cameraResolution == QVGA) ? QQVGA : QVGA;
+        setupCamera(1);
+    }
+    state.counters["sccb/op"] = (double) (Wire.transactions - transactions) / state.iterations;
+    simulation.beginMillis = beginMillis;
+}
+BENCHMARK_ITERATIONS(BM_setResolution_fullInit, 4);
+
+void BM_setResolution_delta(benchmarkState& state){
+    uint64_t transactions = Wire.transactions;
+    uint64_t writes = 0;
+    while(state.keepRunning()){
+        configureResolution((cameraResolution == QVGA) ? QQVGA : QVGA, 1);
+        writes += cameraDeltaWrites;
+    }
+    state.counters["sccb/op"] = (double) (Wire.transactions - transactions) / state.iterations;
+    state.counters["registers/op"] = (double) writes / state.iterations;
+}
+BENCHMARK_ITERATIONS(BM_setResolution_delta, 20);
+
+// "profile use" alternating two profiles: one precomputed register set compared with the shadow, one delta written.
+void BM_profileUse(benchmarkState& state){
+    cameraWindow window;
+    resetCameraWindow(&window);
+    cameraProfile* wide = defineCameraProfile("wide", QVGA, RGB565, 1, window);
+    window = {20, 10, 120, 100, 2};
+    cameraProfile* small = defineCameraProfile("small", QQVGA, GRAYSCALE, 5, window);
+    uint64_t transactions = Wire.transactions;
+    uint64_t writes = 0;
+    bool useSmall = true;
+    while(state.keepRunning()){
+        useCameraProfile(useSmall ? small : wide, 1);
+        writes += cameraDeltaWrites;
+        useSmall = !useSmall;
+    }
+    state.counters["sccb/op"] = (double) (Wire.transactions - transactions) / state.iterations;
+    state.counters["registers/op"] = (double) writes / state.iterations;
+    resetCameraWindow(&cameraRoi);
+}
+BENCHMARK_ITERATIONS(BM_profileUse, 20);
+
+// takePhoto latency (next VSYNC plus the line readout) at each frame rate, QQVGA so that 30 fps is allowed.
+static void runTakePhoto(uint8_t fps, benchmarkState& state){
+    configureResolution(QQVGA, 1);
+    configureFPS(fps, 1);
+    while(state.keepRunning()){
+        takePhoto(&frameBuffer, &frameBufferSize);
+    }
+    state.counters["framePeriodMs"] = cameraFramePeriodMicros(cameraFPS) / 1000.0;
+    freeFrameBuffer(&frameBuffer);
+    configureFPS(1, 1);
+    configureResolution(QVGA, 1);
+}
+
+void BM_takePhoto_1fps(benchmarkState& state){
+    runTakePhoto(1, state);
+}
+BENCHMARK_ITERATIONS(BM_takePhoto_1fps, 3);
+
+void BM_takePhoto_5fps(benchmarkState& state){
+    runTakePhoto(5, state);
+}
+BENCHMARK_ITERATIONS(BM_takePhoto_5fps, 10);
+
+void BM_takePhoto_10fps(benchmarkState& state){
+    runTakePhoto(10, state);
+}
+BENCHMARK_ITERATIONS(BM_takePhoto_10fps, 20);
+
+void BM_takePhoto_15fps(benchmarkState& state){
+    runTakePhoto(15, state);
+}
+BENCHMARK_ITERATIONS(BM_takePhoto_15fps, 20);
+
+void BM_takePhoto_30fps(benchmarkState& state){
+    runTakePhoto(30, state);
+}
+BENCHMARK_ITERATIONS(BM_takePhoto_30fps, 30);
+
+// Frames read by captureStep() slices with loopWorkMicros of other loop() work between them, at QQVGA.
+// longestStepUs bounds the command latency while capturing. Work longer than the horizontal blanking drops every frame,
+// an iteration gives up after 10 dropped frames and completed/op reports it.
+static void runSlicedCapture(uint8_t fps, uint32_t loopWorkMicros, benchmarkState& state){
+    configureResolution(QQVGA, 1);
+    configureFPS(fps, 1);
+    setupFrameBuffer(&frameBuffer, &frameBufferSize);
+    captureStatistics before = captureStats;
+    captureStats.longestStepMicros = 0;
+    uint32_t completed = 0;
+    while(state.keepRunning()){
+        uint32_t dropped = captureStats.framesDropped;
+        captureBegin(frameBuffer);
+        while(captureStep(CAPTURE_SLICE_MICROS) != CAPTURE_DONE && captureStats.framesDropped - dropped < 10){
+            uint32_t workStart = micros();
+            while(micros() - workStart < loopWorkMicros);
+        }
+        completed += (capture.state == CAPTURE_DONE) ? 1 : 0;
+    }
+    state.counters["completed/op"] = (double) completed / state.iterations;
+    state.counters["dropped/op"] = (double) (captureStats.framesDropped - before.framesDropped) / state.iterations;
+    state.counters["steps/op"] = (double) (captureStats.steps - before.steps) / state.iterations;
+    state.counters["longestStepUs"] = captureStats.longestStepMicros;
+    state.counters["linePeriodUs"] = capture.linePeriodMicros;
+    freeFrameBuffer(&frameBuffer);
+    capture.state = CAPTURE_IDLE;
+    configureFPS(1, 1);
+    configureResolution(QVGA, 1);
+}
+
+void BM_captureSliced_30fps_idleLoop(benchmarkState& state){
+    runSlicedCapture(30, 0, state);
+}
+BENCHMARK_ITERATIONS(BM_captureSliced_30fps_idleLoop, 30);
+
+void BM_captureSliced_30fps_loopWork20us(benchmarkState& state){
+    runSlicedCapture(30, 20, state);
+}
+BENCHMARK_ITERATIONS(BM_captureSliced_30fps_loopWork20us, 30);
+
+void BM_captureSliced_5fps_loopWork100us(benchmarkState& state){
+    runSlicedCapture(5, 100, state);
+}
+BENCHMARK_ITERATIONS(BM_captureSliced_5fps_loopWork100us, 10);
+
+void BM_captureSliced_5fps_loopWork500us(benchmarkState& state){
+    runSlicedCapture(5, 500, state);
+}
+BENCHMARK_ITERATIONS(BM_captureSliced_5fps_loopWork500us, 2);
+
+// Output on the modelled CDC endpoint of the shim (packets, short packets and the bus time they take on the board),
+// written straight to Serial the way every print() was sent before the transport, or through serialLink whose batch
+// leaves in whole packets. kB/s is the bus throughput of the modelled endpoint.
+class directSerialTransport : public transport{
+    public:
+        using transport::write;
+        size_t write(const uint8_t* buffer, size_t size) override{ return Serial.write(buffer, size); }
+        int availableForWrite() override{ return Serial.availableForWrite(); }
+        size_t read(byte* buffer, size_t size) override{
+            (void) buffer;
+            (void) size;
+            return 0;
+        }
+        bool connected() override{ return true; }
+        const char* name() override{ return "direct"; }
+};
+
+static directSerialTransport directSerial;
+
+typedef struct{
+    uint64_t writes;
+    uint64_t bytes;
+    uint64_t packets;
+    uint64_t shortPackets;
+    uint64_t micros;
+} cdcSample;
+
+static cdcSample cdcTake(){
+    return {Serial.writeCalls, Serial.writtenBytes, Serial.cdcPackets, Serial.cdcShortPackets, Serial.cdcMicros};
+}
+
+static void cdcCounters(const cdcSample& before, benchmarkState& state){
+    cdcSample after = cdcTake();
+    state.counters["writes/op"] = (double) (after.writes - before.writes) / state.iterations;
+    state.counters["packets/op"] = (double) (after.packets - before.packets) / state.iterations;
+    state.counters["short/op"] = (double) (after.shortPackets - before.shortPackets) / state.iterations;
+    state.counters["busUs/op"] = (double) (after.micros - before.micros) / state.iterations;
+    state.counters["kB/s"] = (double) (after.bytes - before.bytes) * 1000.0 / (after.micros - before.micros);
+}
+
+static void runCdcCommand(const char* command, transport* link, benchmarkState& state){
+    cdcSample before = cdcTake();
+    commandLink = link;
+    while(state.keepRunning()){
+        loadCommandLine(command);
+        argx_type argx = parseArgx(commandLine, sizeof(commandLine), true);
+        executeCommands(argx.argc, argx.argv);
+        freeArgx(&argx);
+        arenaReset();
+        link->flush();
+    }
+    commandLink = &serialLink;
+    cdcCounters(before, state);
+}
+
+void BM_cdc_help_direct(benchmarkState& state){
+    runCdcCommand("help", &directSerial, state);
+}
+BENCHMARK(BM_cdc_help_direct);
+
+void BM_cdc_help_packets(benchmarkState& state){
+    runCdcCommand("help", &serialLink, state);
+}
+BENCHMARK(BM_cdc_help_packets);
+
+void BM_cdc_getCameraSettings_direct(benchmarkState& state){
+    runCdcCommand("getCameraSettings", &directSerial, state);
+}
+BENCHMARK(BM_cdc_getCameraSettings_direct);
+
+void BM_cdc_getCameraSettings_packets(benchmarkState& state){
+    runCdcCommand("getCameraSettings", &serialLink, state);
+}
+BENCHMARK(BM_cdc_getCameraSettings_packets);
+
+// A QQVGA RGB565 stream record as serviceTransmit() writes it: header, TRANSMIT_CHUNK_BYTES pieces, trailer, flush.
+#define CDC_BENCH_FRAME_BYTES 38400
+
+static void runCdcFrameRecord(transport* link, benchmarkState& state){
+    static byte frame[CDC_BENCH_FRAME_BYTES];
+    cdcSample before = cdcTake();
+    uint32_t sequence = 0;
+    while(state.keepRunning()){
+        link->print("FRAME ");
+        link->print(sequence++);
+        link->print(" ");
+        link->print(CDC_BENCH_FRAME_BYTES);
+        link->print(" 12345\r\n");
+        for(size_t offset = 0; offset < CDC_BENCH_FRAME_BYTES; offset += TRANSMIT_CHUNK_BYTES){
+            link->write(frame + offset, TRANSMIT_CHUNK_BYTES);
+        }
+        link->print("\r\n");
+        link->flush();
+    }
+    cdcCounters(before, state);
+}
+
+void BM_cdc_frameRecord_direct(benchmarkState& state){
+    runCdcFrameRecord(&directSerial, state);
+}
+BENCHMARK(BM_cdc_frameRecord_direct);
+
+void BM_cdc_frameRecord_packets(benchmarkState& state){
+    runCdcFrameRecord(&serialLink, state);
+}
+BENCHMARK(BM_cdc_frameRecord_packets);
+
+// Frames per second of a continuous capture over a modelled link: read then send (sequential) against the two-slot
+// stream, whole frames at QQVGA, bands at QVGA where two frames exceed STREAM_MEMORY_BYTES. Both at 5 fps.
+static void runStream(uint8_t resolution, bool pipelined, double linkBytesPerSecond, benchmarkState& state){
+    configureResolution(resolution, 1);
+    configureFPS(5, 1);
+    simulation.linkBytesPerSecond = linkBytesPerSecond;
+    uint32_t dropped = captureStats.framesDropped;
+    if(pipelined){
+        startStream(0);
+    }
+    else{
+        setupFrameBuffer(&frameBuffer, &frameBufferSize);
+    }
+    while(state.keepRunning()){
+        if(pipelined){
+            uint32_t sent = stream.framesSent;
+            while(stream.framesSent == sent && captureOwner == CAPTURE_FOR_STREAM){
+                serviceCapture();
+            }
+        }
+        else{
+            readCameraFrame(frameBuffer);
+            Serial.write(frameBuffer, frameBufferSize);
+        }
+    }
+    if(pipelined){
+        state.counters["torn/op"] = (double) stream.framesTorn / state.iterations;
+        state.counters["overruns/op"] = (double) stream.overruns / state.iterations;
+        state.counters["slotBytes"] = stream.slotBytes;
+        stopCapture();
+    }
+    state.counters["dropped/op"] = (double) (captureStats.framesDropped - dropped) / state.iterations;
+    state.itemsProcessed = state.iterations;
+    simulation.linkBytesPerSecond = 0;
+    freeFrameBuffer(&frameBuffer);
+    configureFPS(1, 1);
+    configureResolution(QVGA, 1);
+}
+
+void BM_stream_sequential_QQVGA(benchmarkState& state){
+    runStream(QQVGA, false, 200000, state);
+}
+BENCHMARK_ITERATIONS(BM_stream_sequential_QQVGA, 10);
+
+void BM_stream_pingPong_QQVGA(benchmarkState& state){
+    runStream(QQVGA, true, 200000, state);
+}
+BENCHMARK_ITERATIONS(BM_stream_pingPong_QQVGA, 10);
+
+void BM_stream_sequential_QVGA(benchmarkState& state){
+    runStream(QVGA, false, 1000000, state);
+}
+BENCHMARK_ITERATIONS(BM_stream_sequential_QVGA, 10);
+
+void BM_stream_bands_QVGA(benchmarkState& state){
+    runStream(QVGA, true, 1000000, state);
+}
+BENCHMARK_ITERATIONS(BM_stream_bands_QVGA, 10);
+
+// The same stream from the threads of src/threads.h, the benchmark thread standing in for the idle command thread.
+// On the host the capture thread has no priority over the others, a drop here is a host scheduling artefact.
+static void runThreadedStream(uint8_t resolution, double linkBytesPerSecond, benchmarkState& state){
+    configureResolution(resolution, 1);
+    configureFPS(5, 1);
+    simulation.linkBytesPerSecond = linkBytesPerSecond;
+    uint32_t dropped = captureStats.framesDropped;
+    startStreamThreads(0);
+    while(state.keepRunning()){
+        uint32_t sent = stream.framesSent;
+        while(stream.framesSent == sent){
+            rtos::ThisThread::sleep_for(std::chrono::milliseconds(THREAD_IDLE_SLEEP_MS));
+        }
+    }
+    uint32_t elapsed = micros() - threads.startMicros;
+    state.counters["captureCpu%"] = threads.stats[THREAD_CAPTURE].busyMicros * 100.0 / elapsed;
+    state.counters["transmitCpu%"] = threads.stats[THREAD_TRANSMIT].busyMicros * 100.0 / elapsed;
+    state.counters["queueMean"] = (double) threads.queue.occupancySum / threads.queue.pushes;
+    state.counters["torn/op"] = (double) stream.framesTorn / state.iterations;
+    stopCapture();
+    state.counters["dropped/op"] = (double) (captureStats.framesDropped - dropped) / state.iterations;
+    state.itemsProcessed = state.iterations;
+    simulation.linkBytesPerSecond = 0;
+    configureFPS(1, 1);
+    configureResolution(QVGA, 1);
+}
+
+void BM_stream_threads_QQVGA(benchmarkState& state){
+    runThreadedStream(QQVGA, 200000, state);
+}
+BENCHMARK_ITERATIONS(BM_stream_threads_QQVGA, 10);
+
+void BM_stream_threads_bands_QVGA(benchmarkState& state){
+    runThreadedStream(QVGA, 1000000, state);
+}
+BENCHMARK_ITERATIONS(BM_stream_threads_bands_QVGA, 10);
+
+// A frame record sent on the BLE data characteristic to a mock central until it received all of it, the way loop()
+// flushes the links after every pass. The link: negotiated MTU, connection interval, notifications the controller
+// sends per event and its queue. test/test_ble asserts the chunking and the credits, this measures the rate; refusals
+// over several frames are the credit pace probing for a faster link.
+#define BLE_BENCH_FRAME_BYTES 9600
+
+static void runBleFrame(uint16_t mtu, uint32_t intervalMicros, uint8_t perEvent, uint8_t controllerQueue, benchmarkState& state){
+    static byte frame[BLE_BENCH_FRAME_BYTES];
+    BLE.connect(mtu, intervalMicros, perEvent, controllerQueue);
+    bleLinkState before = ble;
+    uint64_t modelledMicros = 0;
+    while(state.keepRunning()){
+        bleData.received.clear();
+        uint64_t start = micros();
+        transportSegment segments[2] = {{frame, sizeof(frame)}, {"\r\n", 2}};
+        bleDataLink.writev(segments, 2);
+        while(bleData.received.size() < sizeof(frame) + 2 && ble.dropped == before.dropped){
+            bleLink.flush();
+            BLE.poll();
+            delayMicroseconds(200);
+        }
+        modelledMicros += micros() - start;
+    }
+    state.counters["kB/s"] = (double) state.iterations * (sizeof(frame) + 2) * 1000.0 / modelledMicros;
+    state.counters["notif/op"] = (double) (ble.notifications - before.notifications) / state.iterations;
+    state.counters["notif/event"] = (double) BLE.stats.notifications / BLE.stats.busyEvents;
+    state.counters["peakPerEvent"] = BLE.stats.peakPerEvent;
+    state.counters["refused/op"] = (double) (ble.refused - before.refused) / state.iterations;
+    state.counters["truncated"] = BLE.stats.truncated;
+    state.counters["dropped"] = ble.dropped - before.dropped;
+    BLE.disconnect();
+    bleLink.flush();    // As loop() would: the link sees the central leave, the next connection starts afresh.
+}
+
+void BM_ble_frame_mtu23(benchmarkState& state){
+    runBleFrame(23, 15000, 3, 6, state);
+}
+BENCHMARK_ITERATIONS(BM_ble_frame_mtu23, 2);
+
+void BM_ble_frame_mtu185(benchmarkState& state){
+    runBleFrame(185, 15000, 3, 6, state);
+}
+BENCHMARK_ITERATIONS(BM_ble_frame_mtu185, 4);
+
+void BM_ble_frame_mtu247(benchmarkState& state){
+    runBleFrame(247, 15000, 3, 6, state);
+}
+BENCHMARK_ITERATIONS(BM_ble_frame_mtu247, 4);
+
+void BM_ble_frame_mtu247_fastInterval(benchmarkState& state){
+    runBleFrame(247, 7500, 3, 6, state);
+}
+BENCHMARK_ITERATIONS(BM_ble_frame_mtu247_fastInterval, 4);
+
+// A controller that sends fewer notifications per event than the credits assume: refusals, the link still completes.
+void BM_ble_frame_mtu247_slowController(benchmarkState& state){
+    runBleFrame(247, 15000, 1, 2, state);
+}
+BENCHMARK_ITERATIONS(BM_ble_frame_mtu247_slowController, 2);
+
+// A command line written to the control characteristic, served as loop() does, its response read back from it.
+void BM_ble_command_getCameraSettings(benchmarkState& state){
+    char line[COMMAND_LINE_WIDTH];
+    BLE.connect(247, 15000, 3, 6);
+    size_t bytes = 0;
+    while(state.keepRunning()){
+        bleControl.received.clear();
+        BLE.write(bleControl, "getCameraSettings\r");
+        memset(line, 0, sizeof(line));
+        while(!bleLink.readLine(line, sizeof(line)));
+        commandLink = &bleLink;
+        argx_type argx = parseArgx(line, sizeof(line), true);
+        executeCommands(argx.argc, argx.argv);
+        freeArgx(&argx);
+        arenaReset();
+        commandLink = &serialLink;
+        while(bleControl.received.find("Frame period") == std::string::npos || bleLink.pending() != 0 || !BLE.queue.empty()){
+            bleLink.flush();
+            BLE.poll();
+            delayMicroseconds(200);
+        }
+        bytes += bleControl.received.size();
+    }
+    state.counters["bytes/op"] = (double) bytes / state.iterations;
+    state.counters["notif/op"] = (double) BLE.stats.notifications / state.iterations;
+    BLE.disconnect();
+}
+BENCHMARK_ITERATIONS(BM_ble_command_getCameraSettings, 10);
+
+// One producer (the benchmark thread) and one consumer thread handing items through a 16-slot ring, both spinning
+// when it is full or empty, yielding so that it also works on a single core host. The consumer checks the order, out/op is the items it saw out of sequence (must be 0).
+typedef struct{
+    uint32_t sequence;
+    byte line[60];          // With the sequence, one QQVGA grayscale half line.
+} ringLine;
+
+template<typename T, typename R>
+static void runRingContention(R& ring, benchmarkState& state){
+    uint64_t items = state.iterations;
+    uint64_t outOfOrder = 0;
+    uint64_t emptySpins = 0;
+    std::thread consumer([&](){
+        for(uint64_t expected = 0; expected < items; expected++){
+            T* slot;
+            while((slot = ring.peek()) == NULL){
+                emptySpins++;
+                std::this_thread::yield();
+            }
+            if(slot->sequence != (uint32_t) expected){
+                outOfOrder++;
+            }
+            ring.release();
+        }
+    });
+    uint64_t fullSpins = 0;
+    uint32_t sequence = 0;
+    while(state.keepRunning()){
+        T* slot;
+        while((slot = ring.claim()) == NULL){
+            fullSpins++;
+            std::this_thread::yield();
+        }
+        slot->sequence = sequence++;
+        ring.commit();
+    }
+    consumer.join();
+    state.pauseTiming();
+    state.counters["fullSpins/op"] = (double) fullSpins / items;
+    state.counters["emptySpins/op"] = (double) emptySpins / items;
+    state.counters["out/op"] = (double) outOfOrder / items;
+    state.itemsProcessed = items;
+}
+
+// Same claim/commit interface over a mutex, what the ring replaces.
+template<typename T, size_t CAPACITY>
+class mutexRing{
+    public:
+        T* claim(){
+            std::lock_guard<std::mutex> lock(mutex);
+            return (head - tail == CAPACITY) ? NULL : &slots[head % CAPACITY];
+        }
+        void commit(){
+            std::lock_guard<std::mutex> lock(mutex);
+            head++;
+        }
+        T* peek(){
+            std::lock_guard<std::mutex> lock(mutex);
+            return (head == tail) ? NULL : &slots[tail % CAPACITY];
+        }
+        void release(){
+            std::lock_guard<std::mutex> lock(mutex);
+            tail++;
+        }
+
+    private:
+        std::mutex mutex;
+        size_t head = 0;
+        size_t tail = 0;
+        T slots[CAPACITY];
+};
+
+void BM_spscRing_uncontended(benchmarkState& state){
+    static spscRing<uint32_t, 16> ring;
+    uint32_t value = 0;
+    while(state.keepRunning()){
+        ring.push(value);
+        ring.pop(value);
+    }
+    state.itemsProcessed = state.iterations;
+}
+BENCHMARK(BM_spscRing_uncontended);
+
+void BM_spscRing_contention_lines(benchmarkState& state){
+    static spscRing<ringLine, 16> ring;
+    ring.clear();
+    runRingContention<ringLine>(ring, state);
+}
+BENCHMARK(BM_spscRing_contention_lines);
+
+void BM_mutexRing_contention_lines(benchmarkState& state){
+    static mutexRing<ringLine, 16> ring;
+    runRingContention<ringLine>(ring, state);
+}
+BENCHMARK(BM_mutexRing_contention_lines);
+
+// First-fit heap with coalescing over a fixed region, a model of what newlib leaves of the nRF52840 RAM, so that the
+// largest free block can be read after every step.
+#define MODEL_HEAP_BYTES 184320
+#define MODEL_HEAP_ALIGN 8
+
+typedef struct modelBlock{
+    size_t size;                // Bytes after the header.
+    bool free;
+    struct modelBlock* next;    // In address order.
+} modelBlock;
+
+class modelHeap{
+    public:
+        void begin(){
+            first = (modelBlock*) memory;
+            first->size = MODEL_HEAP_BYTES - sizeof(modelBlock);
+            first->free = true;
+            first->next = NULL;
+        }
+
+        void* allocate(size_t size){
+            size = (size + MODEL_HEAP_ALIGN - 1) & ~((size_t) MODEL_HEAP_ALIGN - 1);
+            for(modelBlock* block = first; block != NULL; block = block->next){
+                if(!block->free || block->size < size){
+                    continue;
+                }
+                if(block->size >= size + sizeof(modelBlock) + MODEL_HEAP_ALIGN){
+                    modelBlock* rest = (modelBlock*) ((byte*) (block + 1) + size);
+                    rest->size = block->size - size - sizeof(modelBlock);
+                    rest->free = true;
+                    rest->next = block->next;
+                    block->next = rest;
+                    block->size = size;
+                }
+                block->free = false;
+                return block + 1;
+            }
+            return NULL;
+        }
+
+        void release(void* pointer){
+            if(pointer == NULL){
+                return;
+            }
+            ((modelBlock*) pointer - 1)->free = true;
+            for(modelBlock* block = first; block != NULL; block = block->next){
+                while(block->free && block->next != NULL && block->next->free){
+                    block->size += sizeof(modelBlock) + block->next->size;
+                    block->next = block->next->next;
+                }
+            }
+        }
+
+        void* reallocate(void* pointer, size_t size){
+            if(pointer == NULL){
+                return allocate(size);
+            }
+            void* block = allocate(size);
+            if(block != NULL){
+                size_t oldSize = ((modelBlock*) pointer - 1)->size;
+                memcpy(block, pointer, (oldSize < size) ? oldSize : size);
+                release(pointer);
+            }
+            return block;
+        }
+
+        size_t largestFree() const{
+            size_t largest = 0;
+            for(modelBlock* block = first; block != NULL; block = block->next){
+                if(block->free && block->size > largest){
+                    largest = block->size;
+                }
+            }
+            return largest;
+        }
+
+        size_t freeBlocks() const{
+            size_t count = 0;
+            for(modelBlock* block = first; block != NULL; block = block->next){
+                count += block->free ? 1 : 0;
+            }
+            return count;
+        }
+
+    private:
+        alignas(MODEL_HEAP_ALIGN) byte memory[MODEL_HEAP_BYTES];
+        modelBlock* first = NULL;
+};
+
+static modelHeap* argtableHeap = NULL;
+static void* modelMalloc(size_t size){ return argtableHeap->allocate(size); }
+static void* modelRealloc(void* pointer, size_t size){ return argtableHeap->reallocate(pointer, size); }
+static void modelFree(void* pointer){ argtableHeap->release(pointer); }
+
+// A session of commands on the modelled heap, each one resizing the frame buffer the way setResolution, setFormat and
+// takePhoto do. With the arena only the frame buffer is on the heap, without it the command tables built by
+// setupCommands(), every argtable3 allocation and the parseArgx() line copy and argv (modelled at their sizes) share it. minLargestFree is the largest frame buffer that could have been
+// allocated at the worst point of the session, finalLargestFree the same after the last cycle.
+static void runFragmentation(bool arena, benchmarkState& state){
+    static const char* commands[] = {"getCameraSettings", "stream start --help", "stats", "help", "profile list", "setFPS --help", "invalid command"};
+    static const size_t frameSizes[] = {153600, 38400, 76800, 19200, 115200, 9600, 57600};
+    static modelHeap heaps[2];
+    modelHeap* heap = &heaps[arena ? 1 : 0];
+    heap->begin();
+    if(!arena){
+        argtableHeap = heap;
+        arg_set_allocator(&modelMalloc, &modelRealloc, &modelFree);
+        setupCommands();
+    }
+
+    size_t startLargest = heap->largestFree();
+    size_t minLargest = startLargest;
+    size_t maxFreeBlocks = 0;
+    uint32_t failed = 0;
+    void* frameBuffer = NULL;
+    uint32_t step = 0;
+    while(state.keepRunning()){
+        loadCommandLine(commands[step % 7]);
+        argx_type argx = parseArgx(commandLine, sizeof(commandLine), true);
+        void* lineCopy = arena ? NULL : heap->allocate(sizeof(commandLine) + 1);
+        void* argv = arena ? NULL : heap->allocate(argx.argc * sizeof(char*));
+        executeCommands(argx.argc, argx.argv);
+        heap->release(frameBuffer);
+        size_t largest = heap->largestFree();
+        frameBuffer = heap->allocate(frameSizes[(step * 3) % 7]);
+        failed += (frameBuffer == NULL) ? 1 : 0;
+        heap->release(argv);
+        heap->release(lineCopy);
+        freeArgx(&argx);
+        arenaReset();
+        step++;
+        minLargest = (largest < minLargest) ? largest : minLargest;
+        maxFreeBlocks = (heap->freeBlocks() > maxFreeBlocks) ? heap->freeBlocks() : maxFreeBlocks;
+    }
+    heap->release(frameBuffer);
+    state.counters["startLargestFree"] = startLargest;
+    state.counters["minLargestFree"] = minLargest;
+    state.counters["finalLargestFree"] = heap->largestFree();
+    state.counters["maxFreeBlocks"] = maxFreeBlocks;
+    state.counters["failed"] = failed;
+
+    if(!arena){
+        arenaBegin();
+        arenaSeal();
+    }
+}
+
+void BM_fragmentation_heap(benchmarkState& state){
+    runFragmentation(false, state);
+}
+BENCHMARK_ITERATIONS(BM_fragmentation_heap, 2000);
+
+void BM_fragmentation_arena(benchmarkState& state){
+    runFragmentation(true, state);
+}
+BENCHMARK_ITERATIONS(BM_fragmentation_arena, 2000);
+
+int main(int argc, char** argv){
+    simulation.beginMillis = 0;
+    Serial.fd = open("/dev/null", O_WRONLY);
+    Serial.begin(115200);
+    setupCamera(1);
+    arenaBegin();
+    setupCommands();
+    arenaSeal();
+    BLE.radio = true;
+    bleLink.begin();
+    return runBenchmarks(argc, argv);
+}
@@ -0,0 +1,188 @@
+#ifndef MICROBENCH_H
+#define MICROBENCH_H
+
+// Minimal Google-Benchmark style harness for the native environment.
+//
+//   void BM_something(benchmarkState& state){
+//       while(state.keepRunning()){ ... }
+//       state.counters["writes/op"] = ...;
+//   }
+//   BENCHMARK(BM_something);
+//
+// The iteration count doubles until a run lasts --min-time seconds, the last run is reported.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+class benchmarkState{
+    public:
+        explicit benchmarkState(uint64_t iterations) : iterations(iterations){}
+
+        bool keepRunning(){
+            if(completed == 0 && !started){
+                started = true;
+                resumeTiming();
+            }
+            if(completed < iterations){
+                completed++;
+                return true;
+            }
+            pauseTiming();
+            return false;
+        }
+
+        void pauseTiming(){
+            if(running){
+                elapsed += std::chrono::steady_clock::now() - start;
+                running = false;
+            }
+        }
+
+        void resumeTiming(){
+            if(!running){
+                start = std::chrono::steady_clock::now();
+                running = true;
+            }
+        }
+
+        // Time reported instead of the measured one, for benchmarks of modelled device time.
+        void setIterationTime(double seconds){
+            manualSeconds += seconds;
+            manualTime = true;
+        }
+
+        double seconds() const{
+            return manualTime ? manualSeconds : std::chrono::duration<double>(elapsed).count();
+        }
+
+        uint64_t iterations;
+        uint64_t bytesProcessed = 0;
+        uint64_t itemsProcessed = 0;
+        std::map<std::string, double> counters;
+
+    private:
+        uint64_t completed = 0;
+        bool started = false;
+        bool running = false;
+        bool manualTime = false;
+        double manualSeconds = 0;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::duration::zero();
+};
+
+typedef void (*benchmarkFunction)(benchmarkState& state);
+
+typedef struct{
+    const char* name;
+    benchmarkFunction function;
+    uint64_t fixedIterations;
+} benchmarkEntry;
+
+inline std::vector<benchmarkEntry>& benchmarkRegistry(){
+    static std::vector<benchmarkEntry> registry;
+    return registry;
+}
+
+inline int registerBenchmark(const char* name, benchmarkFunction function, uint64_t fixedIterations = 0){
+    benchmarkRegistry().push_back({name, function, fixedIterations});
+    return 0;
+}
+
+#define BENCHMARK_CONCAT_INNER(a, b) a##b
+#define BENCHMARK_CONCAT(a, b) BENCHMARK_CONCAT_INNER(a, b)
+#define BENCHMARK(function) static int BENCHMARK_CONCAT(function##Registered, __LINE__) = registerBenchmark(#function, function)
+// For slow benchmarks (modelled sensor or link time) that must not be repeated until --min-time.
+#define BENCHMARK_ITERATIONS(function, count) static int BENCHMARK_CONCAT(function##Registered, __LINE__) = registerBenchmark(#function, function, count)
+
+inline int runBenchmarks(int argc, char** argv){
+    double minTime = 0.5;
+    const char* filter = NULL;
+    bool json = false;
+    for(int index = 1; index < argc; index++){
+        if(strncmp(argv[index], "--min-time=", 11) == 0){
+            minTime = atof(argv[index] + 11);
+        }
+        else if(strncmp(argv[index], "--filter=", 9) == 0){
+            filter = argv[index] + 9;
+        }
+        else if(strcmp(argv[index], "--json") == 0){
+            json = true;
+        }
+        else{
+            fprintf(stderr, "Usage: %s [--filter=SUBSTRING] [--min-time=SECONDS] [--json]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if(json){
+        printf("[\n");
+    }
+    else{
+        printf("%-48s %14s %12s  %s\n", "Benchmark", "Time/op", "Iterations", "Counters");
+    }
+
+    bool first = true;
+    for(const benchmarkEntry& entry : benchmarkRegistry()){
+        if(filter != NULL && strstr(entry.name, filter) == NULL){
+            continue;
+        }
+
+        uint64_t iterations = (entry.fixedIterations != 0) ? entry.fixedIterations : 1;
+        while(true){
+            benchmarkState state(iterations);
+            entry.function(state);
+            double seconds = state.seconds();
+            if(entry.fixedIterations != 0 || seconds >= minTime || iterations >= (1ull << 40)){
+                double perIteration = seconds / iterations;
+                if(state.bytesProcessed != 0){
+                    state.counters["bytes/s"] = state.bytesProcessed / seconds;
+                }
+                if(state.itemsProcessed != 0){
+                    state.counters["items/s"] = state.itemsProcessed / seconds;
+                }
+
+                if(json){
+                    printf("%s  {\"name\": \"%s\", \"iterations\": %llu, \"secondsPerIteration\": %.9g", first ? "" : ",\n", entry.name, (unsigned long long) iterations, perIteration);
+                    for(const auto& counter : state.counters){
+                        printf(", \"%s\": %.6g", counter.first.c_str(), counter.second);
+                    }
+                    printf("}");
+                }
+                else{
+                    char time[32];
+                    if(perIteration >= 1e-3){
+                        snprintf(time, sizeof(time), "%.3f ms", perIteration * 1e3);
+                    }
+                    else if(perIteration >= 1e-6){
+                        snprintf(time, sizeof(time), "%.3f us", perIteration * 1e6);
+                    }
+                    else{
+                        snprintf(time, sizeof(time), "%.1f ns", perIteration * 1e9);
+                    }
+                    printf("%-48s %14s %12llu ", entry.name, time, (unsigned long long) iterations);
+                    for(const auto& counter : state.counters){
+                        printf(" %s=%.4g", counter.first.c_str(), counter.second);
+                    }
+                    printf("\n");
+                }
+                first = false;
+                break;
+            }
+            // Aim straight for minTime once the run is long enough to be measured.
+            iterations = (seconds > minTime / 100) ? (uint64_t) (iterations * minTime * 1.2 / seconds) + 1 : iterations * 10;
+        }
+    }
+
+    if(json){
+        printf("\n]\n");
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,288 @@
+// Host implementation of the Arduino core subset declared in tools/native/include/Arduino.h.
+
+#include <Arduino.h>
+#include "simulation.h"
+
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#define SERIAL_WRITE_STALL_MS 1000
+#define SERIAL_TX_QUEUE_BYTES 1024  // Data the modelled USB stack takes before write() waits for the link.
+#define CDC_PACKET_BYTES 64
+#define CDC_PACKET_MICROS 52        // Full-speed bulk, about 19 packets of 64 bytes per 1 ms frame.
+#define CDC_WRITE_MICROS 15         // USBCDC::send() setting up a transfer and taking its completion interrupt.
+#define CDC_SHORT_PACKET_MICROS 500 // A short packet ends the host's read, the next is asked for half a frame later on average.
+
+simulationConfig simulation = {0, 0.8, 1000, NULL, 0, 0};
+HardwareSerial Serial;
+
+static const std::chrono::steady_clock::time_point clockStart = std::chrono::steady_clock::now();
+static uint8_t pinState[64];
+
+uint64_t simulationMicros(){
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - clockStart).count();
+}
+
+void simulationSleepUntil(uint64_t deadlineMicros){
+    uint64_t now = simulationMicros();
+    if(deadlineMicros > now){
+        std::this_thread::sleep_for(std::chrono::microseconds(deadlineMicros - now));
+    }
+}
+
+unsigned long millis(){
+    return simulationMicros() / 1000;
+}
+
+unsigned long micros(){
+    return simulationMicros();
+}
+
+void delay(unsigned long ms){
+    simulationSleepUntil(simulationMicros() + (uint64_t) ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us){
+    simulationSleepUntil(simulationMicros() + us);
+}
+
+void yield(){
+    std::this_thread::yield();
+}
+
+void pinMode(uint8_t pin, uint8_t mode){
+    (void) pin;
+    (void) mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value){
+    if(pin < sizeof(pinState)){
+        pinState[pin] = value;
+    }
+}
+
+int digitalRead(uint8_t pin){
+    return (pin < sizeof(pinState)) ? pinState[pin] : LOW;
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size){
+    size_t written = 0;
+    while(written < size && write(buffer[written])){
+        written++;
+    }
+    return written;
+}
+
+size_t Print::printNumber(unsigned long long value, int base){
+    char buffer[8 * sizeof(value) + 1];
+    char* digit = &buffer[sizeof(buffer) - 1];
+    *digit = '\0';
+    if(base < 2){
+        base = 10;
+    }
+    do{
+        uint8_t remainder = value % base;
+        *--digit = (remainder < 10) ? '0' + remainder : 'A' + remainder - 10;
+        value /= base;
+    } while(value != 0);
+    return write(digit);
+}
+
+size_t Print::printSigned(long long value, int base){
+    if(value < 0 && base == DEC){
+        return print('-') + printNumber(-(unsigned long long) value, base);
+    }
+    return printNumber((unsigned long long) value, base);
+}
+
+size_t Print::print(double value, int digits){
+    char buffer[48];
+    snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+    return write(buffer);
+}
+
+int Stream::timedRead(){
+    unsigned long start = millis();
+    do{
+        int value = read();
+        if(value >= 0){
+            return value;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    } while(millis() - start < _timeout);
+    return -1;
+}
+
+size_t Stream::readBytes(char* buffer, size_t length){
+    size_t count = 0;
+    while(count < length){
+        int value = timedRead();
+        if(value < 0){
+            break;
+        }
+        buffer[count++] = (char) value;
+    }
+    return count;
+}
+
+size_t Stream::readBytesUntil(char terminator, char* buffer, size_t length){
+    size_t count = 0;
+    while(count < length){
+        int value = timedRead();
+        if(value < 0 || value == terminator){
+            break;
+        }
+        buffer[count++] = (char) value;
+    }
+    return count;
+}
+
+void HardwareSerial::begin(unsigned long baudrate){
+    this->baudrate = baudrate;
+}
+
+void HardwareSerial::end(){
+}
+
+HardwareSerial::operator bool(){
+    return fd >= 0;
+}
+
+int HardwareSerial::available(){
+    int pending = 0;
+    if(fd < 0 || ioctl(fd, FIONREAD, &pending) != 0){
+        pending = 0;
+    }
+    return pending + ((peeked >= 0) ? 1 : 0);
+}
+
+int HardwareSerial::read(){
+    if(peeked >= 0){
+        int value = peeked;
+        peeked = -1;
+        return value;
+    }
+    uint8_t value;
+    if(fd < 0 || ::read(fd, &value, 1) != 1){
+        return -1;
+    }
+    return value;
+}
+
+int HardwareSerial::peek(){
+    if(peeked < 0){
+        peeked = read();
+    }
+    return peeked;
+}
+
+size_t HardwareSerial::write(uint8_t value){
+    return write(&value, 1);
+}
+
+static size_t writeDescriptor(int fd, const uint8_t* buffer, size_t size){
+    size_t written = 0;
+    while(written < size){
+        ssize_t result = ::write(fd, buffer + written, size - written);
+        if(result > 0){
+            written += result;
+            continue;
+        }
+        if(result < 0 && errno != EAGAIN && errno != EINTR){
+            break;
+        }
+        struct pollfd writable = {fd, POLLOUT, 0};
+        if(poll(&writable, 1, SERIAL_WRITE_STALL_MS) <= 0){
+            break;
+        }
+    }
+    return written;
+}
+
+// Errors of a busy hub, packet by packet: a lost packet takes its 64 bytes out of the output, a corrupted one has a
+// byte flipped. The generator is seeded once, a run with the same rates and traffic loses the same packets.
+static std::mt19937 errorGenerator(1);
+
+static void injectErrors(const uint8_t* buffer, size_t size, std::vector<uint8_t>& output){
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    output.clear();
+    for(size_t offset = 0; offset < size; offset += CDC_PACKET_BYTES){
+        size_t packet = (size - offset < CDC_PACKET_BYTES) ? size - offset : CDC_PACKET_BYTES;
+        if(chance(errorGenerator) < simulation.dropRate){
+            continue;
+        }
+        size_t start = output.size();
+        output.insert(output.end(), buffer + offset, buffer + offset + packet);
+        if(chance(errorGenerator) < simulation.corruptRate){
+            output[start + errorGenerator() % packet] ^= 1 << (errorGenerator() % 8);
+        }
+    }
+}
+
+static uint64_t linkBusyUntil = 0; // When the modelled link has sent everything queued so far.
+static std::mutex writeMutex;       // The mbed USB CDC class serialises writes from several threads the same way.
+
+// Blocks like the USB CDC stack: data leaves in 1 ms slices at the modelled link rate, and waits while the host is not reading.
+// Up to SERIAL_TX_QUEUE_BYTES are queued without waiting, availableForWrite() reports the room left.
+// Output is dropped when nobody reads the pty for SERIAL_WRITE_STALL_MS, as a board without a host would.
+// The CDC bulk endpoint is modelled alongside, in counters only: every call is a transfer of 64 byte packets that ends
+// with a short one unless its size is a multiple of 64.
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size){
+    if(fd < 0){
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(writeMutex);
+    writeCalls++;
+    writtenBytes += size;
+    uint64_t packets = (size + CDC_PACKET_BYTES - 1) / CDC_PACKET_BYTES;
+    bool shortPacket = (size % CDC_PACKET_BYTES != 0);
+    cdcPackets += packets;
+    cdcShortPackets += shortPacket ? 1 : 0;
+    cdcMicros += CDC_WRITE_MICROS + packets * CDC_PACKET_MICROS + (shortPacket ? CDC_SHORT_PACKET_MICROS : 0);
+    size_t requested = size;
+    static std::vector<uint8_t> damaged;
+    if(simulation.dropRate > 0 || simulation.corruptRate > 0){
+        injectErrors(buffer, size, damaged);
+        buffer = damaged.data();
+        size = damaged.size();
+    }
+    if(simulation.linkBytesPerSecond <= 0){
+        writeDescriptor(fd, buffer, size);
+        return requested;
+    }
+
+    size_t sliceSize = (size_t) (simulation.linkBytesPerSecond / 1000);
+    sliceSize = (sliceSize < 64) ? 64 : sliceSize;
+    for(size_t offset = 0; offset < size; offset += sliceSize){
+        size_t slice = (size - offset < sliceSize) ? size - offset : sliceSize;
+        uint64_t now = simulationMicros();
+        linkBusyUntil = ((linkBusyUntil > now) ? linkBusyUntil : now) + (uint64_t) (slice * 1000000.0 / simulation.linkBytesPerSecond);
+        uint64_t queueMicros = (uint64_t) (SERIAL_TX_QUEUE_BYTES * 1000000.0 / simulation.linkBytesPerSecond);
+        simulationSleepUntil((linkBusyUntil > queueMicros) ? linkBusyUntil - queueMicros : 0);
+        writeDescriptor(fd, buffer + offset, slice);
+    }
+    return requested;
+}
+
+int HardwareSerial::availableForWrite(){
+    std::lock_guard<std::mutex> lock(writeMutex);
+    if(simulation.linkBytesPerSecond > 0){
+        uint64_t now = simulationMicros();
+        int queued = (linkBusyUntil > now) ? (int) ((linkBusyUntil - now) * simulation.linkBytesPerSecond / 1000000.0) + 1 : 0;
+        return (queued < SERIAL_TX_QUEUE_BYTES) ? SERIAL_TX_QUEUE_BYTES - queued : 0;
+    }
+    int queued = 0;
+    ioctl(fd, TIOCOUTQ, &queued);
+    return (queued < 4096) ? 4096 - queued : 0;
+}
+
+void HardwareSerial::flush(){
+}
@@ -0,0 +1,23 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+// Knobs of the simulated board, set by tools/native/simulator.cpp, never seen by the firmware sources.
+
+#include <stdint.h>
+
+typedef struct{
+    double linkBytesPerSecond;  // USB CDC throughput, 0 disables throttling.
+    double readoutFraction;     // Part of the frame period spent clocking lines out of the sensor.
+    unsigned long beginMillis;  // Time Camera.begin() spends, the library waits 1 s for the sensor.
+    const char* replayPath;     // .n3raw capture replayed by the sensor, NULL for synthetic frames.
+    double dropRate;            // Probability that a 64 byte USB packet sent to the host is lost.
+    double corruptRate;         // Probability that one byte of a packet is flipped.
+} simulationConfig;
+
+extern simulationConfig simulation;
+
+uint64_t simulationMicros();
+void simulationSleepUntil(uint64_t deadlineMicros);
+void simulationFillFrame(uint8_t* buffer, int width, int height, int format, uint32_t sequence);
+
+#endif
@@ -0,0 +1,134 @@
+// Runs the unmodified firmware (setup()/loop() from src/main.cpp) on Linux, serving Serial on a pseudo-terminal.
+//
+//   simulator [--link PATH] [--bandwidth BYTES_PER_S] [--readout FRACTION] [--begin-ms MS] [--replay FILE.n3raw] [--drop P] [--corrupt P]
+//
+// The pty slave path is printed on stdout, --link also exposes it as a stable symlink for the host tools.
+// --drop and --corrupt lose or damage that share of the 64 byte packets sent to the host, as a busy USB hub would.
+
+#include <Arduino.h>
+#include "simulation.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+void setup();
+void loop();
+bool loopDrivesCapture(); // src/stream.h, the board does not idle between loop() calls while it reads a frame.
+
+static volatile sig_atomic_t running = 1;
+
+static void stopSimulation(int signalNumber){
+    (void) signalNumber;
+    running = 0;
+}
+
+static void printUsage(const char* programName){
+    fprintf(stderr, "Usage: %s [--link PATH] [--bandwidth BYTES_PER_S] [--readout FRACTION] [--begin-ms MS] [--replay FILE.n3raw] [--drop P] [--corrupt P]\n", programName);
+}
+
+int main(int argc, char** argv){
+    const char* linkPath = NULL;
+    static const struct option options[] = {
+        {"link", required_argument, NULL, 'l'},
+        {"bandwidth", required_argument, NULL, 'b'},
+        {"readout", required_argument, NULL, 'r'},
+        {"begin-ms", required_argument, NULL, 'm'},
+        {"replay", required_argument, NULL, 'p'},
+        {"drop", required_argument, NULL, 'd'},
+        {"corrupt", required_argument, NULL, 'c'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    int option;
+    while((option = getopt_long(argc, argv, "l:b:r:m:p:d:c:h", options, NULL)) != -1){
+        switch(option){
+            case 'l':
+                linkPath = optarg;
+            break;
+
+            case 'b':
+                simulation.linkBytesPerSecond = atof(optarg);
+            break;
+
+            case 'r':
+                simulation.readoutFraction = atof(optarg);
+            break;
+
+            case 'm':
+                simulation.beginMillis = strtoul(optarg, NULL, 10);
+            break;
+
+            case 'p':
+                simulation.replayPath = optarg;
+            break;
+
+            case 'd':
+                simulation.dropRate = atof(optarg);
+            break;
+
+            case 'c':
+                simulation.corruptRate = atof(optarg);
+            break;
+
+            default:
+                printUsage(argv[0]);
+                return (option == 'h') ? 0 : 1;
+        }
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(master < 0 || grantpt(master) != 0 || unlockpt(master) != 0){
+        perror("Failed to create pseudo-terminal");
+        return 1;
+    }
+    const char* slavePath = ptsname(master);
+
+    // Keeping a slave descriptor open stops the master from hanging up while no host is connected.
+    int slave = open(slavePath, O_RDWR | O_NOCTTY);
+    struct termios settings;
+    if(slave < 0 || tcgetattr(slave, &settings) != 0){
+        perror("Failed to open pseudo-terminal slave");
+        return 1;
+    }
+    cfmakeraw(&settings);
+    tcsetattr(slave, TCSANOW, &settings);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+    if(linkPath != NULL){
+        unlink(linkPath);
+        if(symlink(slavePath, linkPath) != 0){
+            perror("Failed to create link");
+            return 1;
+        }
+    }
+
+    signal(SIGINT, stopSimulation);
+    signal(SIGTERM, stopSimulation);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("%s\n", (linkPath != NULL) ? linkPath : slavePath);
+    fflush(stdout);
+
+    Serial.fd = master;
+    setup();
+    while(running){
+        loop();
+        if(Serial.available() == 0 && !loopDrivesCapture()){
+            usleep(100);
+        }
+    }
+
+    if(linkPath != NULL){
+        unlink(linkPath);
+    }
+    close(slave);
+    close(master);
+    return 0;
+}
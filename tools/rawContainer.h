@@ -0,0 +1,300 @@
+#ifndef RAW_CONTAINER_H
+#define RAW_CONTAINER_H
+
+// Seekable raw-frame container (.n3raw), host side (POSIX) writer and mmap reader.
+// The layout is described in tools/rawContainer.py, both implementations must stay in sync.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define RAW_CONTAINER_MAGIC "N33BLRAW"
+#define RAW_CONTAINER_FOOTER_MAGIC "N33BLIDX"
+#define RAW_CONTAINER_RECORD_MAGIC "N3FR"
+#define RAW_CONTAINER_VERSION 1
+#define RAW_CONTAINER_ALIGNMENT 8
+#define RAW_CONTAINER_FLAG_INDEXED 0x0001
+
+#pragma pack(push, 1)
+typedef struct{
+    char magic[8];
+    uint16_t version;
+    uint16_t headerSize;
+    uint16_t recordSize;
+    uint16_t flags;
+    uint64_t createdMicros;
+    uint32_t frameCount;
+    uint32_t reserved;
+} rawContainerHeader;
+
+typedef struct{
+    char magic[4];
+    uint32_t size;
+    uint64_t offset;
+    uint32_t sequence;
+    uint16_t width;
+    uint16_t height;
+    uint8_t format;
+    uint8_t bytesPerPixel;
+    uint16_t flags;
+    uint32_t crc;
+    uint64_t timestamp;
+} rawFrameRecord;
+
+typedef struct{
+    uint64_t indexOffset;
+    uint32_t frameCount;
+    uint32_t indexCrc;
+    char magic[8];
+} rawContainerFooter;
+#pragma pack(pop)
+
+static_assert(sizeof(rawContainerHeader) == 32, "rawContainerHeader layout changed");
+static_assert(sizeof(rawFrameRecord) == 40, "rawFrameRecord layout changed");
+static_assert(sizeof(rawContainerFooter) == 24, "rawContainerFooter layout changed");
+
+// CRC-32 (IEEE 802.3, reflected), same values as zlib.crc32.
+static uint32_t rawContainerCrc32(const uint8_t* data, size_t size, uint32_t crc = 0){
+    static uint32_t table[256];
+    static bool tableReady = false;
+    if(!tableReady){
+        for(uint32_t index = 0; index < 256; index++){
+            uint32_t value = index;
+            for(uint8_t bit = 0; bit < 8; bit++){
+                value = (value & 1) ? (0xEDB88320 ^ (value >> 1)) : (value >> 1);
+            }
+            table[index] = value;
+        }
+        tableReady = true;
+    }
+
+    crc = ~crc;
+    for(size_t index = 0; index < size; index++){
+        crc = table[(crc ^ data[index]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static uint8_t rawContainerBytesPerPixel(uint8_t format){
+    return (format == 4) ? 1 : 2; // GRAYSCALE keeps only the luma byte.
+}
+
+static int rawContainerWriteAll(int fd, const void* data, size_t size){
+    const uint8_t* bytes = (const uint8_t*) data;
+    while(size > 0){
+        ssize_t written = write(fd, bytes, size);
+        if(written <= 0){
+            return 1;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return 0;
+}
+
+typedef struct{
+    int fd;
+    uint64_t position;
+    uint64_t createdMicros;
+    rawFrameRecord* index;
+    uint32_t frameCount;
+    uint32_t indexCapacity;
+} rawContainerWriter;
+
+static int rawContainerWriteHeader(rawContainerWriter* writer, uint16_t flags){
+    rawContainerHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, RAW_CONTAINER_MAGIC, sizeof(header.magic));
+    header.version = RAW_CONTAINER_VERSION;
+    header.headerSize = sizeof(rawContainerHeader);
+    header.recordSize = sizeof(rawFrameRecord);
+    header.flags = flags;
+    header.createdMicros = writer->createdMicros;
+    header.frameCount = writer->frameCount;
+    if(pwrite(writer->fd, &header, sizeof(header), 0) != (ssize_t) sizeof(header)){
+        return 1;
+    }
+    return 0;
+}
+
+int rawContainerCreate(rawContainerWriter* writer, const char* path){
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(writer->fd < 0){
+        return 1;
+    }
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    writer->createdMicros = (uint64_t) now.tv_sec * 1000000 + now.tv_usec;
+    writer->position = sizeof(rawContainerHeader);
+    if(rawContainerWriteHeader(writer, 0) || lseek(writer->fd, writer->position, SEEK_SET) < 0){
+        close(writer->fd);
+        return 1;
+    }
+    return 0;
+}
+
+// Appends one frame, record->size/offset/crc/bytesPerPixel are filled in by the writer.
+int rawContainerAppend(rawContainerWriter* writer, const uint8_t* payload, uint32_t size, rawFrameRecord* record){
+    if(writer->frameCount == writer->indexCapacity){
+        uint32_t capacity = (writer->indexCapacity == 0) ? 64 : writer->indexCapacity * 2;
+        rawFrameRecord* index = (rawFrameRecord*) realloc(writer->index, capacity * sizeof(rawFrameRecord));
+        if(index == NULL){
+            return 1;
+        }
+        writer->index = index;
+        writer->indexCapacity = capacity;
+    }
+
+    memcpy(record->magic, RAW_CONTAINER_RECORD_MAGIC, sizeof(record->magic));
+    record->size = size;
+    record->offset = writer->position + sizeof(rawFrameRecord);
+    record->bytesPerPixel = rawContainerBytesPerPixel(record->format);
+    record->crc = rawContainerCrc32(payload, size);
+
+    static const uint8_t padding[RAW_CONTAINER_ALIGNMENT] = {0};
+    size_t paddingSize = (RAW_CONTAINER_ALIGNMENT - (size % RAW_CONTAINER_ALIGNMENT)) % RAW_CONTAINER_ALIGNMENT;
+    if(rawContainerWriteAll(writer->fd, record, sizeof(rawFrameRecord)) ||
+       rawContainerWriteAll(writer->fd, payload, size) ||
+       rawContainerWriteAll(writer->fd, padding, paddingSize)){
+        return 1;
+    }
+
+    writer->position += sizeof(rawFrameRecord) + size + paddingSize;
+    writer->index[writer->frameCount] = *record;
+    writer->frameCount++;
+    return 0;
+}
+
+int rawContainerClose(rawContainerWriter* writer){
+    rawContainerFooter footer;
+    memcpy(footer.magic, RAW_CONTAINER_FOOTER_MAGIC, sizeof(footer.magic));
+    footer.indexOffset = writer->position;
+    footer.frameCount = writer->frameCount;
+    footer.indexCrc = rawContainerCrc32((const uint8_t*) writer->index, writer->frameCount * sizeof(rawFrameRecord));
+
+    int result = rawContainerWriteAll(writer->fd, writer->index, writer->frameCount * sizeof(rawFrameRecord)) ||
+                 rawContainerWriteAll(writer->fd, &footer, sizeof(footer)) ||
+                 rawContainerWriteHeader(writer, RAW_CONTAINER_FLAG_INDEXED);
+
+    close(writer->fd);
+    free(writer->index);
+    writer->index = NULL;
+    return result;
+}
+
+typedef struct{
+    int fd;
+    const uint8_t* map;
+    size_t mapSize;
+    const rawContainerHeader* header;
+    const rawFrameRecord* index;    // Trailing index, NULL when the file had to be recovered.
+    uint64_t* scannedOffsets;       // Record offsets found by scanning an unfinished file.
+    uint32_t frameCount;
+} rawContainerReader;
+
+static void rawContainerScan(rawContainerReader* reader){
+    uint32_t capacity = 0;
+    uint64_t position = sizeof(rawContainerHeader);
+    while(position + sizeof(rawFrameRecord) <= reader->mapSize){
+        const rawFrameRecord* record = (const rawFrameRecord*) (reader->map + position);
+        if(memcmp(record->magic, RAW_CONTAINER_RECORD_MAGIC, sizeof(record->magic)) != 0 ||
+           record->offset != position + sizeof(rawFrameRecord) ||
+           record->offset + record->size > reader->mapSize){
+            break;
+        }
+        if(reader->frameCount == capacity){
+            capacity = (capacity == 0) ? 64 : capacity * 2;
+            uint64_t* offsets = (uint64_t*) realloc(reader->scannedOffsets, capacity * sizeof(uint64_t));
+            if(offsets == NULL){
+                break;
+            }
+            reader->scannedOffsets = offsets;
+        }
+        reader->scannedOffsets[reader->frameCount++] = position;
+        position = record->offset + ((record->size + RAW_CONTAINER_ALIGNMENT - 1) & ~(uint64_t) (RAW_CONTAINER_ALIGNMENT - 1));
+    }
+}
+
+int rawContainerOpen(rawContainerReader* reader, const char* path){
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = open(path, O_RDONLY);
+    if(reader->fd < 0){
+        return 1;
+    }
+
+    struct stat fileStat;
+    if(fstat(reader->fd, &fileStat) != 0 || (size_t) fileStat.st_size < sizeof(rawContainerHeader)){
+        close(reader->fd);
+        return 1;
+    }
+    reader->mapSize = fileStat.st_size;
+    void* map = mmap(NULL, reader->mapSize, PROT_READ, MAP_SHARED, reader->fd, 0);
+    if(map == MAP_FAILED){
+        close(reader->fd);
+        return 1;
+    }
+    reader->map = (const uint8_t*) map;
+    reader->header = (const rawContainerHeader*) reader->map;
+
+    if(memcmp(reader->header->magic, RAW_CONTAINER_MAGIC, sizeof(reader->header->magic)) != 0 ||
+       reader->header->version != RAW_CONTAINER_VERSION ||
+       reader->header->recordSize != sizeof(rawFrameRecord)){
+        munmap(map, reader->mapSize);
+        close(reader->fd);
+        return 1;
+    }
+
+    if(reader->mapSize >= sizeof(rawContainerHeader) + sizeof(rawContainerFooter)){
+        const rawContainerFooter* footer = (const rawContainerFooter*) (reader->map + reader->mapSize - sizeof(rawContainerFooter));
+        size_t indexSize = (size_t) footer->frameCount * sizeof(rawFrameRecord);
+        if(memcmp(footer->magic, RAW_CONTAINER_FOOTER_MAGIC, sizeof(footer->magic)) == 0 &&
+           footer->indexOffset + indexSize == reader->mapSize - sizeof(rawContainerFooter) &&
+           rawContainerCrc32(reader->map + footer->indexOffset, indexSize) == footer->indexCrc){
+            reader->index = (const rawFrameRecord*) (reader->map + footer->indexOffset);
+            reader->frameCount = footer->frameCount;
+            return 0;
+        }
+    }
+
+    rawContainerScan(reader);
+    return 0;
+}
+
+// O(1) lookup, returns NULL when frameIndex is out of range.
+const rawFrameRecord* rawContainerRecord(const rawContainerReader* reader, uint32_t frameIndex){
+    if(frameIndex >= reader->frameCount){
+        return NULL;
+    }
+    if(reader->index != NULL){
+        return &reader->index[frameIndex];
+    }
+    return (const rawFrameRecord*) (reader->map + reader->scannedOffsets[frameIndex]);
+}
+
+const uint8_t* rawContainerPayload(const rawContainerReader* reader, uint32_t frameIndex){
+    const rawFrameRecord* record = rawContainerRecord(reader, frameIndex);
+    return (record == NULL) ? NULL : reader->map + record->offset;
+}
+
+bool rawContainerVerify(const rawContainerReader* reader, uint32_t frameIndex){
+    const rawFrameRecord* record = rawContainerRecord(reader, frameIndex);
+    return record != NULL && rawContainerCrc32(reader->map + record->offset, record->size) == record->crc;
+}
+
+void rawContainerCloseReader(rawContainerReader* reader){
+    munmap((void*) reader->map, reader->mapSize);
+    close(reader->fd);
+    free(reader->scannedOffsets);
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = -1;
+}
+
+#endif
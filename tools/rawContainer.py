@@ -0,0 +1,235 @@
+"""Seekable raw-frame container (.n3raw) for camera captures.
+
+The layout is shared with tools/rawContainer.h, all integers are little-endian:
+
+    header   32 bytes   magic "N33BLRAW", version, headerSize, recordSize,
+                        flags, createdMicros, frameCount, reserved
+    frames   N times    record (40 bytes) + payload, padded to 8 bytes
+    index    N records  copy of every frame record, in append order
+    footer   24 bytes   indexOffset, frameCount, indexCrc, magic "N33BLIDX"
+
+Record fields: magic "N3FR", size, offset (of the payload), sequence, width,
+height, format (firmware enum), bytesPerPixel, flags, crc (CRC-32 of the
+payload, same polynomial as zlib) and timestamp (device micros).
+
+Frames are appended while capturing, the index and footer are written on
+close. Frame i is found at indexOffset + i * recordSize, so seeking is O(1).
+A file without footer (interrupted capture) is recovered by scanning the
+inline records.
+"""
+
+import mmap
+import os
+import struct
+import time
+import zlib
+from collections import namedtuple
+
+containerMagic = b"N33BLRAW"
+footerMagic = b"N33BLIDX"
+recordMagic = b"N3FR"
+containerVersion = 1
+
+headerStruct = struct.Struct("<8sHHHHQII")
+recordStruct = struct.Struct("<4sIQIHHBBHIQ")
+footerStruct = struct.Struct("<QII8s")
+
+headerSize = headerStruct.size
+recordSize = recordStruct.size
+footerSize = footerStruct.size
+payloadAlignment = 8
+
+flagIndexed = 0x0001
+
+# Values match the Arduino_OV767X enums used by the firmware.
+formatYUV422 = 0
+formatRGB444 = 1
+formatRGB565 = 2
+formatGRAYSCALE = 4
+
+formatNames = {
+    formatYUV422: "YUV422",
+    formatRGB444: "RGB444",
+    formatRGB565: "RGB565",
+    formatGRAYSCALE: "GRAYSCALE",
+}
+
+formatBytesPerPixel = {
+    formatYUV422: 2,
+    formatRGB444: 2,
+    formatRGB565: 2,
+    formatGRAYSCALE: 1,
+}
+
+RawFrame = namedtuple("RawFrame", ["index", "offset", "size", "sequence", "width", "height", "format", "bytesPerPixel", "flags", "crc", "timestamp", "payload"])
+
+def formatFromName(name):
+    for code, formatName in formatNames.items():
+        if formatName == name.upper():
+            return code
+    raise ValueError(f"Unknown frame format: {name}")
+
+def alignedSize(size):
+    return (size + payloadAlignment - 1) & ~(payloadAlignment - 1)
+
+class RawContainerWriter:
+    """Append-only writer, frames are flushed to disk as soon as they are appended."""
+
+    def __init__(self, path, append=False):
+        self.path = path
+        self.index = bytearray()
+        self.frameCount = 0
+        self.closed = False
+
+        if append and os.path.exists(path) and os.path.getsize(path) > 0:
+            self.file = open(path, "r+b")
+            self._resume()
+        else:
+            self.file = open(path, "w+b")
+            self.createdMicros = time.time_ns() // 1000
+            self._writeHeader(0, 0)
+
+    def _writeHeader(self, flags, frameCount):
+        self.file.seek(0)
+        self.file.write(headerStruct.pack(containerMagic, containerVersion, headerSize, recordSize, flags, self.createdMicros, frameCount, 0))
+
+    def _resume(self):
+        # Drop the previous index and footer, new frames are appended after the last payload.
+        with RawContainerReader(self.path) as reader:
+            self.createdMicros = reader.createdMicros
+            for frameIndex in range(len(reader)):
+                self.index += reader.record(frameIndex)
+            self.frameCount = len(reader)
+            dataEnd = reader.dataEnd
+        self.file.truncate(dataEnd)
+        self._writeHeader(0, self.frameCount)
+        self.file.seek(dataEnd)
+
+    def append(self, payload, width, height, frameFormat, sequence=None, timestamp=0, flags=0):
+        if self.closed:
+            raise ValueError("Container already closed")
+        if frameFormat not in formatNames:
+            raise ValueError(f"Unsupported frame format: {frameFormat}")
+        if sequence is None:
+            sequence = self.frameCount
+
+        recordOffset = self.file.tell()
+        payloadOffset = recordOffset + recordSize
+        record = recordStruct.pack(recordMagic, len(payload), payloadOffset, sequence, width, height, frameFormat, formatBytesPerPixel[frameFormat], flags, zlib.crc32(payload), timestamp)
+
+        self.file.write(record)
+        self.file.write(payload)
+        self.file.write(b"\0" * (alignedSize(len(payload)) - len(payload)))
+        self.index += record
+        self.frameCount += 1
+        return self.frameCount - 1
+
+    def flush(self):
+        self.file.flush()
+
+    def close(self):
+        if self.closed:
+            return
+        indexOffset = self.file.tell()
+        self.file.write(self.index)
+        self.file.write(footerStruct.pack(indexOffset, self.frameCount, zlib.crc32(self.index), footerMagic))
+        self._writeHeader(flagIndexed, self.frameCount)
+        self.file.close()
+        self.closed = True
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, excType, excValue, traceback):
+        self.close()
+
+class RawContainerReader:
+    """Random access reader, payloads are zero-copy memoryviews into the mapped file."""
+
+    def __init__(self, path):
+        self.file = open(path, "rb")
+        self.map = mmap.mmap(self.file.fileno(), 0, access=mmap.ACCESS_READ)
+        self.view = memoryview(self.map)
+
+        magic, version, fileHeaderSize, fileRecordSize, self.flags, self.createdMicros, self.headerFrameCount, _ = headerStruct.unpack_from(self.map, 0)
+        if magic != containerMagic:
+            raise ValueError(f"{path} is not a raw frame container")
+        if version != containerVersion or fileHeaderSize != headerSize or fileRecordSize != recordSize:
+            raise ValueError(f"Unsupported raw container version {version}")
+
+        self.recovered = False
+        if not self._loadIndex():
+            self._scanIndex()
+            self.recovered = True
+
+    def _loadIndex(self):
+        if len(self.map) < headerSize + footerSize:
+            return False
+        indexOffset, frameCount, indexCrc, magic = footerStruct.unpack_from(self.map, len(self.map) - footerSize)
+        if magic != footerMagic or indexOffset + frameCount * recordSize != len(self.map) - footerSize:
+            return False
+        if zlib.crc32(self.view[indexOffset:indexOffset + frameCount * recordSize]) != indexCrc:
+            return False
+        self.indexOffset = indexOffset
+        self.frameCount = frameCount
+        self.dataEnd = indexOffset
+        self.scannedIndex = None
+        return True
+
+    def _scanIndex(self):
+        offsets = []
+        position = headerSize
+        while position + recordSize <= len(self.map):
+            magic, size, payloadOffset = struct.unpack_from("<4sIQ", self.map, position)
+            if magic != recordMagic or payloadOffset != position + recordSize or payloadOffset + size > len(self.map):
+                break
+            offsets.append(position)
+            position = payloadOffset + alignedSize(size)
+        self.scannedIndex = offsets
+        self.frameCount = len(offsets)
+        self.indexOffset = None
+        self.dataEnd = position
+
+    def recordOffset(self, frameIndex):
+        if frameIndex < 0:
+            frameIndex += self.frameCount
+        if not 0 <= frameIndex < self.frameCount:
+            raise IndexError("Frame index out of range")
+        if self.scannedIndex is not None:
+            return self.scannedIndex[frameIndex]
+        return self.indexOffset + frameIndex * recordSize
+
+    def record(self, frameIndex):
+        offset = self.recordOffset(frameIndex)
+        return bytes(self.view[offset:offset + recordSize])
+
+    def __len__(self):
+        return self.frameCount
+
+    def __getitem__(self, frameIndex):
+        if frameIndex < 0:
+            frameIndex += self.frameCount
+        _, size, offset, sequence, width, height, frameFormat, bytesPerPixel, flags, crc, timestamp = recordStruct.unpack_from(self.map, self.recordOffset(frameIndex))
+        return RawFrame(frameIndex, offset, size, sequence, width, height, frameFormat, bytesPerPixel, flags, crc, timestamp, self.view[offset:offset + size])
+
+    def __iter__(self):
+        for frameIndex in range(self.frameCount):
+            yield self[frameIndex]
+
+    def verify(self, frameIndex):
+        frame = self[frameIndex]
+        return zlib.crc32(frame.payload) == frame.crc
+
+    def close(self):
+        try:
+            self.view.release()
+            self.map.close()
+        except BufferError:
+            pass # Payload views are still alive, the mapping is released together with them.
+        self.file.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, excType, excValue, traceback):
+        self.close()
@@ -1,9 +1,15 @@
 import serial
 import argparse
+import json
+import os
 import re
+import time
+import zlib
 import cv2 as cv
 import numpy as np
 from PIL import Image
+import rawContainer
+import frameDecode
 
 defaultTimeout = 3
 requestPhotoTimeoutMultiply = 3
@@ -11,71 +17,139 @@ defaultDTR = False
 defaultRTS = False
 defaultMaxSize = 512
 defaultStopBytes = '\r\n'
+defaultCommandTerminator = '\r'
+defaultOutputPath = "test.jpg"
+defaultStreamFrames = 10
+defaultChunkBytes = 1024
+defaultChunkWindow = 16
+chunkPollSeconds = 0.02
+chunkSilenceSeconds = 0.05  # Nothing received for that long: the first chunk missing is asked for again.
 cameraResolutionHeight = 0
 cameraResolutionWidth = 0
 cameraFormat = None
 
-def communicate_device(port, baudrate, message, timeout=defaultTimeout, dtr=defaultDTR, rts=defaultRTS, encodeInput=None, encodeOutput=None, printSent=True, printReceived=True, maxSize=defaultMaxSize, stopBytes=defaultStopBytes):
-    try:
-        with serial.Serial(port, baudrate, timeout=timeout, dsrdtr=dtr, rtscts=rts) as serialDevice:
-            if encodeInput:
-                messageSent = message.encode('utf-8')
-            else:
-                messageSent = message
+def transact(serialDevice, message, encodeInput=None, encodeOutput=None, printSent=True, printReceived=True, maxSize=defaultMaxSize, stopBytes=defaultStopBytes):
+    if encodeInput:
+        messageSent = (message + defaultCommandTerminator).encode('utf-8')
+    else:
+        messageSent = message
+
+    serialDevice.write(messageSent)
+
+    if printSent:
+        print(f"Bytes sent {len(messageSent)}:\n {messageSent}")
+    
 
-            serialDevice.write(messageSent)
+    if stopBytes is None: # Binary payload, may contain the stop bytes.
+        messageReceived = serialDevice.read(maxSize)
+    else:
+        if isinstance(stopBytes, str):
+            stopBytes = stopBytes.encode('utf-8')
+        messageReceived = serialDevice.read_until(expected=stopBytes, size=maxSize)
+    if encodeOutput:
+        messageReceived = messageReceived.decode('utf-8')
 
-            if printSent:
-                print(f"Bytes sent {len(messageSent)}:\n {messageSent}")
-            
+    if printReceived:
+        print(f"Bytes received {len(messageReceived)}:\n {messageReceived}")
+    else:
+        print(f"Bytes received {len(messageReceived)}")
 
-            messageReceived = serialDevice.read_until(expected=stopBytes, size=maxSize)
-            if encodeOutput:
-                messageReceived = messageReceived.decode('utf-8')
+    return messageReceived
 
-            if printReceived:
-                print(f"Bytes received {len(messageReceived)}:\n {messageReceived}")
-            else:
-                print(f"Bytes received {len(messageReceived)}")
+def openDevice(port, baudrate, timeout=defaultTimeout, dtr=defaultDTR, rts=defaultRTS):
+    return serial.Serial(port, baudrate, timeout=timeout, dsrdtr=dtr, rtscts=rts)
 
-            return messageReceived
+commandRecord = re.compile(rb"R (\d{2}) (\d) (\d{10}) (\d{5})\r\n")
+commandStatus = {0: "ok", 1: "failed", 2: "busy", 3: "unknown"}
+
+def machineCommand(serialDevice, message):
+    """Sends a command to a board in "mode machine" and returns its record as (id, status, micros, payload),
+    None when no record came. Frames sent before the record are skipped."""
+    serialDevice.write((message + defaultCommandTerminator).encode('utf-8'))
+    line = b""
+    while not commandRecord.fullmatch(line):
+        line = serialDevice.read_until(expected=b"\r\n", size=defaultMaxSize)
+        if not line.endswith(b"\r\n"):
+            return None
+    commandId, status, micros, length = (int(field) for field in commandRecord.fullmatch(line).groups())
+    return commandId, status, micros, serialDevice.read(length)
+
+def communicate_device(port, baudrate, message, timeout=defaultTimeout, dtr=defaultDTR, rts=defaultRTS, encodeInput=None, encodeOutput=None, printSent=True, printReceived=True, maxSize=defaultMaxSize, stopBytes=defaultStopBytes):
+    try:
+        with openDevice(port, baudrate, timeout, dtr, rts) as serialDevice:
+            return transact(serialDevice, message, encodeInput, encodeOutput, printSent, printReceived, maxSize, stopBytes)
     except Exception as e:
         print(f"Error: {e}")
 
-def getCameraConfig(port, baudrate, timeout=defaultTimeout, dtr=defaultDTR, rts=defaultRTS, maxSize=defaultMaxSize, stopBytes=defaultStopBytes):
+settingsCborRecord = re.compile(rb"CBOR (\d+)\r\n")
+
+def decodeCbor(data, offset=0):
+    """Decodes the CBOR item at offset, the unsigned integers, text, arrays and maps "getCameraSettings --cbor"
+    sends. Returns the item and the offset after it."""
+    major, value = data[offset] >> 5, data[offset] & 0x1F
+    offset += 1
+    if value >= 24:
+        size = 1 << (value - 24)
+        value = int.from_bytes(data[offset:offset + size], "big")
+        offset += size
+    if major == 0:
+        return value, offset
+    if major == 3:
+        return data[offset:offset + value].decode('utf-8'), offset + value
+    if major == 4:
+        items = []
+        for _ in range(value):
+            item, offset = decodeCbor(data, offset)
+            items.append(item)
+        return items, offset
+    if major == 5:
+        items = {}
+        for _ in range(value):
+            key, offset = decodeCbor(data, offset)
+            items[key], offset = decodeCbor(data, offset)
+        return items, offset
+    raise Exception(f"Unsupported CBOR major type {major}")
+
+def readCameraSettings(serialDevice, encoding="json", maxSize=defaultMaxSize):
+    """The board's "getCameraSettings --json" or "--cbor" as a dict: model, resolution, sensorWidth, sensorHeight,
+    format, width, height (the frame sent), bytesPerPixel, frameBytes, fps, framePeriodUs, window and pins."""
+    serialDevice.write((f"getCameraSettings --{encoding}" + defaultCommandTerminator).encode('utf-8'))
+    line = serialDevice.read_until(expected=b"\r\n", size=maxSize)
     try:
-        response = communicate_device(
-            port=port,
-            baudrate=baudrate,
-            message="getCameraSettings",
-            timeout=timeout,
-            dtr=dtr,
-            rts=rts,
-            encodeInput=True,
-            encodeOutput=True,
-            printSent=True,
-            printReceived=False,
-            maxSize=maxSize,
-            stopBytes=stopBytes
-        )
+        if encoding == "json":
+            return json.loads(line)
+        header = settingsCborRecord.fullmatch(line)
+        document = serialDevice.read(int(header.group(1)) + 2)
+        return decodeCbor(document)[0]
+    except Exception:
+        raise Exception(f"Unexpected camera settings: {line!r}")
+
+# "events <class>...": the board sends "EVENT <name> <fields> <micros>\r\n" records unasked, between frames.
+eventRecord = re.compile(rb"EVENT (\w+)((?: \w+)*) (\d+)\r\n")
 
-        # Extract resolution (height and width)
-        resolution_match = re.search(r'Resolution:\s*\w+\s*\((\d+)x(\d+)\)', response)
-        if resolution_match:
-            global cameraResolutionWidth 
-            cameraResolutionWidth = int(resolution_match.group(1))
+def subscribeEvents(serialDevice, classes, maxSize=defaultMaxSize):
+    serialDevice.write((f"events {classes}" + defaultCommandTerminator).encode('utf-8'))
+    serialDevice.read_until(expected=b"\r\n", size=maxSize) # "Events: ..."
 
-            global cameraResolutionHeight 
-            cameraResolutionHeight = int(resolution_match.group(2))
-        else:
-            raise Exception("Failed to extract resolution")
+def readEvent(serialDevice, names, timeout, maxSize=defaultMaxSize):
+    """Reads up to the next event named in names, returns (name, fields, micros), None when none came in time."""
+    deadline = time.perf_counter() + timeout
+    while time.perf_counter() < deadline:
+        match = eventRecord.fullmatch(serialDevice.read_until(expected=b"\r\n", size=maxSize))
+        if match and match.group(1).decode() in names:
+            return match.group(1).decode(), match.group(2).decode().split(), int(match.group(3))
+    return None
 
-        # Extract format
-        format_match = re.search(r'Format:\s*(\w+)', response)
-        if format_match:
-            cameraFormat = format_match.group(1)
-        else:
-            raise Exception("Failed to extract format")
+def getCameraConfig(port, baudrate, timeout=defaultTimeout, dtr=defaultDTR, rts=defaultRTS, maxSize=defaultMaxSize, stopBytes=defaultStopBytes):
+    try:
+        with openDevice(port, baudrate, timeout, dtr, rts) as serialDevice:
+            settings = readCameraSettings(serialDevice, maxSize=maxSize)
+
+        # The frame sent, after the window of a profile
+        global cameraResolutionWidth, cameraResolutionHeight, cameraFormat
+        cameraResolutionWidth = settings["width"]
+        cameraResolutionHeight = settings["height"]
+        cameraFormat = settings["format"]
 
         print(f"Camera Resolution: {cameraResolutionWidth}x{cameraResolutionHeight}; Format: {cameraFormat}")
 
@@ -94,53 +168,180 @@ def requestPhoto(port, baudrate, timeout=defaultTimeout, dtr=defaultDTR, rts=def
             stopBytes=stopBytes
         )
         
-        response = communicate_device(
-            port=port,
-            baudrate=baudrate,
-            message="takePhoto",
-            timeout=requestPhotoTimeoutMultiply * timeout,
-            dtr=dtr,
-            rts=rts,
-            encodeInput=True,
-            encodeOutput=False,
-            printSent=True,
-            printReceived=False,
-            maxSize=2*cameraResolutionHeight*cameraResolutionWidth + 2,
-            stopBytes=stopBytes
-        )
+        # The board says when the frame was read and how large it is, the bytes follow the "frame" event.
+        with openDevice(port, baudrate, timeout, dtr, rts) as serialDevice:
+            subscribeEvents(serialDevice, "frame error")
+            serialDevice.write(("takePhoto" + defaultCommandTerminator).encode('utf-8'))
+            print("Photo requested")
+            event = readEvent(serialDevice, ("frame", "error"), requestPhotoTimeoutMultiply * timeout)
+            if event is None or event[0] == "error":
+                subscribeEvents(serialDevice, "none")
+                raise Exception(f"No photo received{': ' + event[1][0] if event else ''}")
+            response = serialDevice.read(int(event[1][1]) + len(stopBytes))
+            subscribeEvents(serialDevice, "none")
+        print(f"Bytes received {len(response)}")
 
         return response
     except Exception as e:
         print(f"Error: {e}")
 
+# "stream start --frames N": every frame comes as "FRAME <sequence> <bytes> <micros>\r\n", the frame and "\r\n".
+# A frame dropped after part of it was sent is padded with zeros and ends with "!\r\n" instead, it does not count.
+# With "autoConfig" on, a "MODE <width> <height> <format> <fps>\r\n" record comes before frames of new settings.
+def streamPhotos(port, baudrate, frames=defaultStreamFrames, timeout=defaultTimeout, dtr=defaultDTR, rts=defaultRTS, maxSize=defaultMaxSize, stopBytes=defaultStopBytes):
+    getCameraConfig(
+        port=port,
+        baudrate=baudrate,
+        timeout=timeout,
+        dtr=dtr,
+        rts=rts,
+        maxSize=maxSize,
+        stopBytes=stopBytes
+    )
+
+    receivedFrames = []
+    frameMode = (cameraResolutionWidth, cameraResolutionHeight, cameraFormat)
+    try:
+        with openDevice(port, baudrate, requestPhotoTimeoutMultiply * timeout, dtr, rts) as serialDevice:
+            transact(serialDevice, f"stream start --frames {frames}", encodeInput=True, encodeOutput=True, printSent=True, printReceived=True, maxSize=maxSize, stopBytes=stopBytes)
+            while len(receivedFrames) < frames:
+                header = serialDevice.read_until(expected=stopBytes.encode('utf-8'), size=maxSize).decode('utf-8', errors='replace')
+                mode_match = re.match(r'MODE (\d+) (\d+) (\w+) (\d+)', header)
+                if mode_match:
+                    frameMode = (int(mode_match.group(1)), int(mode_match.group(2)), mode_match.group(3))
+                    print(f"Camera Resolution: {frameMode[0]}x{frameMode[1]}; Format: {frameMode[2]}; {mode_match.group(4)} fps")
+                    continue
+                header_match = re.match(r'FRAME (\d+) (\d+) (\d+)', header)
+                if not header_match:
+                    raise Exception(f"Unexpected stream line: {header.strip()}")
+                frameSize = int(header_match.group(2))
+                rawBytes = serialDevice.read(frameSize)
+                if len(rawBytes) < frameSize:
+                    raise Exception(f"Frame {header_match.group(1)} truncated, {len(rawBytes)}/{frameSize} bytes")
+                trailer = serialDevice.read_until(expected=stopBytes.encode('utf-8'), size=maxSize)
+                if trailer.startswith(b'!'):
+                    print(f"Frame {header_match.group(1)} torn, skipped")
+                    continue
+                receivedFrames.append((int(header_match.group(1)), int(header_match.group(3)), rawBytes[:frameSize], frameMode))
+                print(f"Frame {header_match.group(1)}: {frameSize} bytes at {header_match.group(3)} us")
+            serialDevice.read_until(expected=stopBytes.encode('utf-8'), size=maxSize) # "Stream finished."
+    except Exception as e:
+        print(f"Error: {e}")
+
+    return receivedFrames
+
+# "takePhoto --chunked": the frame comes in "CHUNK <transfer> <index> <offset> <bytes> <crc32>\r\n" records after a
+# "TRANSFER <transfer> <bytes> <chunk bytes> <chunks> <window>\r\n" one. Every record is checked, so a lost or damaged
+# one is found by its CRC or by the gap it leaves, and asked for again with "transfer nack"; "transfer ack" moves
+# the window past the chunks received in order.
+transferRecord = re.compile(rb"TRANSFER (\d+) (\d+) (\d+) (\d+) (\d+)\r\n")
+chunkRecord = re.compile(rb"CHUNK (\d+) (\d+) (\d+) (\d+) ([0-9a-f]{8})\r\n")
+
+def requestChunkedPhoto(port, baudrate, timeout=defaultTimeout, dtr=defaultDTR, rts=defaultRTS, maxSize=defaultMaxSize, stopBytes=defaultStopBytes, chunkBytes=defaultChunkBytes, window=defaultChunkWindow):
+    getCameraConfig(
+        port=port,
+        baudrate=baudrate,
+        timeout=timeout,
+        dtr=dtr,
+        rts=rts,
+        maxSize=maxSize,
+        stopBytes=stopBytes
+    )
+
+    def send(serialDevice, message):
+        serialDevice.write((message + defaultCommandTerminator).encode('utf-8'))
+
+    try:
+        with openDevice(port, baudrate, chunkPollSeconds, dtr, rts) as serialDevice:
+            send(serialDevice, f"takePhoto --chunked --chunk-bytes {chunkBytes} --window {window}")
+            buffer = bytearray()
+            deadline = time.perf_counter() + requestPhotoTimeoutMultiply * timeout
+            # The record is sent again while nothing is acknowledged, one damaged on the way does not match the settings.
+            expectedBytes = rawContainer.formatBytesPerPixel[rawContainer.formatFromName(cameraFormat)] * cameraResolutionWidth * cameraResolutionHeight
+            transfer = None
+            while transfer is None:
+                buffer += serialDevice.read(max(1, serialDevice.in_waiting))
+                for match in transferRecord.finditer(buffer):
+                    transferId, frameBytes, chunkBytes, chunks = (int(value) for value in match.groups()[:4])
+                    if frameBytes == expectedBytes and chunks == -(-frameBytes // chunkBytes):
+                        transfer = match
+                        break
+                if transfer is None and time.perf_counter() > deadline:
+                    raise Exception(f"No transfer started: {bytes(buffer[-maxSize:])}")
+            del buffer[:transfer.end()]
+
+            frame = bytearray(frameBytes)
+            received = [False] * chunks
+            acked = 0
+            highest = -1
+            nacked = {}
+            damaged = 0
+            nacks = 0
+            start = time.perf_counter()
+            lastData = start
+            while acked < chunks:
+                data = serialDevice.read(max(1, serialDevice.in_waiting))
+                now = time.perf_counter()
+                if data:
+                    buffer += data
+                    lastData = now
+                elif now - lastData > requestPhotoTimeoutMultiply * timeout:
+                    raise Exception(f"Transfer {transferId} stalled at {acked}/{chunks} chunks")
+
+                while True:
+                    match = chunkRecord.search(buffer)
+                    if match is None:
+                        del buffer[:-64] # Keep a header cut in two.
+                        break
+                    index, offset, size = (int(value) for value in match.groups()[1:4])
+                    end = match.end() + size + 2
+                    if len(buffer) < end and size <= chunkBytes:
+                        del buffer[:match.start()]
+                        break
+                    payload = bytes(buffer[match.end():match.end() + size])
+                    valid = (int(match.group(1)) == transferId and index < chunks and offset == index * chunkBytes
+                             and size == min(chunkBytes, frameBytes - offset) and buffer[end - 2:end] == b"\r\n"
+                             and zlib.crc32(payload) == int(match.group(5), 16))
+                    if not valid:
+                        damaged += 1
+                        if int(match.group(1)) == transferId and index < chunks:
+                            highest = max(highest, index) # Asked for again below, unless the header itself was hit.
+                        del buffer[:match.start() + 1] # Resynchronise on the next header.
+                        continue
+                    del buffer[:end]
+                    frame[offset:offset + size] = payload
+                    received[index] = True
+                    highest = max(highest, index)
+
+                # Chunks missing before the last one received, or before the window when the link went quiet.
+                if now - lastData > chunkSilenceSeconds and acked < chunks:
+                    highest = max(highest, acked)
+                    lastData = now
+                for index in range(acked, highest + 1):
+                    if not received[index] and now - nacked.get(index, 0) > chunkSilenceSeconds:
+                        send(serialDevice, f"transfer nack {index}")
+                        nacked[index] = now
+                        nacks += 1
+
+                first = acked
+                while acked < chunks and received[acked]:
+                    acked += 1
+                if acked != first:
+                    send(serialDevice, f"transfer ack {acked}")
+
+            elapsed = time.perf_counter() - start
+            print(f"Transfer {transferId}: {frameBytes} bytes in {chunks} chunks, {elapsed:.3f} s, goodput {frameBytes / elapsed / 1000:.1f} kB/s, {damaged} damaged, {nacks} nacks")
+            return bytes(frame) + stopBytes.encode('utf-8') # Same shape as requestPhoto()
+    except Exception as e:
+        print(f"Error: {e}")
+
 def processPhoto(rawBytes, photoWidth, photoHeight, bitShuffle=True):
-    rawData = np.zeros(len(rawBytes), dtype=np.uint8)
-    rawImage = np.zeros((photoHeight, photoWidth, 3), dtype=np.uint8)
-
-    for byteIndex in range(0, len(rawBytes)):
-        rawData[byteIndex] = rawBytes[byteIndex]
-
-    for rowIndex in range(0, photoHeight):
-        for colIndex in range(0, photoWidth):
-            pixelLowIndex = (rowIndex * photoWidth + colIndex) * 2 + 1
-            pixelHighIndex = (rowIndex * photoWidth + colIndex) * 2
-
-            if bitShuffle:
-                rawData[pixelLowIndex] = (rawData[pixelLowIndex] & 0xFC) | ((rawData[pixelLowIndex] & 0x01) << 1) | ((rawData[pixelLowIndex] & 0x02) >> 1)
-                rawData[pixelHighIndex] = (rawData[pixelHighIndex] & 0xFC) | ((rawData[pixelHighIndex] & 0x01) << 1) | ((rawData[pixelHighIndex] & 0x02) >> 1)
-
-            # BGR565
-            # FEDCBA98 76543210
-            # RRRRRGGG GGGBBBBB
-
-            #blue
-            rawImage[rowIndex, colIndex, 0] = ((rawData[pixelLowIndex] >> 0) & 0x1F) << 3
-            #green
-            rawImage[rowIndex, colIndex, 1] = (((rawData[pixelHighIndex] >> 0) & 0x07) << 5) | (((rawData[pixelLowIndex] >> 5) & 0x07) << 2) 
-            #red
-            rawImage[rowIndex, colIndex, 2] = ((rawData[pixelHighIndex] >> 3) & 0x1F) << 3
-    
-    return rawImage
+    return frameDecode.decodeRGB565(rawBytes, photoWidth, photoHeight, bitShuffle)
+
+def saveRawPhoto(rawBytes, containerPath, photoWidth, photoHeight, photoFormat):
+    with rawContainer.RawContainerWriter(containerPath, append=True) as container:
+        frameIndex = container.append(rawBytes, photoWidth, photoHeight, rawContainer.formatFromName(photoFormat))
+    print(f"Raw frame {frameIndex} stored in {containerPath}")
 
 def savePhoto(rawImage, outputPath, displayImage=False):
     cv.imwrite(outputPath, rawImage)
@@ -150,7 +351,7 @@ def savePhoto(rawImage, outputPath, displayImage=False):
 
 def main():
     parser = argparse.ArgumentParser(description="Communicate with a serial device")
-    parser.add_argument("command", choices=["sendCommand", "getCameraConfig", "requestPhoto"], help="Command to execute")
+    parser.add_argument("command", choices=["sendCommand", "getCameraConfig", "requestPhoto", "streamPhotos"], help="Command to execute")
     parser.add_argument("--port", "-p", type=str, help="Serial port")
     parser.add_argument("--baudrate", "-b", type=int, help="Baud rate")
     parser.add_argument("--message", "-m", type=str, help="Message to send")
@@ -159,6 +360,12 @@ def main():
     parser.add_argument("--rts", "-r", action="store_true", help="Set RTS", default=defaultRTS)
     parser.add_argument("--maxSize", "-s", type=int, help="Max receive size in bytes", default=defaultMaxSize)
     parser.add_argument("--stopBytes", "-sb", type=str, help="Stop bytes", default=defaultStopBytes)
+    parser.add_argument("--raw", type=str, help="Append the raw frame to this .n3raw container")
+    parser.add_argument("--output", "-o", type=str, help=f"Decoded image path (default {defaultOutputPath} when --raw is not used), streamed frames add their sequence number")
+    parser.add_argument("--frames", "-n", type=int, help=f"Frames to stream (default {defaultStreamFrames})", default=defaultStreamFrames)
+    parser.add_argument("--chunked", action="store_true", help="requestPhoto in acknowledged, CRC checked chunks, missing ones are sent again")
+    parser.add_argument("--chunkBytes", type=int, help=f"Chunk size with --chunked (default {defaultChunkBytes})", default=defaultChunkBytes)
+    parser.add_argument("--window", type=int, help=f"Chunks in flight with --chunked (default {defaultChunkWindow})", default=defaultChunkWindow)
 
     args = parser.parse_args()
 
@@ -189,6 +396,28 @@ def main():
             stopBytes=args.stopBytes
         )
 
+    elif args.command == "requestPhoto" and args.chunked:
+        rawImage = requestChunkedPhoto(
+            port=args.port,
+            baudrate=args.baudrate,
+            timeout=args.timeout,
+            dtr=args.dtr,
+            rts=args.rts,
+            maxSize=args.maxSize,
+            stopBytes=args.stopBytes,
+            chunkBytes=args.chunkBytes,
+            window=args.window
+        )
+        if rawImage is None:
+            return
+        if args.raw:
+            saveRawPhoto(rawImage[:-len(args.stopBytes)], args.raw, cameraResolutionWidth, cameraResolutionHeight, cameraFormat)
+
+        outputPath = args.output if args.output or args.raw else defaultOutputPath
+        if outputPath:
+            processedImage = frameDecode.decodeFrame(rawImage, cameraResolutionWidth, cameraResolutionHeight, rawContainer.formatFromName(cameraFormat))
+            savePhoto(processedImage, outputPath)
+
     elif args.command == "requestPhoto":
         rawImage = requestPhoto(
             port=args.port,
@@ -201,8 +430,34 @@ def main():
         )
 
         #print(f"Raw image dimensions: {cameraResolutionWidth}x{cameraResolutionHeight}")
-        processedImage = processPhoto(rawImage, cameraResolutionWidth, cameraResolutionHeight)
-        savePhoto(processedImage, "test.jpg", True)
+        if args.raw:
+            saveRawPhoto(rawImage[:-len(args.stopBytes)], args.raw, cameraResolutionWidth, cameraResolutionHeight, cameraFormat)
+
+        outputPath = args.output if args.output or args.raw else defaultOutputPath
+        if outputPath:
+            processedImage = frameDecode.decodeFrame(rawImage, cameraResolutionWidth, cameraResolutionHeight, rawContainer.formatFromName(cameraFormat))
+            savePhoto(processedImage, outputPath, True)
+
+    elif args.command == "streamPhotos":
+        receivedFrames = streamPhotos(
+            port=args.port,
+            baudrate=args.baudrate,
+            frames=args.frames,
+            timeout=args.timeout,
+            dtr=args.dtr,
+            rts=args.rts,
+            maxSize=args.maxSize,
+            stopBytes=args.stopBytes
+        )
+
+        outputPath = args.output if args.output or args.raw else defaultOutputPath
+        for sequence, frameMicros, rawImage, (frameWidth, frameHeight, frameFormat) in receivedFrames:
+            if args.raw:
+                saveRawPhoto(rawImage, args.raw, frameWidth, frameHeight, frameFormat)
+            if outputPath:
+                stem, extension = os.path.splitext(outputPath)
+                processedImage = frameDecode.decodeFrame(rawImage, frameWidth, frameHeight, rawContainer.formatFromName(frameFormat))
+                savePhoto(processedImage, f"{stem}_{sequence:04d}{extension}")
 
 if __name__ == "__main__":
     main()